@@ -0,0 +1,97 @@
+/*
+ * at_engine.h
+ */
+
+#ifndef AT_ENGINE_H_
+#define AT_ENGINE_H_
+
+#include <wifi.h>
+#include <at_match.h>
+#include <at_timeout.h>
+#include <ring.h>
+
+/*Number of commands that can be queued at the same time*/
+#define AT_QUEUE_SIZE          4
+/*Maximum size of a queued command, including the trailing \r\n*/
+#define AT_COMMAND_SIZE        128
+
+/*Maximum number of data frames scanned ahead of the response matcher*/
+#define AT_FRAMES              4
+/*Longest data frame header, e.g. "+IPD,4,2048:"*/
+#define AT_FRAME_HEADER_SIZE   24
+
+/*Total of the chunks of a transparent transmission, the stream has no length*/
+#define AT_STREAM_TOTAL        0xFFFFFFFFU
+
+/*The command may be transmitted while the previous one is still in flight*/
+#define AT_FLAG_PIPELINE       0x01
+/*The payload is transmitted once the module sent the ">" prompt, not right after the command*/
+#define AT_FLAG_PROMPT         0x02
+/*The latency depends on the arguments, e.g. AT+CWJAP=, the learned timeout never goes below the caller's*/
+#define AT_FLAG_TIMEOUT_FLOOR  0x04
+
+/*Handle of a submitted command, negative when the submission failed*/
+typedef int32_t at_handleType;
+
+/**
+ * @brief Response handed to the completion callback.
+ */
+struct at_response
+{
+    WiFi_resultType result;      // Result code, ESP-AT error code and latency
+    ring_viewType view;          // The response in the receive ring, valid during the callback only, see at_hold()
+};
+
+typedef struct at_response at_responseType;
+
+/*Completion callback, called from at_poll() in the context of the main loop*/
+typedef void (*at_callbackType)(at_handleType handle, const at_responseType *response, void *context);
+
+/**
+ * @brief Part of the payload of a data frame ("+IPD,<len>:" or "+CIPRECVDATA:<len>,").
+ */
+struct at_chunk
+{
+    int8_t link;                 // Link ID of the frame, -1 in single connection mode
+    uint32_t total;              // Payload length advertised by the frame header, AT_STREAM_TOTAL in passthrough mode
+    uint32_t offset;             // Position of the chunk in the payload
+    ring_viewType view;          // Bytes of the chunk in the receive ring, valid during the handler only
+};
+
+typedef struct at_chunk at_chunkType;
+
+/*Data handler, called from at_poll() with the payload bytes as they arrive*/
+typedef void (*at_data_handlerType)(const at_chunkType *chunk, void *context);
+
+/**
+ * @brief Command waiting in the queue or in flight.
+ */
+struct at_command
+{
+    char text[AT_COMMAND_SIZE];      // Command followed by \r\n
+    uint32_t length;                 // Number of bytes to transmit
+    const char *exp_end;             // Expected terminator, must outlive the command
+    const char *exp_fail;            // Failure result of this command only, NULL if none
+    uint32_t timeout;                // Time allowed for the response in ms, until it is learned
+    int8_t latency;                  // Latency estimator of the command type, -1 if none
+    uint8_t flags;                   // AT_FLAG_PIPELINE, AT_FLAG_PROMPT, AT_FLAG_TIMEOUT_FLOOR
+    const char *payload;             // Data that follows the command, NULL if none. Not copied
+    uint32_t payload_length;         // Length of the payload
+    at_callbackType callback;        // Completion callback, may be NULL
+    void *context;                   // Passed back to the callback
+};
+
+typedef struct at_command at_commandType;
+
+/*Function prototypes*/
+at_handleType at_submit(const char *command, const char *exp_end, uint32_t timeout, uint8_t flags, at_callbackType callback, void *context);
+at_handleType at_submit_data(const char *command, const char *exp_end, const char *exp_fail, const char *payload, uint32_t length, uint32_t timeout, uint8_t flags, at_callbackType callback, void *context);
+uint32_t at_poll(void);
+bool at_pending(at_handleType handle);
+bool at_idle(void);
+void at_hold(void);
+void at_data_register(at_data_handlerType handler, void *context);
+void at_passthrough(bool enable);
+void at_release(void);
+
+#endif /* AT_ENGINE_H_ */
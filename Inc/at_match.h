@@ -0,0 +1,55 @@
+/*
+ * at_match.h
+ */
+
+#ifndef AT_MATCH_H_
+#define AT_MATCH_H_
+
+#include <stdint.h>
+
+/*Maximum number of patterns tracked at the same time: the terminator, the failure codes, a command's own failure result and the prompt*/
+#define AT_MATCH_MAX_PATTERNS   7
+/*Maximum length of a pattern*/
+#define AT_MATCH_MAX_LENGTH     16
+/*Pattern only matches at the beginning of a line*/
+#define AT_MATCH_LINE_START     0x01
+
+/**
+ * @brief One pattern of the matcher with its KMP failure table.
+ */
+struct at_pattern
+{
+    const char *text;                         // Pattern characters
+    uint8_t length;                           // Pattern length
+    uint8_t flags;                            // AT_MATCH_xxx flags
+    uint8_t state;                            // Characters matched so far
+    uint8_t failure[AT_MATCH_MAX_LENGTH];     // Longest proper prefix that is also a suffix
+};
+
+typedef struct at_pattern at_patternType;
+
+/**
+ * @brief Streaming multi-pattern matcher.
+ *
+ * Bytes are fed once, in arbitrary chunks, and every pattern advances by its
+ * KMP automaton, so the cost per response is linear in its length no matter
+ * how many times the caller polls.
+ */
+struct at_matcher
+{
+    at_patternType patterns[AT_MATCH_MAX_PATTERNS];
+    uint8_t count;           // Number of patterns in use
+    uint8_t line_start;      // The next byte starts a line
+    uint32_t position;       // Bytes fed since the last reset
+    uint32_t match_end;      // Stream position right after the last match
+};
+
+typedef struct at_matcher at_matcherType;
+
+/*Function prototypes*/
+void at_match_init(at_matcherType *matcher);
+int at_match_add(at_matcherType *matcher, const char *pattern, uint8_t flags);
+void at_match_reset(at_matcherType *matcher);
+int at_match_feed(at_matcherType *matcher, const char *data, uint32_t length, uint32_t *used);
+
+#endif /* AT_MATCH_H_ */
@@ -0,0 +1,60 @@
+/*
+ * at_parse.h
+ */
+
+#ifndef AT_PARSE_H_
+#define AT_PARSE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <ring.h>
+
+/**
+ * @brief Types of the fields of a response line.
+ */
+typedef enum at_field_type
+{
+    AT_FIELD_INT    = 0,   /*Signed decimal, leading spaces skipped, stored in 1, 2 or 4 bytes.*/
+    AT_FIELD_STRING = 1,   /*Raw text up to the delimiter, truncated to the size of the destination.*/
+    AT_FIELD_QUOTED = 2,   /*Text between double quotes, the quotes are not stored.*/
+    AT_FIELD_SKIP   = 3    /*Text up to the delimiter, not stored.*/
+}at_field_t;
+
+/**
+ * @brief Field of a response line, stored at an offset of the destination struct.
+ */
+struct at_field
+{
+    uint8_t type;          // at_field_t
+    char delimiter;        // Character that ends the field, '\0' for the end of the line
+    uint16_t offset;       // Offset of the member in the destination struct
+    uint16_t size;         // Size of the member in bytes
+};
+
+typedef struct at_field at_fieldType;
+
+/**
+ * @brief Layout of the data line of a response.
+ */
+struct at_schema
+{
+    const char *prefix;            // Start of the data line, e.g. "+CWJAP:"
+    const at_fieldType *fields;    // Fields in the order they appear
+    uint8_t count;                 // Number of fields
+};
+
+typedef struct at_schema at_schemaType;
+
+/*Field descriptors of a member of a destination struct*/
+#define AT_INT(type, member, delimiter)     { AT_FIELD_INT,    (delimiter), offsetof(type, member), sizeof(((type *)0)->member) }
+#define AT_STRING(type, member, delimiter)  { AT_FIELD_STRING, (delimiter), offsetof(type, member), sizeof(((type *)0)->member) }
+#define AT_QUOTED(type, member, delimiter)  { AT_FIELD_QUOTED, (delimiter), offsetof(type, member), sizeof(((type *)0)->member) }
+#define AT_SKIP(delimiter)                  { AT_FIELD_SKIP,   (delimiter), 0, 0 }
+
+/*Schema of a fields table*/
+#define AT_SCHEMA(prefix, fields)           { (prefix), (fields), sizeof(fields) / sizeof((fields)[0]) }
+
+/*Function prototypes*/
+int at_parse(const at_schemaType *schema, const ring_viewType *view, void *out);
+
+#endif /* AT_PARSE_H_ */
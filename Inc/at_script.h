@@ -0,0 +1,79 @@
+/*
+ * at_script.h
+ */
+
+#ifndef AT_SCRIPT_H_
+#define AT_SCRIPT_H_
+
+#include <at_engine.h>
+#include <at_parse.h>
+
+/*The step does not wait for the outcome of the previous one*/
+#define AT_STEP_INDEPENDENT    0x01
+
+/*Transmit independent steps without waiting for the previous terminator*/
+#define AT_SCRIPT_PIPELINE     0x01
+
+/**
+ * @brief What the script does when a step does not end with its terminator.
+ */
+typedef enum at_fail
+{
+    AT_FAIL_ABORT    = 0,   /*Stop the script and report the step.*/
+    AT_FAIL_CONTINUE = 1,   /*Ignore the failure and go on with the next step.*/
+    AT_FAIL_RETRY    = 2    /*Send the step again, abort after its retries.*/
+}at_failType;
+
+/*Decides when a step is due whether it is needed at all, context is the one given to at_script_run()*/
+typedef bool (*at_skipType)(void *context);
+
+/**
+ * @brief Step of a script, meant to live in flash.
+ */
+struct at_step
+{
+    const char *command;         // Command without \r\n
+    const char *exp_end;         // Expected terminator
+    const at_schemaType *schema; // Data line parsed on success, NULL if the response carries no data
+    void *out;                   // Struct described by the schema
+    at_skipType skip;            // Skips the step when it returns true, NULL to always run it
+    uint32_t timeout;            // Time allowed for the response in ms
+    at_failType on_fail;         // Failure policy
+    uint8_t retries;             // Extra attempts with AT_FAIL_RETRY
+    uint8_t flags;               // AT_STEP_INDEPENDENT
+};
+
+typedef struct at_step at_stepType;
+
+/**
+ * @brief A sequence of steps executed back to back.
+ */
+struct at_script
+{
+    const char *name;            // Shown in the latency report
+    const at_stepType *steps;    // Table of steps
+    uint32_t count;              // Number of steps
+    uint8_t flags;               // AT_SCRIPT_PIPELINE
+};
+
+typedef struct at_script at_scriptType;
+
+/**
+ * @brief Outcome and latency of a script run.
+ */
+struct at_script_report
+{
+    WiFi_resultType result;      // Outcome of the step that aborted the script, else of the last step
+    int32_t failed_step;         // Index of the step that aborted the script, -1 if none did
+    uint32_t executed;           // Commands transmitted, retries included
+    uint32_t skipped;            // Steps that were not needed
+    uint32_t elapsed;            // Time from the first submission to the last completion in ms
+    uint32_t command_time;       // Sum of the response times of the commands in ms
+};
+
+typedef struct at_script_report at_script_reportType;
+
+/*Function prototypes*/
+WiFi_res_t at_script_run(const at_scriptType *script, void *context, at_script_reportType *report);
+
+#endif /* AT_SCRIPT_H_ */
@@ -0,0 +1,47 @@
+/*
+ * at_timeout.h
+ */
+
+#ifndef AT_TIMEOUT_H_
+#define AT_TIMEOUT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <rtt.h>
+
+/*Number of command types whose latency is learned*/
+#define AT_TIMEOUT_ENTRIES       16
+/*Longest command type, e.g. "AT+CWRECONNCFG", including the NUL*/
+#define AT_TIMEOUT_NAME_SIZE     16
+/*Responses observed before the learned timeout replaces the caller's one*/
+#define AT_TIMEOUT_MIN_SAMPLES   3
+/*Shortest timeout ever derived in ms*/
+#define AT_TIMEOUT_FLOOR         200
+/*Longest timeout ever derived in ms, back-off included*/
+#define AT_TIMEOUT_CEILING       20000
+
+/**
+ * @brief Latency estimator of a command type, see rtt.h.
+ */
+struct at_latency
+{
+    char command[AT_TIMEOUT_NAME_SIZE];   // Command type, the command up to '=' or '?'
+    rtt_estimatorType latency;            // Time from transmission to the final result code
+    uint16_t timeouts;                    // Responses that never came
+    uint8_t backoff;                      // Consecutive timeouts, doubles the timeout each
+};
+
+typedef struct at_latency at_latencyType;
+
+/*Function prototypes*/
+int at_timeout_lookup(const char *command);
+uint32_t at_timeout_get(int index, uint32_t fallback);
+void at_timeout_sample(int index, uint32_t elapsed);
+void at_timeout_expired(int index);
+void at_timeout_answered(int index);
+const at_latencyType *at_timeout_table(uint32_t *count);
+uint32_t at_timeout_mean(const at_latencyType *entry);
+uint32_t at_timeout_value(const at_latencyType *entry);
+void at_timeout_print(void);
+
+#endif /* AT_TIMEOUT_H_ */
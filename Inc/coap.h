@@ -0,0 +1,116 @@
+/*
+ * coap.h
+ */
+
+#ifndef COAP_H_
+#define COAP_H_
+
+#include <socket.h>
+
+/*Default UDP port of CoAP*/
+#define COAP_PORT              5683
+/*Largest message sent or received, header and options included*/
+#define COAP_MESSAGE_SIZE      128
+/*Block size exponent of Block1 and Block2: 2^(4 + SZX) bytes, 2 gives 64 bytes*/
+#define COAP_BLOCK_SZX         2
+/*Initial ACK timeout in ms, randomized up to 1.5 times (RFC 7252 ACK_TIMEOUT, ACK_RANDOM_FACTOR)*/
+#define COAP_ACK_TIMEOUT       2000
+/*Retransmissions of a confirmable message (RFC 7252 MAX_RETRANSMIT)*/
+#define COAP_MAX_RETRANSMIT    4
+/*Time to wait for a separate response, or for the response to a non-confirmable request, in ms*/
+#define COAP_RESPONSE_TIMEOUT  10000
+/*Bytes of the tokens the client generates*/
+#define COAP_TOKEN_SIZE        4
+
+/*Request methods*/
+#define COAP_GET               1
+#define COAP_POST              2
+#define COAP_PUT               3
+#define COAP_DELETE            4
+
+/*Response code from its class and detail, e.g. COAP_CODE(2, 5) for 2.05 Content*/
+#define COAP_CODE(class, detail)   (((class) << 5) | (detail))
+#define COAP_CODE_CLASS(code)      ((code) >> 5)
+
+/*Content formats*/
+#define COAP_FORMAT_NONE       -1
+#define COAP_FORMAT_TEXT       0
+#define COAP_FORMAT_JSON       50
+#define COAP_FORMAT_CBOR       60
+
+/**
+ * @brief Request sent by coap_request().
+ */
+struct coap_request
+{
+    uint8_t method;                  // COAP_GET, COAP_POST, COAP_PUT or COAP_DELETE
+    const char *path;                // e.g. "telemetry/batch", sent as Uri-Path options
+    bool confirmable;                // CON, retransmitted until acknowledged, or NON
+    int16_t format;                  // Content-Format of the payload, COAP_FORMAT_NONE if none
+    const uint8_t *payload;          // Sent in Block1 blocks if it does not fit one message
+    uint32_t length;
+};
+
+typedef struct coap_request coap_requestType;
+
+/**
+ * @brief Response, or one block of it, valid only during the handler call.
+ */
+struct coap_response
+{
+    uint8_t code;                    // e.g. COAP_CODE(2, 5)
+    const uint8_t *payload;
+    uint32_t length;
+    uint32_t offset;                 // Position of the block in the whole representation
+    bool more;                       // More blocks follow
+    int32_t observe;                 // Observe sequence number of a notification, -1 if none
+};
+
+typedef struct coap_response coap_responseType;
+
+/*Consumer of a response, called once per block*/
+typedef void (*coap_handlerType)(const coap_responseType *response, void *context);
+
+/**
+ * @brief Counters of a client.
+ */
+struct coap_stats
+{
+    uint32_t requests;               // Messages sent, retransmissions excluded
+    uint32_t retransmits;
+    uint32_t timeouts;               // Requests that got no response
+    uint32_t resets;                 // Requests the server rejected with RST
+    uint32_t notifications;          // Observe notifications delivered
+};
+
+typedef struct coap_stats coap_statsType;
+
+/**
+ * @brief CoAP client over a UDP socket, one request at a time.
+ */
+struct coap_client
+{
+    socket_handleType socket;        // Socket to the server
+    uint16_t message_id;             // Message ID of the next message
+    uint32_t random;                 // State of the generator of tokens and timeouts
+    uint8_t token[COAP_TOKEN_SIZE];  // Token of the request in progress
+    uint8_t observe_token[COAP_TOKEN_SIZE];
+    coap_handlerType observer;       // Handler of the notifications, NULL if nothing is observed
+    void *observer_context;
+    int32_t observe_sequence;        // Observe value of the last notification
+    uint32_t observe_time;           // Tick of the last notification
+    uint8_t tx[COAP_MESSAGE_SIZE];   // Message being sent
+    uint8_t rx[COAP_MESSAGE_SIZE];   // Message being received
+    coap_statsType stats;
+};
+
+typedef struct coap_client coap_clientType;
+
+/*Function prototypes*/
+void coap_init(coap_clientType *client, socket_handleType socket);
+WiFi_res_t coap_request(coap_clientType *client, const coap_requestType *request, coap_handlerType handler, void *context);
+WiFi_res_t coap_observe(coap_clientType *client, const char *path, coap_handlerType handler, void *context);
+void coap_observe_cancel(coap_clientType *client);
+void coap_poll(coap_clientType *client, uint32_t timeout);
+
+#endif /* COAP_H_ */
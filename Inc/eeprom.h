@@ -0,0 +1,21 @@
+/*
+ * eeprom.h
+ */
+
+#ifndef EEPROM_H_
+#define EEPROM_H_
+
+#include <main.h>
+
+/*Size of the data EEPROM in bytes, it survives resets and power cycles*/
+#define EEPROM_SIZE            (DATA_EEPROM_END - DATA_EEPROM_BASE + 1U)
+
+/*Keys that unlock the data EEPROM and PECR*/
+#define EEPROM_PEKEY1          0x89ABCDEFU
+#define EEPROM_PEKEY2          0x02030405U
+
+/*Function prototypes*/
+void eeprom_read(uint32_t offset, void *data, uint32_t length);
+int eeprom_write(uint32_t offset, const void *data, uint32_t length);
+
+#endif /* EEPROM_H_ */
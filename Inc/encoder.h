@@ -0,0 +1,70 @@
+/*
+ * encoder.h
+ */
+
+#ifndef ENCODER_H_
+#define ENCODER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*Deepest nesting of maps and arrays*/
+#define ENCODER_MAX_DEPTH      4
+/*Count of a map or an array whose length is not known when it starts*/
+#define ENCODER_INDEFINITE     0xFFFFFFFFU
+
+typedef struct encoder encoderType;
+
+/**
+ * @brief Operations of a payload format, see encoder_cbor and encoder_json.
+ *
+ * Every operation appends to the buffer of the encoder. Containers are closed
+ * with end, a map takes a key before each value.
+ */
+struct encoder_ops
+{
+    void (*map)(encoderType *encoder, uint32_t count);                          // Starts a map of count pairs
+    void (*array)(encoderType *encoder, uint32_t count);                        // Starts an array of count items
+    void (*end)(encoderType *encoder);                                          // Closes the innermost map or array
+    void (*key)(encoderType *encoder, uint32_t key);                            // Key of the next map value
+    void (*integer)(encoderType *encoder, int32_t value);                       // Signed integer
+    void (*fixed)(encoderType *encoder, int32_t value, uint8_t decimals);      // value / 10^decimals
+    void (*bytes)(encoderType *encoder, const uint8_t *data, uint32_t length);  // Byte string
+};
+
+typedef struct encoder_ops encoder_opsType;
+
+/**
+ * @brief Encoder writing straight into a datagram buffer.
+ */
+struct encoder
+{
+    const encoder_opsType *ops;      // Payload format
+    uint8_t *buffer;                 // Destination
+    uint32_t size;                   // Size of the destination
+    uint32_t length;                 // Bytes written
+    bool overflow;                   // Something did not fit or had no map to go in, the buffer holds what did
+    uint8_t depth;                   // Open maps and arrays
+    struct
+    {
+        bool map;                    // The container is a map
+        bool indefinite;             // Its length was not known when it started
+        uint16_t items;              // Keys and values written into it
+    } levels[ENCODER_MAX_DEPTH];
+};
+
+/*Payload formats*/
+extern const encoder_opsType encoder_cbor;
+extern const encoder_opsType encoder_json;
+
+/*Function prototypes*/
+void encoder_init(encoderType *encoder, const encoder_opsType *ops, void *buffer, uint32_t size);
+void encoder_map(encoderType *encoder, uint32_t count);
+void encoder_array(encoderType *encoder, uint32_t count);
+void encoder_end(encoderType *encoder);
+void encoder_key(encoderType *encoder, uint32_t key);
+void encoder_integer(encoderType *encoder, int32_t value);
+void encoder_fixed(encoderType *encoder, int32_t value, uint8_t decimals);
+void encoder_bytes(encoderType *encoder, const uint8_t *data, uint32_t length);
+
+#endif /* ENCODER_H_ */
@@ -0,0 +1,43 @@
+/*
+ * modem_cache.h
+ */
+
+#ifndef MODEM_CACHE_H_
+#define MODEM_CACHE_H_
+
+#include <main.h>
+#include <stdbool.h>
+
+/*Marks backup registers written by this cache, anything else is power-on garbage*/
+#define MODEM_CACHE_MAGIC      0xCAC1U
+
+/**
+ * @brief Facts about the WiFi module that outlive a wake-up cycle.
+ */
+typedef enum modem_fact
+{
+    FACT_MAC      = 0,   /*Station MAC address, 6 bytes. Never changes.*/
+    FACT_MUX      = 1,   /*AT+CIPMUX mode, 1 byte. Lost when the module restarts.*/
+    FACT_RECVTYPE = 2,   /*AT+CIPRECVTYPE mode, 1 byte. Lost when the module restarts.*/
+    FACT_IP       = 3,   /*DHCP lease, 4 bytes. Lost when the station disconnects.*/
+    FACT_SYSSTORE = 4,   /*AT+SYSSTORE=0 is in effect, no bytes. Lost when the module restarts.*/
+    FACT_COUNT    = 5
+}modem_fact_t;
+
+/**
+ * @brief Events that invalidate facts, reported by the unsolicited result codes.
+ */
+typedef enum modem_event
+{
+    EVENT_RESTART    = 0,   /*"ready": the module rebooted.*/
+    EVENT_DISCONNECT = 1    /*"WIFI DISCONNECT": the station left the AP.*/
+}modem_event_t;
+
+/*Function prototypes*/
+void modem_cache_init(void);
+bool modem_cache_get(modem_fact_t fact, void *value);
+void modem_cache_put(modem_fact_t fact, const void *value);
+void modem_cache_invalidate(modem_event_t event);
+void modem_cache_stats(uint32_t *hits, uint32_t *misses);
+
+#endif /* MODEM_CACHE_H_ */
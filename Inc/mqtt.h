@@ -0,0 +1,83 @@
+/*
+ * mqtt.h
+ */
+
+#ifndef MQTT_H_
+#define MQTT_H_
+
+#include <wifi.h>
+#include <telemetry.h>
+
+/*Client ID of the node, the broker keeps the persistent session under it*/
+#define MQTT_CLIENT_ID         "nucleo-l053"
+/*Broker of the node*/
+#define MQTT_BROKER            "192.168.1.10"
+#define MQTT_PORT              1883
+/*Keepalive in s, the MCU wakes up once per sample period, at most 7200 for ESP-AT*/
+#define MQTT_KEEPALIVE         ((TELEMETRY_SAMPLE_PERIOD < 7200) ? TELEMETRY_SAMPLE_PERIOD : 7200)
+/*Messages received from subscriptions and not read yet*/
+#define MQTT_QUEUE_SIZE        3
+/*Longest topic of a received message, including the NUL*/
+#define MQTT_TOPIC_SIZE        32
+/*Longest payload of a received message, longer ones are truncated*/
+#define MQTT_PAYLOAD_SIZE      48
+
+/**
+ * @brief Quality of service of a publication or a subscription.
+ */
+typedef enum mqtt_qos
+{
+    MQTT_QOS0 = 0,   /*At most once, no acknowledgement.*/
+    MQTT_QOS1 = 1    /*At least once, acknowledged by the broker.*/
+}mqtt_qos_t;
+
+/**
+ * @brief State of the connection to the broker, as the module reports it.
+ */
+typedef enum mqtt_state
+{
+    MQTT_UNKNOWN      = 0,   /*The MCU restarted, the module has to be asked.*/
+    MQTT_DISCONNECTED = 1,   /*Configured but not connected, the module may be reconnecting.*/
+    MQTT_CONNECTED    = 2    /*Connected, publications go out without a handshake.*/
+}mqtt_state_t;
+
+/**
+ * @brief Message received on a subscribed topic.
+ */
+struct mqtt_message
+{
+    char topic[MQTT_TOPIC_SIZE];           // Topic, NUL terminated
+    uint8_t payload[MQTT_PAYLOAD_SIZE];    // Payload, not NUL terminated
+    uint16_t length;                       // Bytes stored in payload
+    uint16_t total;                        // Length of the payload the broker sent
+};
+
+typedef struct mqtt_message mqtt_messageType;
+
+/**
+ * @brief Traffic of the client since the MCU started.
+ */
+struct mqtt_stats
+{
+    uint32_t connects;               // Handshakes with the broker
+    uint32_t reuses;                 // mqtt_connect() calls answered by the open session
+    uint32_t published;              // Publications the module reported +MQTTPUB:OK for
+    uint32_t publish_failures;
+    uint32_t received;               // Messages queued for mqtt_receive()
+    uint32_t dropped;                // Messages that did not fit the queue
+};
+
+typedef struct mqtt_stats mqtt_statsType;
+
+/*Function prototypes*/
+void mqtt_init(void);
+WiFi_res_t mqtt_connect(void);
+WiFi_res_t mqtt_publish(const char *topic, const uint8_t *payload, uint32_t length, mqtt_qos_t qos, bool retain);
+WiFi_res_t mqtt_subscribe(const char *topic, mqtt_qos_t qos);
+bool mqtt_receive(mqtt_messageType *message);
+WiFi_res_t mqtt_disconnect(void);
+mqtt_state_t mqtt_state(void);
+const mqtt_statsType *mqtt_stats(void);
+void mqtt_session_lost(void);
+
+#endif /* MQTT_H_ */
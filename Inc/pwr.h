@@ -12,9 +12,12 @@
 #define PWR_H_
 
 #include <main.h>
+#include <stdbool.h>
 
 void enter_SleepMode();
+void enter_CoreSleep();
 void prepare_LowPower();
 void mcu_WakeUp();
+bool mcu_alarm_pending();
 
 #endif /* PWR_H_ */
@@ -0,0 +1,69 @@
+/*
+ * ring.h
+ */
+
+#ifndef RING_H_
+#define RING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Lock-free single-producer/single-consumer byte ring.
+ *
+ * head and tail are free-running byte counters: only the producer writes head,
+ * only the consumer writes tail, and (head - tail) is the number of unread bytes.
+ * The storage size must be a power of two so the counters can wrap freely.
+ */
+struct ring
+{
+    volatile char *buffer;          // Ring storage
+    uint32_t size;                  // Size of the storage (power of two)
+    volatile uint32_t head;         // Total bytes produced
+    volatile uint32_t tail;         // Total bytes consumed
+    volatile uint32_t overflows;    // Bytes overwritten before the consumer read them
+};
+
+typedef struct ring ringType;
+
+/**
+ * @brief Contiguous piece of the ring, valid until the bytes are consumed.
+ */
+struct ring_span
+{
+    const char *data;
+    uint32_t length;
+};
+
+typedef struct ring_span ring_spanType;
+
+/**
+ * @brief Unread bytes seen in place, as one or two spans when they wrap.
+ */
+struct ring_view
+{
+    ring_spanType spans[2];         // Second span used only when the bytes wrap
+    uint32_t count;                 // Number of spans in use
+    uint32_t length;                // Total number of bytes
+};
+
+typedef struct ring_view ring_viewType;
+
+/*Function prototypes*/
+void ring_init(ringType *ring, volatile char *buffer, uint32_t size);
+void ring_produced(ringType *ring, uint32_t length);
+uint32_t ring_write(ringType *ring, const char *data, uint32_t length);
+uint32_t ring_available(ringType *ring);
+uint32_t ring_fill(ringType *ring);
+uint32_t ring_free(ringType *ring);
+char ring_at(ringType *ring, uint32_t offset);
+uint32_t ring_spans(ringType *ring, uint32_t offset, uint32_t length, ring_spanType spans[2]);
+uint32_t ring_peek(ringType *ring, uint32_t offset, char *data, uint32_t length);
+uint32_t ring_read(ringType *ring, char *data, uint32_t length);
+void ring_consume(ringType *ring, uint32_t length);
+uint32_t ring_view(ringType *ring, uint32_t offset, uint32_t length, ring_viewType *view);
+void ring_view_init(ring_viewType *view, const char *data, uint32_t length);
+char ring_view_at(const ring_viewType *view, uint32_t index);
+int32_t ring_view_find(const ring_viewType *view, uint32_t from, const char *text);
+
+#endif /* RING_H_ */
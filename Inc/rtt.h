@@ -0,0 +1,31 @@
+/*
+ * rtt.h
+ */
+
+#ifndef RTT_H_
+#define RTT_H_
+
+#include <stdint.h>
+
+/**
+ * @brief Round trip time estimator, as the TCP retransmission timer keeps it (RFC 6298).
+ *
+ * The mean and the mean deviation are kept in fixed point, scaled by 8 and 4, and
+ * updated with gains 1/8 and 1/4, so only shifts and additions are needed.
+ */
+struct rtt_estimator
+{
+    uint32_t smoothed;               // Mean in ms, scaled by 8
+    uint32_t deviation;              // Mean deviation in ms, scaled by 4
+    uint16_t samples;                // Round trips observed, saturates at UINT16_MAX
+};
+
+typedef struct rtt_estimator rtt_estimatorType;
+
+/*Function prototypes*/
+void rtt_sample(rtt_estimatorType *rtt, uint32_t elapsed);
+uint32_t rtt_mean(const rtt_estimatorType *rtt);
+uint32_t rtt_deviation(const rtt_estimatorType *rtt);
+uint32_t rtt_timeout(const rtt_estimatorType *rtt, uint32_t floor, uint32_t ceiling);
+
+#endif /* RTT_H_ */
@@ -0,0 +1,84 @@
+/*
+ * rudp.h
+ */
+
+#ifndef RUDP_H_
+#define RUDP_H_
+
+#include <socket.h>
+#include <rtt.h>
+
+/*Bytes every datagram reserves in front of its payload for the header*/
+#define RUDP_HEADER_SIZE       7
+/*Datagrams sent and not acknowledged yet, at most 16 (the SACK bitmap)*/
+#define RUDP_WINDOW            4
+/*Retransmission timeout before the first RTT sample in ms*/
+#define RUDP_RTO_INITIAL       1000
+/*Shortest retransmission timeout in ms, an AT+CIPSEND round trip takes tens of ms*/
+#define RUDP_RTO_MIN           200
+/*Longest retransmission timeout in ms, back-off included*/
+#define RUDP_RTO_MAX           8000
+/*Transmissions of a datagram before it is given up*/
+#define RUDP_MAX_TRANSMISSIONS 5
+
+/*Header flags*/
+#define RUDP_FLAG_DATA         0x01   /*A payload follows, its sequence number is valid.*/
+#define RUDP_FLAG_ACK          0x02   /*The acknowledgement fields are valid.*/
+#define RUDP_FLAG_SYN          0x04   /*The sender started from scratch, its sequence number restarts the receiver.*/
+
+/**
+ * @brief Datagram sent and not acknowledged yet, kept in the caller's buffer.
+ */
+struct rudp_slot
+{
+    uint8_t *datagram;               // Header and payload, NULL if the slot is free
+    uint16_t length;                 // Header included
+    uint16_t sequence;
+    uint32_t sent;                   // Tick of the last transmission
+    uint8_t transmissions;
+};
+
+/**
+ * @brief Counters of a connection.
+ */
+struct rudp_stats
+{
+    uint32_t sent;                   // Datagrams sent, retransmissions excluded
+    uint32_t retransmits;
+    uint32_t acknowledged;
+    uint32_t lost;                   // Datagrams given up after RUDP_MAX_TRANSMISSIONS
+    uint32_t received;               // New datagrams delivered
+    uint32_t duplicates;             // Datagrams received again and dropped
+};
+
+typedef struct rudp_stats rudp_statsType;
+
+/**
+ * @brief Reliable connection over a UDP socket.
+ *
+ * The round trip time is estimated as the TCP retransmission timer does, see rtt.h.
+ */
+struct rudp
+{
+    socket_handleType socket;        // Socket the datagrams go through
+    uint16_t next_sequence;          // Sequence number of the next datagram sent
+    bool synced;                     // The peer acknowledged a datagram since rudp_init
+    uint16_t expected;               // Next sequence number expected from the peer
+    uint16_t received_mask;          // Sequence numbers expected + 1 + i already received
+    bool peer_synced;                // A datagram of the peer was received
+    rtt_estimatorType rtt;           // Round trips of datagrams acknowledged at their first transmission
+    uint32_t rto;                    // Retransmission timeout in ms
+    struct rudp_slot slots[RUDP_WINDOW];
+    rudp_statsType stats;
+};
+
+typedef struct rudp rudpType;
+
+/*Function prototypes*/
+void rudp_init(rudpType *rudp);
+void rudp_bind(rudpType *rudp, socket_handleType socket);
+WiFi_res_t rudp_send(rudpType *rudp, uint8_t *datagram, uint32_t length);
+WiFi_res_t rudp_poll(rudpType *rudp, uint8_t *buffer, uint32_t size, uint32_t *length, uint32_t timeout);
+uint32_t rudp_pending(const rudpType *rudp);
+
+#endif /* RUDP_H_ */
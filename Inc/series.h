@@ -0,0 +1,57 @@
+/*
+ * series.h
+ */
+
+#ifndef SERIES_H_
+#define SERIES_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*Maximum number of values recorded with each timestamp*/
+#define SERIES_CHANNELS        4
+/*Longest encoded sample: a 5 byte varint for the timestamp and for each value*/
+#define SERIES_MAX_SAMPLE      (5 * (1 + SERIES_CHANNELS))
+
+/**
+ * @brief Compressor of an integer time series, appends to a byte buffer.
+ */
+struct series_encoder
+{
+    uint8_t *buffer;                     // Compressed samples
+    uint32_t size;                       // Size of the buffer
+    uint32_t length;                     // Bytes written
+    uint32_t count;                      // Samples written
+    uint8_t channels;                    // Values per sample
+    uint32_t first_time;                 // Timestamp of the first sample
+    uint32_t last_time;                  // Timestamp of the previous sample
+    int32_t last_delta;                  // Time between the two previous samples
+    int32_t last_values[SERIES_CHANNELS];
+};
+
+typedef struct series_encoder series_encoderType;
+
+/**
+ * @brief Decompressor of a buffer written by a series_encoder.
+ */
+struct series_decoder
+{
+    const uint8_t *buffer;               // Compressed samples
+    uint32_t length;                     // Bytes in the buffer
+    uint32_t position;                   // Next byte to read
+    uint32_t count;                      // Samples read
+    uint8_t channels;                    // Values per sample, as encoded
+    uint32_t last_time;
+    int32_t last_delta;
+    int32_t last_values[SERIES_CHANNELS];
+};
+
+typedef struct series_decoder series_decoderType;
+
+/*Function prototypes*/
+void series_init(series_encoderType *series, void *buffer, uint32_t size, uint8_t channels);
+int series_append(series_encoderType *series, uint32_t time, const int32_t *values);
+void series_decoder_init(series_decoderType *decoder, const void *buffer, uint32_t length, uint8_t channels);
+int series_next(series_decoderType *decoder, uint32_t *time, int32_t *values);
+
+#endif /* SERIES_H_ */
@@ -0,0 +1,58 @@
+/*
+ * socket.h
+ */
+
+#ifndef SOCKET_H_
+#define SOCKET_H_
+
+#include <wifi.h>
+#include <at_engine.h>
+
+/*Links of the module in multiple connection mode, link IDs 0 to 4*/
+#define SOCKET_LINKS           5
+/*Receive queue of each link in bytes, a power of two, every datagram takes 2 more*/
+#define SOCKET_RX_SIZE         128
+/*Longest remote host name, including the NUL*/
+#define SOCKET_HOST_SIZE       32
+
+/*Handle of an open socket, the link ID, negative when the socket could not be opened*/
+typedef int8_t socket_handleType;
+
+/**
+ * @brief Transport of a socket.
+ */
+typedef enum socket_protocol
+{
+    SOCKET_UDP = 0,
+    SOCKET_TCP = 1
+}socket_protocol_t;
+
+/**
+ * @brief Traffic of a link since the MCU started.
+ */
+struct socket_stats
+{
+    uint32_t opens;                  // Times the link was opened, reuses excluded
+    uint32_t reuses;                 // socket_open() calls answered by the open link
+    uint32_t tx_datagrams;           // Datagrams the module reported SEND OK for
+    uint32_t tx_bytes;
+    uint32_t tx_failures;            // Sends that did not end with SEND OK
+    uint32_t rx_datagrams;           // Datagrams queued for socket_receive()
+    uint32_t rx_bytes;
+    uint32_t rx_dropped;             // Datagrams that did not fit the receive queue
+};
+
+typedef struct socket_stats socket_statsType;
+
+/*Function prototypes*/
+void socket_init(void);
+socket_handleType socket_open(socket_protocol_t protocol, const char *host, uint16_t port, uint16_t local_port);
+WiFi_res_t socket_send(socket_handleType handle, const uint8_t *data, uint32_t length);
+WiFi_res_t socket_receive(socket_handleType handle, uint8_t *buffer, uint32_t size, uint32_t *length, uint32_t timeout);
+WiFi_res_t socket_close(socket_handleType handle);
+bool socket_is_open(socket_handleType handle);
+const socket_statsType *socket_stats(socket_handleType handle);
+void socket_data_received(const at_chunkType *chunk);
+void socket_links_lost(void);
+
+#endif /* SOCKET_H_ */
@@ -0,0 +1,39 @@
+/*
+ * telemetry.h
+ */
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <main.h>
+#include <stdbool.h>
+#include <encoder.h>
+#include <series.h>
+
+/*Seconds between two samples, it is the RTC alarm period and must stay below 24 h*/
+#define TELEMETRY_SAMPLE_PERIOD    1800
+/*Seconds between two uploads, rounded down to a whole number of sample periods*/
+#define TELEMETRY_UPLOAD_PERIOD    (6 * 3600)
+/*Seconds between a failed upload and the first retry, doubled on each failure up to TELEMETRY_UPLOAD_PERIOD*/
+#define TELEMETRY_RETRY_PERIOD     3600
+/*Bytes of compressed samples kept in SRAM, which Stop mode retains, 2 bytes per steady sample*/
+#define TELEMETRY_SERIES_SIZE      128
+/*Upload early once the compressed samples take this many bytes*/
+#define TELEMETRY_FILL_THRESHOLD   96
+/*Upload early once the oldest sample is this old in seconds*/
+#define TELEMETRY_MAX_AGE          (12 * 3600)
+/*Size of the datagram that carries a batch*/
+#define TELEMETRY_DATAGRAM_SIZE    512
+/*Payload format of the batch, encoder_json for servers that only read text*/
+#define TELEMETRY_ENCODER          encoder_cbor
+/*Decimal digits of the temperature*/
+#define TELEMETRY_TEMPERATURE_DECIMALS   2
+
+/*Function prototypes*/
+void telemetry_add(int32_t temperature);
+bool telemetry_upload_due(void);
+uint32_t telemetry_encode(encoderType *encoder);
+void telemetry_uploaded(uint32_t count);
+uint32_t telemetry_count(void);
+
+#endif /* TELEMETRY_H_ */
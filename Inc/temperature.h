@@ -0,0 +1,17 @@
+/*
+ * temperature.h
+ */
+
+#ifndef TEMPERATURE_H_
+#define TEMPERATURE_H_
+
+#include <main.h>
+#include <stdbool.h>
+
+/*Time in ms for a conversion of the ADC*/
+#define TEMPERATURE_ADC_TIMEOUT  10
+
+/*Function prototypes*/
+bool temperature_read(int32_t *temperature);
+
+#endif /* TEMPERATURE_H_ */
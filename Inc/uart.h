@@ -12,26 +12,132 @@
 #define UART_H_
 
 #include "stdint.h"
+#include "stdbool.h"
 #include "stm32l0xx.h"
 #include "stm32l053xx.h"
+#include "ring.h"
 
 
 /*System core clock*/
 #define SYSTEM_CLOCK  16000000
+/*Kernel clock of USART1, HSI16 as RCC_CCIPR_USART1SEL selects it so reception goes on in Stop mode*/
+#define USART1_CLOCK  16000000
 /*Desired baudrate*/
 #define BAUDRATE      115200
 
+/*Size of the USART1 receive ring, written by DMA (must be a power of two)*/
+#define SIZE_OF_INCOMING_DATA   1024
+/*Size of the USART1 transmit queue (must be a power of two)*/
+#define SIZE_OF_OUTGOING_DATA   256
+/*Size of the USART2 (console) transmit queue (must be a power of two)*/
+#define SIZE_OF_CONSOLE_DATA    256
+/*DMA request number of USART1_RX on DMA1 channel 3*/
+#define USART1_RX_DMA_REQUEST   0x03
+
+/*Storage of the USART1 receive ring, written by DMA*/
+extern volatile char uart_receive_buffer[SIZE_OF_INCOMING_DATA];
+/*USART1 receive ring, the DMA/IDLE interrupts produce and the AT layer consumes*/
+extern ringType uart_receive_ring;
+
 /**
  * @brief Initialize USART2 for communication with serial port.
  * Data will be printed out to the terminal through USART2.
  * @retval None.
  */
-void uart2Init(void);
+void uart2_init(void);
 
 /**
- * @brief Transmits a character over UART peripheral.
+ * @brief Initialize USART1 for communication with the ESP32 module.
+ * Reception runs through DMA1 channel 3 in circular mode; the IDLE-line
+ * interrupt marks the end of every burst.
+ * @retval None.
+ */
+void uart1_init(void);
+
+/**
+ * @brief Queues a character for transmission over USART2.
+ * Returns immediately unless the queue is full; the TXE interrupt drains it.
  * @retval None.
  */
 void uart_transmit_byte(uint8_t data);
 
+/**
+ * @brief Queues a buffer for transmission to the ESP32 module over USART1.
+ * Returns as soon as the last byte is queued; the TXE interrupt drains it.
+ * @retval None.
+ */
+void uart1_transmit(const char *data, uint32_t length);
+
+/**
+ * @brief Waits until the USART1 queue is empty and the last byte left the wire.
+ * @param timeout: Maximum time to wait in ms.
+ * @retval 0 when flushed, -1 if the deadline expired first.
+ */
+int uart1_flush(uint32_t timeout);
+
+/**
+ * @brief Waits until the USART2 queue is empty and the last byte left the wire.
+ * @param timeout: Maximum time to wait in ms.
+ * @retval 0 when flushed, -1 if the deadline expired first.
+ */
+int uart2_flush(uint32_t timeout);
+
+/**
+ * @brief Registers a function called from interrupt context every time the
+ * USART1 transmit queue has drained completely. NULL disables it.
+ * @retval None.
+ */
+void uart1_set_tx_callback(void (*callback)(void));
+
+/**
+ * @brief Registers a function called from interrupt context every time the
+ * USART2 transmit queue has drained completely. NULL disables it.
+ * @retval None.
+ */
+void uart2_set_tx_callback(void (*callback)(void));
+
+/**
+ * @brief Feeds the USART1 transmitter. Called from USART1_IRQHandler.
+ * @retval None.
+ */
+void uart1_tx_irq(void);
+
+/**
+ * @brief Feeds the USART2 transmitter. Called from USART2_IRQHandler.
+ * @retval None.
+ */
+void uart2_tx_irq(void);
+
+/**
+ * @brief Publishes the bytes the DMA has written since the last call.
+ * Called from the USART1 IDLE and DMA half/full transfer interrupts.
+ * @retval None.
+ */
+void uart1_rx_update(void);
+
+/**
+ * @brief Closes the current receive burst. Called from the IDLE interrupt.
+ * @retval None.
+ */
+void uart1_rx_idle(void);
+
+/**
+ * @brief Returns the byte count of the last completed burst and clears it.
+ * @retval 0 if no burst completed since the previous call.
+ */
+uint32_t uart1_rx_burst(void);
+
+/**
+ * @brief Marks a burst as started, called when a start bit woke the MCU from Stop mode.
+ * @retval None.
+ */
+void uart1_rx_wakeup(void);
+
+/**
+ * @brief Tells whether a burst that woke the MCU is still arriving.
+ * The DMA does not run in Stop mode, so the MCU must not stop before the IDLE line.
+ * @retval true from the wakeup until the IDLE interrupt closed the burst.
+ */
+bool uart1_rx_active(void);
+
 #endif /* UART_H_ */
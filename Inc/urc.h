@@ -0,0 +1,23 @@
+/*
+ * urc.h
+ */
+
+#ifndef URC_H_
+#define URC_H_
+
+#include <main.h>
+#include <stdbool.h>
+
+/*Maximum number of unsolicited result code handlers*/
+#define URC_MAX_HANDLERS       16
+/*Longest line handed to a handler, longer lines are truncated*/
+#define URC_LINE_SIZE          96
+
+/*Handler of an unsolicited line, line is NUL terminated without \r\n*/
+typedef void (*urc_handlerType)(const char *line, uint32_t length);
+
+/*Function prototypes*/
+int urc_register(const char *prefix, urc_handlerType handler);
+bool urc_dispatch(const char *line, uint32_t length);
+
+#endif /* URC_H_ */
@@ -13,31 +13,108 @@
 
 #include <main.h>
 #include <timebase.h>
-#include <stdarg.h>
 #include <stdbool.h>
 #include <timebase.h>
 #include <rtc.h>
 #include <swo.h>
+#include <at_parse.h>
+#include <encoder.h>
 
 
 /*Define maximum command size*/
 #define MAX_COMMAND_SIZE       50
 /*Define maximum UART response size*/
 #define MAX_RESPONSE_SIZE      1024
+/*Define maximum size of the data received from the server*/
+#define MAX_RECEIVE_SIZE       100
 /*Name of the local router*/
 #define SSID                   "THEOGREG_8"
 /*Password of local router*/
 #define PSWD                   "mantepsetonvlakentie"
+/*Silence kept around "+++" on top of the packing interval, so the module sees it as a packet of its own, in ms*/
+#define WIFI_STREAM_GUARD_TIME 30
+/*Time the module needs after "+++" before it accepts AT commands again in ms*/
+#define WIFI_STREAM_EXIT_TIME  1000
+/*Packing interval of the module in passthrough mode when none is configured in ms*/
+#define WIFI_STREAM_INTERVAL   20
+/*Payload format of WiFi_send_udp, encoder_json for servers that only read text*/
+#define WIFI_ENCODER           encoder_cbor
+/*Oldest ESP-AT version, (major << 8) | minor as AT+GMR reports it, that takes the payload of
+  AT+CIPSEND before its ">" prompt. 0xFFFF to always wait for the prompt, until a firmware
+  is verified on the board*/
+#define WIFI_EARLY_PAYLOAD_VERSION  0xFFFF
+/*Rejected sends in a row after which an early payload falls back to waiting for the prompt*/
+#define WIFI_EARLY_PAYLOAD_REJECTS  3
+/*AT+CIPMUX mode, fixed at build time because the socket layer and the link IDs of every
+  AT+CIPSEND follow it. 1 for up to 5 links side by side. Passthrough streaming
+  (WiFi_stream_start) only works on the single link of mode 0 and returns WIFI_FAIL
+  with 1: build with 0 to stream, at the cost of one socket at a time*/
+#define WIFI_CIPMUX            1
+/*AT_SCRIPT_PIPELINE (0x01) if the module firmware buffers commands instead of answering "busy p..."*/
+#define WIFI_INIT_SCRIPT_FLAGS 0
+/*Time the module looks for the cached AP before falling back to a full scan, in s*/
+#define WIFI_FAST_JOIN_TIMEOUT 3
+/*Offset of the record of the last joined AP in the data EEPROM*/
+#define WIFI_AP_EEPROM_OFFSET  0
+/*Marks a valid AP record, anything else is an erased or foreign EEPROM*/
+#define WIFI_AP_MAGIC          0xA9B5U
+/*Addressing of the station, see WiFi_addressing_t. WIFI_ADDRESS_STICKY saves the DHCP exchange of
+  every join, but only on a network whose DHCP server keeps leases: a lease the server gave to another
+  host meanwhile is not detected*/
+#define WIFI_ADDRESSING        WIFI_ADDRESS_DHCP
+/*Address of the station in WIFI_ADDRESS_STATIC mode*/
+#define WIFI_STATIC_IP         WIFI_IP(192, 168, 1, 50)
+#define WIFI_STATIC_GATEWAY    WIFI_IP(192, 168, 1, 1)
+#define WIFI_STATIC_NETMASK    WIFI_IP(255, 255, 255, 0)
+/*Offset of the last DHCP lease in the data EEPROM, after the AP record*/
+#define WIFI_LEASE_EEPROM_OFFSET 12
+/*Marks a valid lease record*/
+#define WIFI_LEASE_MAGIC       0x1EA5U
+
+/*IPv4 address packed in 32 bits, the first octet in the most significant byte*/
+#define WIFI_IP(a, b, c, d)    (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+/*The four octets of a packed address, as printf arguments for "%u.%u.%u.%u"*/
+#define WIFI_IP_OCTETS(ip)     (unsigned)((ip) >> 24), (unsigned)(((ip) >> 16) & 0xFFU), (unsigned)(((ip) >> 8) & 0xFFU), (unsigned)((ip) & 0xFFU)
 
 /*Structure definitions*/
 typedef enum WiFi_res
 {
     WIFI_OK,
 	WIFI_FAIL,
-	WIFI_TIMEOUT
+	WIFI_TIMEOUT,
+	WIFI_ERROR,       /*Module rejected the command (ERROR).*/
+	WIFI_BUSY,        /*Module is still processing a previous command (busy p...).*/
+	WIFI_SEND_FAIL    /*Module could not transmit the data (SEND FAIL).*/
 }WiFi_res_t;
 
 
+/*Outcome of the last command sent to the ESP32*/
+struct WiFi_result
+{
+	WiFi_res_t code;       /*Result code returned by send_command.*/
+	uint32_t err_code;     /*ESP-AT "ERR CODE:0x..." value, 0 when the module did not report one.*/
+	uint32_t elapsed;      /*Time from transmission to the final result code in ms.*/
+};
+
+typedef struct WiFi_result WiFi_resultType;
+
+/**
+ * @brief Joins to the AP since the MCU started and their latency, per path.
+ */
+struct WiFi_join_stats
+{
+	uint32_t fast_joins;   /*Joins to the cached BSSID.*/
+	uint32_t fast_time;    /*Total latency of the fast joins in ms.*/
+	uint32_t fallbacks;    /*Fast joins that failed and fell back to a full scan.*/
+	uint32_t full_joins;   /*Joins after a full scan.*/
+	uint32_t full_time;    /*Total latency of the full scan joins in ms.*/
+	uint32_t sticky;       /*Joins that reused the last DHCP lease.*/
+	uint32_t dhcp;         /*Joins that waited for the DHCP server, the sticky lease failed or there was none.*/
+};
+
+typedef struct WiFi_join_stats WiFi_join_statsType;
+
+
 typedef enum connectionStatus
 {
 	UNITITIALIZED = 0,    /*Station has not started any Wi-Fi connection.*/
@@ -48,23 +125,46 @@ typedef enum connectionStatus
 }connectionStatus_t;
 
 
+typedef enum socketStatus
+{
+	SOCKET_UNKNOWN = 0,   /*Link state has not been reported yet.*/
+	SOCKET_CLOSED  = 1,   /*The link is closed.*/
+	SOCKET_OPEN    = 2,   /*The link to a server is open.*/
+}socketStatus_t;
+
+typedef enum WiFi_addressing
+{
+	WIFI_ADDRESS_DHCP   = 0,   /*The DHCP server assigns the address on every association.*/
+	WIFI_ADDRESS_STATIC = 1,   /*WIFI_STATIC_IP, WIFI_STATIC_GATEWAY and WIFI_STATIC_NETMASK, no DHCP.*/
+	WIFI_ADDRESS_STICKY = 2    /*The last DHCP lease is set as a static address, DHCP only when it fails.*/
+}WiFi_addressing_t;
+
+
 struct nucleo
 {
-	char board_ip[MAX_COMMAND_SIZE];
+	uint32_t board_ip;               /*IPv4 address of the station, packed as WIFI_IP(), 0 while unknown.*/
 	char IMEI_num[MAX_COMMAND_SIZE];
+	uint8_t mac[6];                  /*The same MAC address as 6 raw bytes.*/
 	connectionStatus_t connection_status;
+	bool status_valid;               /*connection_status is kept up to date by unsolicited result codes.*/
+	bool time_synced;                /*The module reported +TIME_UPDATED since its last restart.*/
 	int RSSI;
 	int32_t temperature_value;
 };
 
 typedef struct nucleo nucleoType;
 
+/*Consumer of socket data, called with the payload bytes as they arrive*/
+typedef void (*WiFi_chunkType)(const uint8_t *data, uint32_t length, uint32_t offset, uint32_t total, void *context);
+
 /*Extern variable declaration*/
 extern nucleoType node;
 
 /*Function prototypes*/
+void WiFi_urc_init(void);
 void WiFi_status(void);
-WiFi_res_t send_command(const char *command, const char *exp, const char *exp_parse, const char *exp_end, uint32_t num_of_exp, uint32_t delay, ...);
+WiFi_res_t send_command(const char *command, const at_schemaType *schema, void *out, const char *exp_end, uint32_t delay);
+WiFi_res_t send_payload(const char *command, const char *payload, uint32_t length, const char *exp_end, const char *exp_fail, uint32_t delay);
 WiFi_res_t WiFi_init();
 WiFi_res_t WiFi_ntp_init(rtcType time);
 WiFi_res_t WiFi_check(void);
@@ -72,9 +172,18 @@ WiFi_res_t WiFi_get_IMEI();
 WiFi_res_t WiFi_get_RSSI();
 WiFi_res_t WiFi_open_connection(const char * server_ip, int port_number);
 WiFi_res_t WiFi_close_connection();
+int8_t WiFi_connection_socket(void);
 WiFi_res_t WiFi_send_udp();
+WiFi_res_t WiFi_send_data(const char *payload, uint32_t length);
+WiFi_res_t WiFi_send_link(int8_t link, const char *payload, uint32_t length);
 WiFi_res_t WiFi_power_down();
-WiFi_res_t WiFi_receive_data(char * response);
+WiFi_res_t WiFi_receive_data(uint8_t *buffer, uint32_t size, uint32_t *length, uint32_t timeout);
+void WiFi_receive_stream(WiFi_chunkType handler, void *context);
+WiFi_res_t WiFi_stream_start(uint32_t interval);
+WiFi_res_t WiFi_stream_write(const uint8_t *data, uint32_t length);
+WiFi_res_t WiFi_stream_stop(void);
+const WiFi_resultType *WiFi_last_result(void);
+const WiFi_join_statsType *WiFi_join_stats(void);
 int _get_wifi_state(void);
 
 
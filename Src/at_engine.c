@@ -0,0 +1,895 @@
+/*
+ * at_engine.c
+ */
+
+
+#include <at_engine.h>
+#include <urc.h>
+
+
+/*Function prototypes*/
+static void _start_command(void);
+static void _transmit_command(at_commandType *entry);
+static void _transmit_ahead(void);
+static void _complete_command(WiFi_res_t code);
+static void _scan_lines(void);
+static void _dispatch_line(uint32_t offset, uint32_t length);
+static uint32_t _read_err_code(const ring_viewType *view);
+static int _open_frame(uint32_t tail);
+static uint32_t _deliver_payload(uint32_t tail, uint32_t available);
+
+/*Local variables*/
+static at_commandType command_queue[AT_QUEUE_SIZE];      // Submitted commands, FIFO
+static uint32_t queue_head = 0;                          // Commands submitted
+static uint32_t queue_tail = 0;                          // Commands completed
+static uint32_t queue_sent = 0;                          // Commands transmitted
+static bool command_active = false;                      // command_queue[queue_tail] is in flight
+static uint32_t start_time = 0;                          // Tick when the active command was sent
+static uint32_t active_timeout = 0;                      // Time allowed for the active command in ms
+static uint32_t received = 0;                            // Response bytes fed to the matcher
+static uint32_t response_start = 0;                      // Offset of the active response from the ring tail
+static uint32_t holds = 0;                               // Completed responses still read by their callbacks
+static bool hold_requested = false;                      // The running callback called at_hold()
+static int prompt_pattern = -1;                          // Matcher pattern of the ">" prompt, -1 if not awaited
+static int fail_pattern = -1;                            // Matcher pattern of the command's own failure result, -1 if none
+static uint32_t err_code = 0;                            // ESP-AT error code of the active command
+static at_matcherType response_matcher;                  // Terminator matcher of the active command
+static uint32_t reported_overflows = 0;                  // Receive ring overflows already reported
+static uint32_t line_start = 0;                          // Stream position where the current line starts
+static uint32_t line_scan = 0;                           // Stream position of the next byte to scan for \n
+static at_data_handlerType data_handler = NULL;          // Consumer of the data frame payloads
+static void *data_context = NULL;                        // Passed back to the data handler
+static bool frame_open = false;                          // line_scan is inside the payload of the newest frame
+static int8_t frame_link = -1;                           // Link ID of the newest frame
+static uint32_t frame_total = 0;                         // Payload length of the newest frame
+static uint32_t frame_head = 0;                          // Frames scanned
+static uint32_t frame_tail = 0;                          // Frames the response matcher has passed
+static bool passthrough = false;                         // Transparent transmission, every received byte is socket data
+static uint32_t stream_offset = 0;                       // Bytes received since passthrough mode started
+
+/*Stream positions of the payloads scanned ahead of the response matcher, it skips them*/
+static struct
+{
+    uint32_t start;
+    uint32_t end;
+} frames[AT_FRAMES];
+
+/*Final result codes the ESP32 sends instead of the expected terminator*/
+static const struct
+{
+    const char *text;
+    WiFi_res_t code;
+} failure_terminators[] =
+{
+    { "ERROR",         WIFI_ERROR     },
+    { "FAIL",          WIFI_FAIL      },
+    { "SEND FAIL",     WIFI_SEND_FAIL },
+    { "busy p",        WIFI_BUSY      }
+};
+
+
+/**
+ * @function at_submit
+ *
+ * @brief Queues a command for the ESP32 without waiting for it.
+ *
+ * The command is copied, so the caller's buffer can be reused immediately. It is
+ * transmitted by at_poll() once the commands ahead of it have completed, and the
+ * callback reports its outcome.
+ *
+ * @param command: The command to be transmitted, without \r\n.
+ * @param exp_end: Expected end of the response, must outlive the command.
+ * @param timeout: Time allowed for the response in ms, counted from transmission. Once
+ *                 enough responses of the same command type have been observed, the
+ *                 timeout learned from their latency is used instead, see at_timeout.c.
+ * @param flags: AT_FLAG_PIPELINE to transmit the command without waiting for the
+ *               previous terminator. Only for modules that buffer commands instead
+ *               of answering "busy p...", responses still complete in order.
+ *               AT_FLAG_TIMEOUT_FLOOR to keep the learned timeout at or above
+ *               `timeout`, for commands whose latency depends on their arguments.
+ * @param callback: Completion callback, NULL if not needed.
+ * @param context: Passed back to the callback.
+ * @retval Handle of the command, -1 if the queue is full or the command too long.
+ */
+at_handleType at_submit(const char *command, const char *exp_end, uint32_t timeout, uint8_t flags, at_callbackType callback, void *context)
+{
+    /*Local variables*/
+    at_commandType *entry;
+    int length;
+
+    if ((queue_head - queue_tail) >= AT_QUEUE_SIZE)
+    {
+        return -1;
+    }
+
+    entry = &command_queue[queue_head % AT_QUEUE_SIZE];
+
+    /*Format the command with newline*/
+    length = snprintf(entry->text, sizeof(entry->text), "%s\r\n", command);
+    if (length < 0 || length >= (int)sizeof(entry->text))
+    {
+        return -1;
+    }
+
+    entry->length   = length;
+    entry->exp_end  = exp_end;
+    entry->timeout  = timeout;
+    entry->flags    = flags;
+    entry->latency  = at_timeout_lookup(command);
+    entry->callback = callback;
+    entry->context  = context;
+    entry->exp_fail = NULL;
+    entry->payload  = NULL;
+    entry->payload_length = 0;
+
+    return (at_handleType)(queue_head++ & 0x7FFFFFFF);
+}
+
+/**
+ * @function at_submit_data
+ *
+ * @brief Queues a send command together with its payload, e.g. AT+CIPSEND=<len>.
+ *
+ * The payload is streamed right behind the command, without waiting for the ">"
+ * prompt, and the command completes on its terminator, "SEND OK" for a datagram:
+ * one round trip per datagram.
+ * Firmware that drops the bytes it receives before its prompt needs
+ * AT_FLAG_PROMPT, the engine then transmits the payload once the prompt arrives,
+ * still within the same command.
+ *
+ * @param command: The send command, without \r\n.
+ * @param exp_end: Expected end of the response, e.g. "SEND OK". Must outlive the command.
+ * @param exp_fail: Failure result only this command reports, e.g. "+MQTTPUB:FAIL", NULL if none.
+ *                  Completes the command with WIFI_FAIL. Must outlive the command.
+ * @param payload: The data, transmitted as is. Must outlive the command.
+ * @param length: Length of the data, the one announced in the command.
+ * @param timeout: Time allowed until the terminator in ms.
+ * @param flags: AT_FLAG_PROMPT to wait for the prompt, AT_FLAG_PIPELINE is ignored.
+ * @param callback: Completion callback, NULL if not needed.
+ * @param context: Passed back to the callback.
+ * @retval Handle of the command, -1 if the queue is full or the command too long.
+ */
+at_handleType at_submit_data(const char *command, const char *exp_end, const char *exp_fail, const char *payload, uint32_t length, uint32_t timeout, uint8_t flags, at_callbackType callback, void *context)
+{
+    /*Local variables*/
+    at_handleType handle;
+    at_commandType *entry;
+
+    /*Nothing may reach the module between the command and its payload*/
+    handle = at_submit(command, exp_end, timeout, flags & ~AT_FLAG_PIPELINE, callback, context);
+    if (handle < 0)
+    {
+        return handle;
+    }
+
+    entry = &command_queue[(uint32_t)handle % AT_QUEUE_SIZE];
+    entry->exp_fail       = exp_fail;
+    entry->payload        = payload;
+    entry->payload_length = length;
+
+    return handle;
+}
+
+/**
+ * @function at_poll
+ *
+ * @brief Advances the engine, to be called from the main loop.
+ *
+ * Hands every complete line received since the previous call to the unsolicited
+ * result code dispatcher, completes the command in
+ * flight when its terminator, a failure result or its timeout is seen, and sends
+ * the next queued command right away. It never blocks, so the caller can sleep
+ * (WFI) whenever there is nothing else to do: the UART and SysTick interrupts
+ * wake the core again.
+ *
+ * @retval Number of commands still queued or in flight.
+ */
+uint32_t at_poll(void)
+{
+    /*Local variables*/
+    at_commandType *entry;
+    ring_spanType spans[2];
+    uint32_t span_count, used, tail;
+    int fired = -1;
+
+    /*Dispatch unsolicited lines first, they may arrive while a command is in flight*/
+    _scan_lines();
+
+    if (!command_active)
+    {
+        if (queue_head == queue_tail)
+        {
+            return 0;
+        }
+
+        _start_command();
+    }
+
+    entry = &command_queue[queue_tail % AT_QUEUE_SIZE];
+    tail = uart_receive_ring.tail;
+
+    /*Drop the start of a response that fills the ring, the terminator is at its end*/
+    if (holds == 0 && received >= (SIZE_OF_INCOMING_DATA * 3) / 4)
+    {
+        uint32_t half = received / 2;
+
+        ring_consume(&uart_receive_ring, half);
+        received -= half;
+        tail += half;
+    }
+
+    /*Feed the bytes scanned since the previous poll, they stay in the ring. Payloads
+      of data frames are binary, they are skipped so that they never match a terminator*/
+    while (fired < 0)
+    {
+        uint32_t position = tail + response_start + received;
+        uint32_t end = line_scan;
+
+        /*Frames the matcher has passed are no longer needed*/
+        while (frame_tail != frame_head && (int32_t)(frames[frame_tail % AT_FRAMES].end - position) <= 0)
+        {
+            frame_tail++;
+        }
+
+        if ((int32_t)(end - position) <= 0)
+        {
+            break;
+        }
+
+        if (frame_tail != frame_head)
+        {
+            uint32_t frame_start = frames[frame_tail % AT_FRAMES].start;
+            uint32_t frame_end = frames[frame_tail % AT_FRAMES].end;
+
+            if ((int32_t)(frame_start - position) <= 0)
+            {
+                received += (((int32_t)(frame_end - end) < 0) ? frame_end : end) - position;
+                continue;
+            }
+
+            if ((int32_t)(frame_start - end) < 0)
+            {
+                end = frame_start;
+            }
+        }
+
+        span_count = ring_spans(&uart_receive_ring, position - tail, end - position, spans);
+        for (uint32_t i = 0; i < span_count && fired < 0; i++)
+        {
+            fired = at_match_feed(&response_matcher, spans[i].data, spans[i].length, &used);
+            received += used;
+
+            /*The module waits for the payload, the response goes on with "Recv <len> bytes"*/
+            if (fired >= 0 && fired == prompt_pattern)
+            {
+                uart1_transmit(entry->payload, entry->payload_length);
+                prompt_pattern = -1;
+                fired = -1;
+                break;
+            }
+        }
+    }
+
+    if (fired == 0)
+    {
+        /*Expected end of response received*/
+        _complete_command(WIFI_OK);
+    }
+    else if (fired > 0)
+    {
+        /*The module reported a failure, do not wait for the timeout*/
+        ring_viewType view;
+
+        ring_view(&uart_receive_ring, response_start, received, &view);
+
+#ifdef DEBUG_SYSTEM
+        printf("Failure terminator: %s%c%c", response_matcher.patterns[fired].text, RETURN, NEWLINE);
+#endif
+        err_code = _read_err_code(&view);
+
+        _complete_command((fired == fail_pattern) ? WIFI_FAIL : failure_terminators[fired - 1].code);
+    }
+    else if ((get_tick() - start_time) >= active_timeout)
+    {
+#ifdef DEBUG_SYSTEM
+        LOG_WRN("Timeout occurred");
+#endif
+        at_timeout_expired(entry->latency);
+        _complete_command(WIFI_TIMEOUT);
+    }
+
+    /*Keep the UART busy: send the next command the moment this one completed*/
+    if (!command_active && queue_head != queue_tail)
+    {
+        _start_command();
+    }
+
+    _transmit_ahead();
+
+    return queue_head - queue_tail;
+}
+
+/**
+ * @function at_hold
+ *
+ * @brief Keeps the response of the running callback in the receive ring.
+ *
+ * The view handed to a completion callback points into the receive ring and is
+ * valid during the callback only. A callback that needs it longer, e.g. to parse
+ * it from the main loop, calls at_hold() and at_release() once done. Held bytes
+ * are not consumed, so the ring has less room for the responses that follow: do
+ * not hold longer than needed. The view stays valid as long as the module sends
+ * less than SIZE_OF_INCOMING_DATA bytes meanwhile.
+ *
+ * @pre Called from a completion callback.
+ */
+void at_hold(void)
+{
+    hold_requested = true;
+}
+
+/**
+ * @function at_release
+ *
+ * @brief Returns a response kept by at_hold() to the receive ring.
+ *
+ * Responses are consumed in order, once every held one has been released.
+ */
+void at_release(void)
+{
+    if (holds == 0)
+    {
+        return;
+    }
+
+    holds--;
+
+    if (holds == 0)
+    {
+        ring_consume(&uart_receive_ring, response_start);
+        response_start = 0;
+    }
+}
+
+/**
+ * @function at_data_register
+ *
+ * @brief Sets the consumer of the payloads of data frames.
+ *
+ * The ESP32 sends received socket data as "+IPD,<len>:<payload>" in active
+ * receive mode, and as "+CIPRECVDATA:<len>,<payload>" in reply to AT+CIPRECVDATA.
+ * The payload is binary: it is not split into lines, never offered to the URC
+ * handlers and never taken for a terminator. Exactly <len> bytes are handed to
+ * the handler as they arrive, in one or more chunks.
+ *
+ * @param handler: Called with every chunk, NULL to drop the payloads.
+ * @param context: Passed back to the handler.
+ */
+void at_data_register(at_data_handlerType handler, void *context)
+{
+    data_handler = handler;
+    data_context = context;
+}
+
+/**
+ * @function at_passthrough
+ *
+ * @brief Switches the receive path in and out of transparent transmission.
+ *
+ * After AT+CIPMODE=1 and AT+CIPSEND the module no longer frames the socket data:
+ * every byte it sends is payload, until it leaves the mode on "+++". While
+ * enabled, the received bytes are handed to the data handler as they arrive, with
+ * AT_STREAM_TOTAL as total, and nothing is taken for a line or a response.
+ *
+ * @param enable: true once the module sent the ">" prompt, false once it left the mode.
+ * @pre No command is queued or in flight.
+ */
+void at_passthrough(bool enable)
+{
+    passthrough   = enable;
+    stream_offset = 0;
+    frame_open    = false;
+}
+
+/**
+ * @function at_pending
+ *
+ * @brief Checks if a submitted command is still queued or in flight.
+ * @param handle: Handle returned by at_submit().
+ * @retval true until the command has completed.
+ */
+bool at_pending(at_handleType handle)
+{
+    uint32_t age = ((uint32_t)handle - queue_tail) & 0x7FFFFFFF;
+
+    return age < (queue_head - queue_tail);
+}
+
+/**
+ * @function at_idle
+ *
+ * @brief Checks if the engine has nothing queued or in flight.
+ */
+bool at_idle(void)
+{
+    return queue_head == queue_tail;
+}
+
+/**
+ * @function _start_command
+ *
+ * @brief Transmits the oldest queued command and prepares its matcher.
+ */
+static void _start_command(void)
+{
+    /*Local variables*/
+    at_commandType *entry = &command_queue[queue_tail % AT_QUEUE_SIZE];
+
+    /*Release the complete lines that arrived since the previous command*/
+    _scan_lines();
+
+    received = 0;
+    err_code = 0;
+
+    /*Track the expected terminator (index 0) together with the failure ones*/
+    at_match_init(&response_matcher);
+    at_match_add(&response_matcher, entry->exp_end, 0);
+    for (uint32_t i = 0; i < sizeof(failure_terminators) / sizeof(failure_terminators[0]); i++)
+    {
+        at_match_add(&response_matcher, failure_terminators[i].text, AT_MATCH_LINE_START);
+    }
+
+    /*Failure result of this command only, e.g. +MQTTPUB:FAIL*/
+    fail_pattern = -1;
+    if (entry->exp_fail != NULL)
+    {
+        fail_pattern = at_match_add(&response_matcher, entry->exp_fail, AT_MATCH_LINE_START);
+    }
+
+    /*The payload waits for the prompt, or follows the command on the wire*/
+    prompt_pattern = -1;
+    if (entry->payload != NULL && (entry->flags & AT_FLAG_PROMPT))
+    {
+        prompt_pattern = at_match_add(&response_matcher, ">", AT_MATCH_LINE_START);
+    }
+
+    /*Pipelined commands are already on the wire*/
+    if (queue_sent == queue_tail)
+    {
+        _transmit_command(entry);
+    }
+
+    /*The response time is counted from the moment the command is due*/
+    active_timeout = at_timeout_get(entry->latency, entry->timeout);
+    if ((entry->flags & AT_FLAG_TIMEOUT_FLOOR) && active_timeout < entry->timeout)
+    {
+        active_timeout = entry->timeout;
+    }
+
+    start_time = get_tick();
+    command_active = true;
+}
+
+/**
+ * @function _transmit_command
+ *
+ * @brief Transmits a queued command via UART.
+ * @param entry: The command at queue_sent.
+ */
+static void _transmit_command(at_commandType *entry)
+{
+    uart1_transmit(entry->text, entry->length);
+    queue_sent++;
+
+    if (entry->payload != NULL && !(entry->flags & AT_FLAG_PROMPT))
+    {
+        uart1_transmit(entry->payload, entry->payload_length);
+    }
+
+#ifdef DEBUG_SYSTEM
+    printf("%c>>>>", '\n');
+    printf(" Command:");
+    printf(" %.*s", (int)entry->length, entry->text);
+#endif
+}
+
+/**
+ * @function _transmit_ahead
+ *
+ * @brief Transmits the pipelined commands that follow the command in flight.
+ *
+ * The module answers them in order, so each response is still matched by its
+ * own command once the ones ahead of it have completed.
+ */
+static void _transmit_ahead(void)
+{
+    /*Bytes sent before the prompt would be taken for the payload*/
+    while (command_active && prompt_pattern < 0 && queue_sent != queue_head)
+    {
+        at_commandType *entry = &command_queue[queue_sent % AT_QUEUE_SIZE];
+
+        if (!(entry->flags & AT_FLAG_PIPELINE))
+        {
+            break;
+        }
+
+        _transmit_command(entry);
+    }
+}
+
+/**
+ * @function _complete_command
+ *
+ * @brief Reports the outcome of the command in flight and frees its slot.
+ * @param code: Final result of the command.
+ */
+static void _complete_command(WiFi_res_t code)
+{
+    /*Local variables*/
+    at_commandType *entry = &command_queue[queue_tail % AT_QUEUE_SIZE];
+    at_handleType handle = (at_handleType)(queue_tail & 0x7FFFFFFF);
+    at_responseType response;
+
+    response.result.code     = code;
+    response.result.err_code = err_code;
+    response.result.elapsed  = get_tick() - start_time;
+
+    /*Only a success measures the latency the timeout is for, a failure may come after a timeout of the
+      module's own, e.g. the jap_timeout of AT+CWJAP=. Busy replies and timeouts tell nothing at all*/
+    if (code == WIFI_OK)
+    {
+        at_timeout_sample(entry->latency, response.result.elapsed);
+    }
+    else if (code != WIFI_TIMEOUT && code != WIFI_BUSY)
+    {
+        at_timeout_answered(entry->latency);
+    }
+
+    /*The response is read where it lies in the ring*/
+    ring_view(&uart_receive_ring, response_start, received, &response.view);
+
+    /*Print the response if available*/
+    if (received != 0)
+    {
+        for (uint32_t i = 0; i < response.view.count; i++)
+        {
+            printf("%.*s", (int)response.view.spans[i].length, response.view.spans[i].data);
+        }
+        printf("\r\n");
+    }
+
+#ifdef DEBUG_SYSTEM
+    printf("<<<<");
+    printf("%c%c%c%c", RETURN, NEWLINE, RETURN, NEWLINE);
+#endif
+
+    command_active = false;
+    hold_requested = false;
+    prompt_pattern = -1;
+
+    if (entry->callback != NULL)
+    {
+        entry->callback(handle, &response, entry->context);
+    }
+
+    /*Consume the response up to its terminator unless it is held, later bytes stay for the next reader*/
+    response_start += received;
+    received = 0;
+
+    if (hold_requested)
+    {
+        holds++;
+    }
+
+    if (holds == 0)
+    {
+        ring_consume(&uart_receive_ring, response_start);
+        response_start = 0;
+    }
+
+    /*Free the slot after the callback, so it can still read the response*/
+    queue_tail++;
+}
+
+/**
+ * @function _scan_lines
+ *
+ * @brief Splits the newly received bytes into lines and dispatches them.
+ *
+ * Every byte is examined once. Lines are offered to the URC dispatcher while they
+ * stay in the ring, so a response in flight still sees them. When no command is
+ * in flight nobody else waits for them and the complete lines are consumed; a
+ * partial line is kept since the rest of it is still arriving, and so is every
+ * line while a held response is ahead of them in the ring.
+ *
+ * A line that starts with a data frame header ends at the header, the payload
+ * that follows is handed to the data handler instead.
+ */
+static void _scan_lines(void)
+{
+    /*Local variables*/
+    uint32_t available = ring_available(&uart_receive_ring);
+    uint32_t tail = uart_receive_ring.tail;
+
+    /*Bytes consumed by the command engine are not scanned again*/
+    if ((int32_t)(line_start - tail) < 0)
+    {
+        line_start = tail;
+    }
+
+    if ((int32_t)(line_scan - tail) < 0)
+    {
+        line_scan = tail;
+    }
+
+    /*Frames consumed or ahead of the response of the next command are not needed by the matcher*/
+    while (frame_tail != frame_head && (int32_t)(frames[frame_tail % AT_FRAMES].end - (tail + response_start)) <= 0)
+    {
+        frame_tail++;
+    }
+
+    /*Transparent transmission: every byte is socket data*/
+    if (passthrough && (line_scan - tail) < available)
+    {
+        at_chunkType chunk;
+
+        chunk.link   = -1;
+        chunk.total  = AT_STREAM_TOTAL;
+        chunk.offset = stream_offset;
+        ring_view(&uart_receive_ring, line_scan - tail, available - (line_scan - tail), &chunk.view);
+
+        if (data_handler != NULL)
+        {
+            data_handler(&chunk, data_context);
+        }
+
+        stream_offset += chunk.view.length;
+        line_scan     += chunk.view.length;
+        line_start     = line_scan;
+    }
+
+    while ((line_scan - tail) < available)
+    {
+        char c;
+
+        /*Payload of a data frame, not text*/
+        if (frame_open)
+        {
+            line_scan += _deliver_payload(tail, available);
+            continue;
+        }
+
+        c = ring_at(&uart_receive_ring, line_scan - tail);
+
+        if (c == NEWLINE)
+        {
+            _dispatch_line(line_start - tail, line_scan - line_start);
+            line_start = line_scan + 1;
+        }
+        else if ((c == ':' || c == ',') && ring_at(&uart_receive_ring, line_start - tail) == '+')
+        {
+            int opened = _open_frame(tail);
+
+            /*Wait for the response matcher to pass the frames scanned ahead of it*/
+            if (opened < 0)
+            {
+                break;
+            }
+
+            if (opened > 0)
+            {
+                continue;
+            }
+        }
+
+        line_scan++;
+    }
+
+    if (!command_active && holds == 0)
+    {
+        ring_consume(&uart_receive_ring, line_start - tail);
+    }
+
+#ifdef DEBUG_SYSTEM
+    if (uart_receive_ring.overflows != reported_overflows)
+    {
+        LOG_WRN("Receive ring overflow");
+    }
+#endif
+
+    reported_overflows = uart_receive_ring.overflows;
+}
+
+/**
+ * @function _dispatch_line
+ *
+ * @brief Copies a complete line out of the ring and offers it to the URC handlers.
+ * @param offset: Start of the line relative to the ring tail.
+ * @param length: Length of the line without the \n.
+ */
+static void _dispatch_line(uint32_t offset, uint32_t length)
+{
+    /*Local variables*/
+    char line[URC_LINE_SIZE];
+
+    /*Strip the \r*/
+    if (length != 0 && ring_at(&uart_receive_ring, offset + length - 1) == RETURN)
+    {
+        length--;
+    }
+
+    if (length == 0)
+    {
+        return;
+    }
+
+    length = ring_peek(&uart_receive_ring, offset, line, (length < sizeof(line)) ? length : sizeof(line) - 1);
+    line[length] = '\0';
+
+    urc_dispatch(line, length);
+}
+
+/**
+ * @function _read_err_code
+ *
+ * @brief Reads the ESP-AT error code that precedes a failure result code.
+ * @param view: The response.
+ * @retval The error code, 0 if the response has none.
+ */
+static uint32_t _read_err_code(const ring_viewType *view)
+{
+    /*Local variables*/
+    int32_t position = ring_view_find(view, 0, "ERR CODE:0x");
+    uint32_t code = 0;
+
+    if (position < 0)
+    {
+        return 0;
+    }
+
+    for (uint32_t i = position + strlen("ERR CODE:0x"); i < view->length; i++)
+    {
+        char c = ring_view_at(view, i);
+
+        if (c >= '0' && c <= '9')
+        {
+            code = (code << 4) | (c - '0');
+        }
+        else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+        {
+            code = (code << 4) | ((c | 0x20) - 'a' + 10);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    return code;
+}
+
+/**
+ * @function _open_frame
+ *
+ * @brief Checks if the line scanned so far is a data frame header.
+ *
+ * The headers are "+IPD,<len>:" and "+IPD,<link>,<len>:" in active receive mode,
+ * "+CIPRECVDATA:<len>," in reply to AT+CIPRECVDATA. The payload starts right after
+ * the header and is not followed by \r\n.
+ *
+ * @param tail: Stream position of the ring tail.
+ * @retval 1 if a frame was opened, 0 if the line is text, -1 if there is no room for the frame.
+ */
+static int _open_frame(uint32_t tail)
+{
+    /*Local variables*/
+    char header[AT_FRAME_HEADER_SIZE];
+    uint32_t length = line_scan - line_start + 1;
+    uint32_t values[2];
+    uint32_t count = 0;
+    char *p;
+
+    if (length >= sizeof(header))
+    {
+        return 0;
+    }
+
+    ring_peek(&uart_receive_ring, line_start - tail, header, length);
+    header[length] = '\0';
+
+    if (strncmp(header, "+IPD,", strlen("+IPD,")) == 0 && header[length - 1] == ':')
+    {
+        p = &header[strlen("+IPD,")];
+    }
+    else if (strncmp(header, "+CIPRECVDATA:", strlen("+CIPRECVDATA:")) == 0 && header[length - 1] == ',')
+    {
+        p = &header[strlen("+CIPRECVDATA:")];
+    }
+    else
+    {
+        return 0;
+    }
+
+    /*One or two numbers separated by commas, up to the last character*/
+    while (count < 2 && *p >= '0' && *p <= '9')
+    {
+        values[count++] = strtoul(p, &p, 10);
+
+        if (p == &header[length - 1] || *p != ',')
+        {
+            break;
+        }
+
+        p++;
+    }
+
+    if (count == 0 || p != &header[length - 1])
+    {
+        return 0;
+    }
+
+    if ((frame_head - frame_tail) >= AT_FRAMES)
+    {
+        return -1;
+    }
+
+    frame_link  = (count == 2) ? (int8_t)values[0] : -1;
+    frame_total = values[count - 1];
+
+    frames[frame_head % AT_FRAMES].start = line_scan + 1;
+    frames[frame_head % AT_FRAMES].end   = line_scan + 1 + frame_total;
+    frame_head++;
+
+    line_scan++;
+    line_start = line_scan;
+    frame_open = true;
+
+    /*An empty payload is complete already*/
+    if (frame_total == 0)
+    {
+        _deliver_payload(tail, line_scan - tail);
+    }
+
+    return 1;
+}
+
+/**
+ * @function _deliver_payload
+ *
+ * @brief Hands the payload bytes received so far to the data handler.
+ * @param tail: Stream position of the ring tail.
+ * @param available: Bytes in the ring.
+ * @retval Number of payload bytes handed over.
+ */
+static uint32_t _deliver_payload(uint32_t tail, uint32_t available)
+{
+    /*Local variables*/
+    uint32_t remaining = frames[(frame_head - 1) % AT_FRAMES].end - line_scan;
+    uint32_t length = tail + available - line_scan;
+    at_chunkType chunk;
+
+    if (length > remaining)
+    {
+        length = remaining;
+    }
+
+    chunk.link   = frame_link;
+    chunk.total  = frame_total;
+    chunk.offset = frame_total - remaining;
+    ring_view(&uart_receive_ring, line_scan - tail, length, &chunk.view);
+
+    if (data_handler != NULL)
+    {
+        data_handler(&chunk, data_context);
+    }
+
+    /*Delivered bytes are released like complete lines, the next line starts after the payload*/
+    line_start = line_scan + length;
+
+    if (length == remaining)
+    {
+        frame_open = false;
+    }
+
+    return length;
+}
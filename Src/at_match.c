@@ -0,0 +1,168 @@
+/*
+ * at_match.c
+ */
+
+
+#include <at_match.h>
+#include <string.h>
+
+
+/**
+ * @function at_match_init
+ *
+ * @brief Removes every pattern from the matcher.
+ * @param matcher: The matcher to initialize.
+ * @retval None.
+ */
+void at_match_init(at_matcherType *matcher)
+{
+    matcher->count = 0;
+    at_match_reset(matcher);
+}
+
+/**
+ * @function at_match_add
+ *
+ * @brief Adds a pattern to the matcher and builds its failure table.
+ * @param matcher: The matcher.
+ * @param pattern: NUL terminated pattern, it must outlive the matcher.
+ * @param flags: AT_MATCH_LINE_START to accept the pattern only at a line start.
+ * @retval Index of the pattern, -1 if it does not fit.
+ */
+int at_match_add(at_matcherType *matcher, const char *pattern, uint8_t flags)
+{
+    /*Local variables*/
+    at_patternType *entry;
+    uint32_t length = strlen(pattern);
+    uint8_t k = 0;
+
+    if (matcher->count >= AT_MATCH_MAX_PATTERNS || length == 0 || length > AT_MATCH_MAX_LENGTH)
+    {
+        return -1;
+    }
+
+    entry = &matcher->patterns[matcher->count];
+    entry->text   = pattern;
+    entry->length = length;
+    entry->flags  = flags;
+    entry->state  = 0;
+
+    /*Compute the prefix function of the pattern*/
+    entry->failure[0] = 0;
+    for (uint32_t i = 1; i < length; i++)
+    {
+        while (k > 0 && pattern[i] != pattern[k])
+        {
+            k = entry->failure[k - 1];
+        }
+
+        if (pattern[i] == pattern[k])
+        {
+            k++;
+        }
+
+        entry->failure[i] = k;
+    }
+
+    return matcher->count++;
+}
+
+/**
+ * @function at_match_reset
+ *
+ * @brief Forgets partial matches, keeps the patterns.
+ * @param matcher: The matcher.
+ * @retval None.
+ */
+void at_match_reset(at_matcherType *matcher)
+{
+    for (uint32_t i = 0; i < matcher->count; i++)
+    {
+        matcher->patterns[i].state = 0;
+    }
+
+    matcher->line_start = 1;
+    matcher->position   = 0;
+    matcher->match_end  = 0;
+}
+
+/**
+ * @function at_match_feed
+ *
+ * @brief Advances every pattern over newly received bytes.
+ *
+ * Feeding stops right after the first byte that completes a pattern. When more
+ * than one pattern completes on the same byte the longest wins, so "SEND FAIL"
+ * is reported instead of "FAIL".
+ *
+ * @param matcher: The matcher.
+ * @param data: New bytes.
+ * @param length: Number of new bytes.
+ * @param used: Receives the number of bytes consumed from data.
+ * @retval Index of the pattern that completed, -1 if none did.
+ */
+int at_match_feed(at_matcherType *matcher, const char *data, uint32_t length, uint32_t *used)
+{
+    /*Local variables*/
+    int fired = -1;
+    uint32_t i;
+
+    for (i = 0; i < length && fired < 0; i++)
+    {
+        char c = data[i];
+
+        for (uint32_t p = 0; p < matcher->count; p++)
+        {
+            at_patternType *entry = &matcher->patterns[p];
+            uint8_t state = entry->state;
+
+            if (entry->flags & AT_MATCH_LINE_START)
+            {
+                /*A mismatch means this line does not start with the pattern*/
+                if (state == 0 && !matcher->line_start)
+                {
+                    continue;
+                }
+
+                state = (entry->text[state] == c) ? (state + 1) : 0;
+            }
+            else
+            {
+                while (state > 0 && entry->text[state] != c)
+                {
+                    state = entry->failure[state - 1];
+                }
+
+                if (entry->text[state] == c)
+                {
+                    state++;
+                }
+            }
+
+            if (state == entry->length)
+            {
+                if (fired < 0 || entry->length > matcher->patterns[fired].length)
+                {
+                    fired = p;
+                }
+
+                state = 0;
+            }
+
+            entry->state = state;
+        }
+
+        matcher->line_start = (c == '\n');
+    }
+
+    matcher->position += i;
+
+    if (fired >= 0)
+    {
+        matcher->match_end = matcher->position;
+    }
+
+    *used = i;
+
+    return fired;
+}
@@ -0,0 +1,265 @@
+/*
+ * at_parse.c
+ */
+
+
+#include <at_parse.h>
+#include <string.h>
+#include <stdbool.h>
+
+
+/*Read position inside the view*/
+struct cursor
+{
+    const ring_viewType *view;      // The response
+    uint32_t position;              // Next byte to read
+    uint32_t end;                   // End of the data line
+};
+
+/*Function prototypes*/
+static int32_t _find_line(const ring_viewType *view, const char *prefix);
+static bool _parse_int(struct cursor *cursor, char delimiter, void *member, uint16_t size);
+static void _parse_text(struct cursor *cursor, char delimiter, char *member, uint16_t size, bool quoted);
+
+
+/**
+ * @function at_parse
+ *
+ * @brief Parses the data line of a response into a struct.
+ *
+ * The line that starts with the schema prefix is split into fields, each field is
+ * converted where it lies and written to its member of the destination. The
+ * response is read in place through a view, also when it wraps around the end of
+ * the receive ring. Strings never overflow their member and are always NUL
+ * terminated. Nothing is allocated and nothing outside the view is read.
+ *
+ * @param schema: Layout of the data line.
+ * @param view: The response.
+ * @param out: Destination struct, the members of the fields that were not found are left untouched.
+ * @retval Number of fields parsed, -1 if no line starts with the prefix.
+ */
+int at_parse(const at_schemaType *schema, const ring_viewType *view, void *out)
+{
+    /*Local variables*/
+    struct cursor cursor;
+    int32_t start;
+    int parsed = 0;
+
+    start = _find_line(view, schema->prefix);
+    if (start < 0)
+    {
+        return -1;
+    }
+
+    cursor.view     = view;
+    cursor.position = start;
+
+    /*Fields never continue on the next line*/
+    for (cursor.end = start; cursor.end < view->length; cursor.end++)
+    {
+        char c = ring_view_at(view, cursor.end);
+
+        if (c == '\r' || c == '\n')
+        {
+            break;
+        }
+    }
+
+    for (uint32_t i = 0; i < schema->count; i++)
+    {
+        const at_fieldType *field = &schema->fields[i];
+        char *member = (char *)out + field->offset;
+
+        if (cursor.position >= cursor.end && field->type != AT_FIELD_STRING)
+        {
+            break;
+        }
+
+        switch (field->type)
+        {
+            case AT_FIELD_INT:
+                if (!_parse_int(&cursor, field->delimiter, member, field->size))
+                {
+                    return parsed;
+                }
+                break;
+
+            case AT_FIELD_STRING:
+                _parse_text(&cursor, field->delimiter, member, field->size, false);
+                break;
+
+            case AT_FIELD_QUOTED:
+                _parse_text(&cursor, field->delimiter, member, field->size, true);
+                break;
+
+            default:
+                _parse_text(&cursor, field->delimiter, NULL, 0, false);
+                break;
+        }
+
+        parsed++;
+    }
+
+    return parsed;
+}
+
+/**
+ * @function _find_line
+ *
+ * @brief Finds the line that starts with a prefix.
+ * @retval Position of the first character after the prefix, -1 if no line starts with it.
+ */
+static int32_t _find_line(const ring_viewType *view, const char *prefix)
+{
+    /*Local variables*/
+    uint32_t prefix_length = strlen(prefix);
+    uint32_t line = 0;
+
+    while (line < view->length)
+    {
+        uint32_t i = 0;
+
+        while (i < prefix_length && line + i < view->length && ring_view_at(view, line + i) == prefix[i])
+        {
+            i++;
+        }
+
+        if (i == prefix_length)
+        {
+            return line + prefix_length;
+        }
+
+        /*Move to the start of the next line*/
+        while (line < view->length && ring_view_at(view, line) != '\n')
+        {
+            line++;
+        }
+
+        line++;
+    }
+
+    return -1;
+}
+
+/**
+ * @function _parse_int
+ *
+ * @brief Converts a signed decimal field and stores it in a 1, 2 or 4 byte member.
+ * @retval false if the field does not start with a number.
+ */
+static bool _parse_int(struct cursor *cursor, char delimiter, void *member, uint16_t size)
+{
+    /*Local variables*/
+    uint32_t p = cursor->position;
+    bool negative = false;
+    int32_t value = 0;
+    char c;
+
+    while (p < cursor->end && ring_view_at(cursor->view, p) == ' ')
+    {
+        p++;
+    }
+
+    if (p < cursor->end)
+    {
+        c = ring_view_at(cursor->view, p);
+
+        if (c == '-' || c == '+')
+        {
+            negative = (c == '-');
+            p++;
+        }
+    }
+
+    if (p >= cursor->end || (c = ring_view_at(cursor->view, p)) < '0' || c > '9')
+    {
+        return false;
+    }
+
+    while (p < cursor->end && (c = ring_view_at(cursor->view, p)) >= '0' && c <= '9')
+    {
+        value = value * 10 + (c - '0');
+        p++;
+    }
+
+    if (negative)
+    {
+        value = -value;
+    }
+
+    switch (size)
+    {
+        case 1:  *(int8_t *)member  = value; break;
+        case 2:  *(int16_t *)member = value; break;
+        default: *(int32_t *)member = value; break;
+    }
+
+    /*Step over the delimiter*/
+    if (p < cursor->end && ring_view_at(cursor->view, p) == delimiter)
+    {
+        p++;
+    }
+
+    cursor->position = p;
+
+    return true;
+}
+
+/**
+ * @function _parse_text
+ *
+ * @brief Copies a text field up to its delimiter, NULL member to skip it.
+ */
+static void _parse_text(struct cursor *cursor, char delimiter, char *member, uint16_t size, bool quoted)
+{
+    /*Local variables*/
+    uint32_t p = cursor->position;
+    char stop = delimiter;
+    uint32_t stored = 0;
+
+    /*Quoted text ends at the closing quote, the delimiter may appear inside it*/
+    if (quoted && p < cursor->end && ring_view_at(cursor->view, p) == '"')
+    {
+        stop = '"';
+        p++;
+    }
+    else
+    {
+        quoted = false;
+    }
+
+    while (p < cursor->end)
+    {
+        char c = ring_view_at(cursor->view, p);
+
+        if (stop != '\0' && c == stop)
+        {
+            break;
+        }
+
+        if (member != NULL && stored + 1 < size)
+        {
+            member[stored++] = c;
+        }
+
+        p++;
+    }
+
+    if (member != NULL && size != 0)
+    {
+        member[stored] = '\0';
+    }
+
+    /*Step over the closing quote and the delimiter*/
+    if (quoted && p < cursor->end)
+    {
+        p++;
+    }
+
+    if (p < cursor->end && ring_view_at(cursor->view, p) == delimiter)
+    {
+        p++;
+    }
+
+    cursor->position = p;
+}
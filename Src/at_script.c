@@ -0,0 +1,255 @@
+/*
+ * at_script.c
+ */
+
+
+#include <at_script.h>
+
+
+struct at_script_state;
+
+/*Submission of a step, handed to the engine as callback context*/
+struct at_script_slot
+{
+    struct at_script_state *state;     // Script the step belongs to
+    uint32_t step;                     // Index of the step
+    uint8_t attempt;                   // 0 for the first transmission
+};
+
+/*Progress of a running script*/
+struct at_script_state
+{
+    const at_scriptType *script;                 // Script being executed
+    void *context;                               // Passed to the skip checks
+    at_script_reportType *report;                // Outcome and latency
+    struct at_script_slot slots[AT_QUEUE_SIZE];  // Steps in the engine queue
+    uint32_t submitted;                          // Submissions so far, selects the next slot
+    uint32_t next;                               // Next step to submit
+    uint32_t outstanding;                        // Steps submitted and not completed yet
+    int32_t retry_step;                          // Step to submit again, -1 if none
+    uint8_t retry_attempt;                       // Attempt number of that step
+    bool aborted;                                // A step failed with AT_FAIL_ABORT
+};
+
+/*Function prototypes*/
+static void _script_advance(struct at_script_state *state);
+static void _script_abort(struct at_script_state *state, uint32_t step, const WiFi_resultType *result);
+static void _step_completed(at_handleType handle, const at_responseType *response, void *context);
+
+
+/**
+ * @function at_script_run
+ *
+ * @brief Executes a script of AT commands and waits for it to finish.
+ *
+ * The next step is submitted from the completion callback of the previous one, so
+ * the engine transmits it in the same at_poll() that saw the terminator and the
+ * UART never idles between steps. With AT_SCRIPT_PIPELINE the independent steps
+ * are transmitted without waiting for the previous terminator at all.
+ *
+ * @param script: The script to execute.
+ * @param context: Passed to the skip checks of the steps.
+ * @param report: Receives the outcome and the latency of the script.
+ * @retval WIFI_OK if no step aborted the script, else the result of that step.
+ */
+WiFi_res_t at_script_run(const at_scriptType *script, void *context, at_script_reportType *report)
+{
+    /*Local variables*/
+    struct at_script_state state;
+    uint32_t start_time;
+
+    memset(&state, 0, sizeof(state));
+    memset(report, 0, sizeof(*report));
+
+    state.script      = script;
+    state.context     = context;
+    state.report      = report;
+    state.retry_step  = -1;
+
+    report->result.code = WIFI_OK;
+    report->failed_step = -1;
+
+    start_time = get_tick();
+
+    _script_advance(&state);
+
+    /*Run the engine until every submitted step completed, sleep between UART events*/
+    while (state.outstanding != 0 || (!state.aborted && (state.next < script->count || state.retry_step >= 0)))
+    {
+        at_poll();
+
+        /*Submit what did not fit in the engine queue before*/
+        _script_advance(&state);
+
+        if (state.outstanding != 0)
+        {
+            __WFI();
+        }
+    }
+
+    report->elapsed = get_tick() - start_time;
+
+#ifdef DEBUG_SYSTEM
+    printf("Script %s: %lu commands, %lu skipped, %lu ms (%lu ms waiting for responses)%c%c",
+           script->name, report->executed, report->skipped, report->elapsed, report->command_time, RETURN, NEWLINE);
+#endif
+
+    return state.aborted ? report->result.code : WIFI_OK;
+}
+
+/**
+ * @function _script_advance
+ *
+ * @brief Submits the steps that are due.
+ *
+ * A pending retry goes first. A step waits for the previous one to complete,
+ * unless the script is pipelined and the step is independent.
+ */
+static void _script_advance(struct at_script_state *state)
+{
+    /*Local variables*/
+    const at_scriptType *script = state->script;
+    bool pipeline = (script->flags & AT_SCRIPT_PIPELINE) != 0;
+
+    while (!state->aborted && state->outstanding < AT_QUEUE_SIZE)
+    {
+        const at_stepType *step;
+        struct at_script_slot *slot;
+        uint32_t index;
+        uint8_t attempt = 0;
+        uint8_t flags = 0;
+
+        if (state->retry_step >= 0)
+        {
+            index   = state->retry_step;
+            attempt = state->retry_attempt;
+        }
+        else if (state->next < script->count)
+        {
+            index = state->next;
+        }
+        else
+        {
+            break;
+        }
+
+        step = &script->steps[index];
+
+        if (pipeline && (step->flags & AT_STEP_INDEPENDENT))
+        {
+            flags = AT_FLAG_PIPELINE;
+        }
+        else if (state->outstanding != 0)
+        {
+            /*Wait for the outcome of the previous step*/
+            break;
+        }
+
+        if (attempt == 0 && step->skip != NULL && step->skip(state->context))
+        {
+            state->report->skipped++;
+            state->next++;
+            continue;
+        }
+
+        /*The engine copies the command together with \r\n*/
+        if (strlen(step->command) + 2 >= AT_COMMAND_SIZE)
+        {
+            WiFi_resultType result = { WIFI_FAIL, 0, 0 };
+
+            _script_abort(state, index, &result);
+            break;
+        }
+
+        slot = &state->slots[state->submitted % AT_QUEUE_SIZE];
+        slot->state   = state;
+        slot->step    = index;
+        slot->attempt = attempt;
+
+        if (at_submit(step->command, step->exp_end, step->timeout, flags, _step_completed, slot) < 0)
+        {
+            /*Engine queue is full, at_script_run tries again after the next poll*/
+            break;
+        }
+
+        if (attempt == 0)
+        {
+            state->next++;
+        }
+        else
+        {
+            state->retry_step = -1;
+        }
+
+        state->submitted++;
+        state->outstanding++;
+        state->report->executed++;
+    }
+}
+
+/**
+ * @function _script_abort
+ *
+ * @brief Stops submitting steps and records the step that failed.
+ */
+static void _script_abort(struct at_script_state *state, uint32_t step, const WiFi_resultType *result)
+{
+    if (state->aborted)
+    {
+        return;
+    }
+
+    state->aborted             = true;
+    state->report->failed_step = step;
+    state->report->result      = *result;
+
+#ifdef DEBUG_SYSTEM
+    printf("Script %s aborted at: %s%c%c", state->script->name, state->script->steps[step].command, RETURN, NEWLINE);
+#endif
+}
+
+/**
+ * @function _step_completed
+ *
+ * @brief Completion callback of the script steps.
+ *
+ * Parses the data line or applies the failure policy of the step and submits the next
+ * steps right away, before the engine looks for another command to transmit.
+ */
+static void _step_completed(at_handleType handle, const at_responseType *response, void *context)
+{
+    /*Local variables*/
+    struct at_script_slot *slot = (struct at_script_slot *)context;
+    struct at_script_state *state = slot->state;
+    const at_stepType *step = &state->script->steps[slot->step];
+
+    state->outstanding--;
+    state->report->command_time += response->result.elapsed;
+
+    if (state->aborted)
+    {
+        /*Pipelined steps that were already on the wire, nothing depends on them anymore*/
+        return;
+    }
+
+    state->report->result = response->result;
+
+    if (response->result.code == WIFI_OK)
+    {
+        if (step->schema != NULL)
+        {
+            at_parse(step->schema, &response->view, step->out);
+        }
+    }
+    else if (step->on_fail == AT_FAIL_RETRY && slot->attempt < step->retries && state->retry_step < 0)
+    {
+        state->retry_step    = slot->step;
+        state->retry_attempt = slot->attempt + 1;
+    }
+    else if (step->on_fail != AT_FAIL_CONTINUE)
+    {
+        _script_abort(state, slot->step, &response->result);
+    }
+
+    _script_advance(state);
+}
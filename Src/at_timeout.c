@@ -0,0 +1,216 @@
+/*
+ * at_timeout.c
+ */
+
+
+#include <at_timeout.h>
+#include <string.h>
+#include <stdio.h>
+
+
+/*Local variables*/
+static at_latencyType latency_table[AT_TIMEOUT_ENTRIES];   // Kept in SRAM, which Stop mode retains
+static uint32_t latency_count = 0;                         // Command types seen so far
+
+
+/**
+ * @function at_timeout_lookup
+ *
+ * @brief Finds the estimator of a command type, creating it the first time.
+ *
+ * The type is the command up to its '=' or '?', so "AT+CWJAP=..." and "AT+CWJAP?"
+ * have separate estimators while every "AT+CIPSEND=<n>" shares one.
+ *
+ * @param command: The command, with or without \r\n.
+ * @retval Index of the estimator, -1 if the table is full, the type too long or
+ * the text is data rather than a command.
+ */
+int at_timeout_lookup(const char *command)
+{
+    /*Local variables*/
+    uint32_t length = strcspn(command, "=\r\n");
+
+    /*Data sent after a prompt is not a command*/
+    if (strncmp(command, "AT", 2) != 0)
+    {
+        return -1;
+    }
+
+    /*Queries keep their '?', they answer differently than the set command*/
+    if (command[length] == '\0' || command[length] == '\r' || command[length] == '\n')
+    {
+        length = strcspn(command, "\r\n");
+    }
+
+    if (length >= AT_TIMEOUT_NAME_SIZE)
+    {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < latency_count; i++)
+    {
+        if (strncmp(latency_table[i].command, command, length) == 0 && latency_table[i].command[length] == '\0')
+        {
+            return i;
+        }
+    }
+
+    if (latency_count >= AT_TIMEOUT_ENTRIES)
+    {
+        return -1;
+    }
+
+    memset(&latency_table[latency_count], 0, sizeof(at_latencyType));
+    memcpy(latency_table[latency_count].command, command, length);
+
+    return latency_count++;
+}
+
+/**
+ * @function at_timeout_get
+ *
+ * @brief Derives the timeout of a command from the latency of its type.
+ * @param index: Index returned by at_timeout_lookup().
+ * @param fallback: Timeout used until enough responses have been observed.
+ * @retval Timeout in ms.
+ */
+uint32_t at_timeout_get(int index, uint32_t fallback)
+{
+    /*Local variables*/
+    at_latencyType *entry;
+    uint32_t timeout;
+
+    if (index < 0)
+    {
+        return fallback;
+    }
+
+    entry = &latency_table[index];
+
+    if (entry->latency.samples < AT_TIMEOUT_MIN_SAMPLES)
+    {
+        timeout = fallback;
+    }
+    else
+    {
+        timeout = at_timeout_value(entry);
+    }
+
+    /*Every timeout in a row doubles the next one*/
+    for (uint8_t i = 0; i < entry->backoff && timeout < AT_TIMEOUT_CEILING; i++)
+    {
+        timeout *= 2;
+    }
+
+    return (timeout > AT_TIMEOUT_CEILING) ? AT_TIMEOUT_CEILING : timeout;
+}
+
+/**
+ * @function at_timeout_sample
+ *
+ * @brief Feeds the time a command took to its estimator.
+ * @param index: Index returned by at_timeout_lookup().
+ * @param elapsed: Time from transmission to the final result code in ms.
+ */
+void at_timeout_sample(int index, uint32_t elapsed)
+{
+    if (index < 0)
+    {
+        return;
+    }
+
+    rtt_sample(&latency_table[index].latency, elapsed);
+    latency_table[index].backoff = 0;
+}
+
+/**
+ * @function at_timeout_expired
+ *
+ * @brief Records a command that got no response, the next one waits longer.
+ * @param index: Index returned by at_timeout_lookup().
+ */
+void at_timeout_expired(int index)
+{
+    if (index < 0)
+    {
+        return;
+    }
+
+    if (latency_table[index].timeouts < UINT16_MAX)
+    {
+        latency_table[index].timeouts++;
+    }
+
+    if (latency_table[index].backoff < 8)
+    {
+        latency_table[index].backoff++;
+    }
+}
+
+/**
+ * @function at_timeout_answered
+ *
+ * @brief Records a command answered with a failure, it ends the back-off without a latency sample.
+ * @param index: Index returned by at_timeout_lookup().
+ */
+void at_timeout_answered(int index)
+{
+    if (index < 0)
+    {
+        return;
+    }
+
+    latency_table[index].backoff = 0;
+}
+
+/**
+ * @function at_timeout_table
+ *
+ * @brief Gives access to the learned latencies, e.g. to report them to the server.
+ * @param count: Receives the number of entries.
+ * @retval The estimators of the command types seen since reset.
+ */
+const at_latencyType *at_timeout_table(uint32_t *count)
+{
+    *count = latency_count;
+
+    return latency_table;
+}
+
+/**
+ * @function at_timeout_mean
+ *
+ * @brief Mean latency of a command type in ms.
+ */
+uint32_t at_timeout_mean(const at_latencyType *entry)
+{
+    return rtt_mean(&entry->latency);
+}
+
+/**
+ * @function at_timeout_value
+ *
+ * @brief Timeout derived from the latency: mean plus four mean deviations, within the limits.
+ */
+uint32_t at_timeout_value(const at_latencyType *entry)
+{
+    return rtt_timeout(&entry->latency, AT_TIMEOUT_FLOOR, AT_TIMEOUT_CEILING);
+}
+
+/**
+ * @function at_timeout_print
+ *
+ * @brief Prints one CSV line per command type, for collection from the console:
+ * latency,<command>,<mean ms>,<deviation ms>,<timeout ms>,<samples>,<timeouts>
+ */
+void at_timeout_print(void)
+{
+    for (uint32_t i = 0; i < latency_count; i++)
+    {
+        const at_latencyType *entry = &latency_table[i];
+
+        printf("latency,%s,%lu,%lu,%lu,%u,%u\r\n", entry->command, (unsigned long)at_timeout_mean(entry),
+               (unsigned long)rtt_deviation(&entry->latency), (unsigned long)at_timeout_get(i, at_timeout_value(entry)),
+               entry->latency.samples, entry->timeouts);
+    }
+}
@@ -0,0 +1,780 @@
+/*
+ * coap.c
+ */
+
+
+#include <coap.h>
+#include <string.h>
+
+
+/*
+ * CoAP client (RFC 7252) with block-wise transfer (RFC 7959) and Observe (RFC 7641).
+ *
+ * One request is in progress at a time and every message is built in and
+ * received into the two buffers of the client, so the RAM used is fixed at
+ * sizeof(coap_clientType). Payloads larger than a message travel in
+ * 2^(4 + COAP_BLOCK_SZX) byte blocks: Block1 for the request, Block2 for the
+ * response, whose blocks are handed to the handler one by one.
+ */
+
+/*Message types*/
+#define TYPE_CON               0
+#define TYPE_NON               1
+#define TYPE_ACK               2
+#define TYPE_RST               3
+
+/*Option numbers*/
+#define OPTION_OBSERVE         6
+#define OPTION_URI_PATH        11
+#define OPTION_CONTENT_FORMAT  12
+#define OPTION_BLOCK2          23
+#define OPTION_BLOCK1          27
+
+/*2.31 Continue, the server wants the next Block1 block*/
+#define CODE_CONTINUE          COAP_CODE(2, 31)
+/*A notification older than the last one is still fresh after this many ms (RFC 7641 3.4)*/
+#define OBSERVE_FRESHNESS      128000U
+
+/*Message received, the pointers refer to the receive buffer of the client*/
+struct coap_message
+{
+    uint8_t type;
+    uint8_t code;
+    uint16_t id;
+    uint8_t token_length;
+    const uint8_t *token;
+    int32_t observe;                 // Values of the options, -1 if absent
+    int32_t block1;
+    int32_t block2;
+    const uint8_t *payload;
+    uint32_t length;
+};
+
+/*Options of a message being built, -1 if absent*/
+struct coap_options
+{
+    int32_t observe;
+    int16_t format;
+    int32_t block1;
+    int32_t block2;
+};
+
+/*Write position in the transmit buffer*/
+struct coap_writer
+{
+    uint8_t *buffer;
+    uint32_t position;
+    uint16_t last;                   // Number of the previous option, options go in ascending order
+    bool overflow;
+};
+
+/*Function prototypes*/
+static uint32_t _random(coap_clientType *client);
+static void _new_token(coap_clientType *client, uint8_t *token);
+static uint32_t _build(coap_clientType *client, uint8_t type, uint8_t code, const char *path, const struct coap_options *options, const uint8_t *payload, uint32_t length);
+static void _put_option(struct coap_writer *writer, uint16_t number, const uint8_t *value, uint32_t length);
+static void _put_uint(struct coap_writer *writer, uint16_t number, uint32_t value);
+static bool _parse(const uint8_t *data, uint32_t length, struct coap_message *message);
+static bool _token_is(const struct coap_message *message, const uint8_t *token);
+static void _reply(coap_clientType *client, uint8_t type, uint16_t id);
+static WiFi_res_t _exchange(coap_clientType *client, uint32_t length, bool confirmable, struct coap_message *response);
+static void _unsolicited(coap_clientType *client, const struct coap_message *message);
+static void _to_response(const struct coap_message *message, coap_responseType *response);
+
+
+/**
+ * @function coap_init
+ *
+ * @brief Starts a client on a UDP socket to the server, e.g. opened on COAP_PORT.
+ * @param client: The client.
+ * @param socket: The socket.
+ */
+void coap_init(coap_clientType *client, socket_handleType socket)
+{
+    memset(client, 0, sizeof(*client));
+    client->socket = socket;
+
+    /*Message IDs and tokens must not repeat across restarts, seed with the tick and the MAC*/
+    client->random = 0x9E3779B9U ^ get_tick() ^
+                     ((uint32_t)node.mac[2] << 24 | (uint32_t)node.mac[3] << 16 | (uint32_t)node.mac[4] << 8 | node.mac[5]);
+    if (client->random == 0)
+    {
+        client->random = 1;
+    }
+
+    client->message_id       = (uint16_t)_random(client);
+    client->observe_sequence = -1;
+}
+
+/**
+ * @function coap_request
+ *
+ * @brief Sends a request and waits for its response.
+ *
+ * A confirmable request is retransmitted with an exponential back-off, from a
+ * random timeout between COAP_ACK_TIMEOUT and 1.5 times that, up to
+ * COAP_MAX_RETRANSMIT times. The response may be piggybacked on the ACK or
+ * come separately, it is matched by its token. A payload larger than a block
+ * is sent in Block1 blocks, a response in Block2 blocks is fetched block by
+ * block, the later blocks requested with the same method and no payload.
+ * A non-confirmable request without a handler is sent once and not waited for.
+ *
+ * @param client: The client.
+ * @param request: The request.
+ * @param handler: Called with every block of the response, NULL if it is not needed.
+ * @param context: Passed back to the handler.
+ * @retval WIFI_OK for a 2.xx response, WIFI_ERROR for a 4.xx or 5.xx one, WIFI_TIMEOUT if none
+ * came, WIFI_FAIL if the server reset the request or it does not fit a message.
+ */
+WiFi_res_t coap_request(coap_clientType *client, const coap_requestType *request, coap_handlerType handler, void *context)
+{
+    /*Local variables*/
+    struct coap_options options = { -1, request->format, -1, -1 };
+    uint8_t type = request->confirmable ? TYPE_CON : TYPE_NON;
+    bool blockwise = request->length > (1U << (COAP_BLOCK_SZX + 4));
+    struct coap_message response;
+    coap_responseType block;
+    uint32_t szx = COAP_BLOCK_SZX;
+    uint32_t offset = 0;
+    uint32_t length;
+    WiFi_res_t result;
+
+    _new_token(client, client->token);
+
+    /*Block1: the payload goes in blocks, each one answered with 2.31 Continue*/
+    for (;;)
+    {
+        uint32_t size = 1U << (szx + 4);
+        uint32_t chunk = request->length - offset;
+        bool more = false;
+
+        if (blockwise)
+        {
+            if (chunk > size)
+            {
+                chunk = size;
+                more = true;
+            }
+
+            options.block1 = ((offset >> (szx + 4)) << 4) | (more ? 0x08 : 0) | szx;
+        }
+
+        length = _build(client, type, request->method, request->path, &options, &request->payload[offset], chunk);
+        if (length == 0)
+        {
+            return WIFI_FAIL;
+        }
+
+        if (!request->confirmable && handler == NULL && !blockwise)
+        {
+            client->stats.requests++;
+            return socket_send(client->socket, client->tx, length);
+        }
+
+        result = _exchange(client, length, request->confirmable, &response);
+        if (result != WIFI_OK)
+        {
+            return result;
+        }
+
+        /*The last block, or the server answered before the end*/
+        if (!more || response.code != CODE_CONTINUE)
+        {
+            break;
+        }
+
+        offset += chunk;
+
+        /*The server may ask for smaller blocks, the offset stays a multiple of the size*/
+        if (response.block1 >= 0 && (uint32_t)(response.block1 & 0x07) < szx)
+        {
+            szx = response.block1 & 0x07;
+        }
+    }
+
+    /*Block2: the response comes in blocks, each one requested*/
+    options.block1 = -1;
+    options.format = COAP_FORMAT_NONE;
+
+    for (;;)
+    {
+        _to_response(&response, &block);
+
+        if (handler != NULL)
+        {
+            handler(&block, context);
+        }
+
+        if (!block.more)
+        {
+            break;
+        }
+
+        options.block2 = ((((uint32_t)response.block2 >> 4) + 1) << 4) | (response.block2 & 0x07);
+
+        length = _build(client, type, request->method, request->path, &options, NULL, 0);
+        result = _exchange(client, length, request->confirmable, &response);
+        if (result != WIFI_OK)
+        {
+            return result;
+        }
+    }
+
+    return (COAP_CODE_CLASS(response.code) == 2) ? WIFI_OK : WIFI_ERROR;
+}
+
+/**
+ * @function coap_observe
+ *
+ * @brief Registers for the notifications of a resource (GET with Observe 0).
+ *
+ * The current representation is handed to the handler right away, every
+ * notification later on from coap_poll() or while a request waits. Only one
+ * resource is observed at a time, and only the first block of a notification
+ * is delivered.
+ *
+ * @param client: The client.
+ * @param path: The resource.
+ * @param handler: Called with the representation and every notification.
+ * @param context: Passed back to the handler.
+ * @retval WIFI_OK once registered, WIFI_ERROR for an error response, WIFI_FAIL if the resource
+ * can not be observed, or the result of the exchange.
+ */
+WiFi_res_t coap_observe(coap_clientType *client, const char *path, coap_handlerType handler, void *context)
+{
+    /*Local variables*/
+    struct coap_options options = { 0, COAP_FORMAT_NONE, -1, -1 };
+    struct coap_message response;
+    coap_responseType first;
+    uint32_t length;
+    WiFi_res_t result;
+
+    _new_token(client, client->token);
+
+    length = _build(client, TYPE_CON, COAP_GET, path, &options, NULL, 0);
+    if (length == 0)
+    {
+        return WIFI_FAIL;
+    }
+
+    result = _exchange(client, length, true, &response);
+    if (result != WIFI_OK)
+    {
+        return result;
+    }
+
+    _to_response(&response, &first);
+    handler(&first, context);
+
+    if (COAP_CODE_CLASS(response.code) != 2)
+    {
+        return WIFI_ERROR;
+    }
+
+    if (response.observe < 0)
+    {
+        return WIFI_FAIL;
+    }
+
+    memcpy(client->observe_token, client->token, COAP_TOKEN_SIZE);
+    client->observer         = handler;
+    client->observer_context = context;
+    client->observe_sequence = response.observe;
+    client->observe_time     = get_tick();
+
+    return WIFI_OK;
+}
+
+/**
+ * @function coap_observe_cancel
+ *
+ * @brief Stops delivering notifications, the next one is answered with RST so the server forgets the client.
+ */
+void coap_observe_cancel(coap_clientType *client)
+{
+    client->observer = NULL;
+}
+
+/**
+ * @function coap_poll
+ *
+ * @brief Receives notifications while no request is in progress.
+ * @param client: The client.
+ * @param timeout: Time to listen in ms.
+ */
+void coap_poll(coap_clientType *client, uint32_t timeout)
+{
+    /*Local variables*/
+    struct coap_message message;
+    uint32_t start = get_tick();
+    uint32_t elapsed;
+    uint32_t received;
+
+    while ((elapsed = get_tick() - start) < timeout)
+    {
+        if (socket_receive(client->socket, client->rx, sizeof(client->rx), &received, timeout - elapsed) != WIFI_OK ||
+            received > sizeof(client->rx) || !_parse(client->rx, received, &message))
+        {
+            continue;
+        }
+
+        _unsolicited(client, &message);
+    }
+}
+
+/**
+ * @function _exchange
+ *
+ * @brief Sends the message in the transmit buffer and waits for the response to it.
+ * @param length: Length of the message.
+ * @param confirmable: The message is retransmitted until acknowledged.
+ * @param response: Receives the response, it refers to the receive buffer.
+ * @retval WIFI_OK once the response arrived, WIFI_FAIL on RST, WIFI_TIMEOUT if nothing came.
+ */
+static WiFi_res_t _exchange(coap_clientType *client, uint32_t length, bool confirmable, struct coap_message *response)
+{
+    /*Local variables*/
+    uint16_t id = ((uint16_t)client->tx[2] << 8) | client->tx[3];
+    uint32_t timeout = COAP_ACK_TIMEOUT + _random(client) % (COAP_ACK_TIMEOUT / 2 + 1);
+    uint32_t limit = confirmable ? timeout : COAP_RESPONSE_TIMEOUT;
+    bool acknowledged = !confirmable;
+    uint32_t retransmits = 0;
+    uint32_t sent = get_tick();
+    uint32_t received;
+    uint32_t elapsed;
+
+    socket_send(client->socket, client->tx, length);
+    client->stats.requests++;
+
+    for (;;)
+    {
+        elapsed = get_tick() - sent;
+
+        if (elapsed >= limit)
+        {
+            if (acknowledged || retransmits >= COAP_MAX_RETRANSMIT)
+            {
+                client->stats.timeouts++;
+                return WIFI_TIMEOUT;
+            }
+
+            socket_send(client->socket, client->tx, length);
+            client->stats.retransmits++;
+            retransmits++;
+
+            timeout *= 2;
+            limit = timeout;
+            sent = get_tick();
+            continue;
+        }
+
+        if (socket_receive(client->socket, client->rx, sizeof(client->rx), &received, limit - elapsed) != WIFI_OK ||
+            received > sizeof(client->rx) || !_parse(client->rx, received, response))
+        {
+            continue;
+        }
+
+        if ((response->type == TYPE_ACK || response->type == TYPE_RST) && response->id == id)
+        {
+            if (response->type == TYPE_RST)
+            {
+                client->stats.resets++;
+                return WIFI_FAIL;
+            }
+
+            /*Piggybacked response*/
+            if (response->code != 0 && _token_is(response, client->token))
+            {
+                return WIFI_OK;
+            }
+
+            /*Empty ACK, the response comes separately*/
+            acknowledged = true;
+            limit = COAP_RESPONSE_TIMEOUT;
+            sent = get_tick();
+            continue;
+        }
+
+        /*Separate response, it also acknowledges a request whose ACK was lost*/
+        if ((response->type == TYPE_CON || response->type == TYPE_NON) && response->code != 0 && _token_is(response, client->token))
+        {
+            if (response->type == TYPE_CON)
+            {
+                _reply(client, TYPE_ACK, response->id);
+            }
+
+            return WIFI_OK;
+        }
+
+        _unsolicited(client, response);
+    }
+}
+
+/**
+ * @function _unsolicited
+ *
+ * @brief Delivers a notification of the observed resource, rejects any other request or response.
+ */
+static void _unsolicited(coap_clientType *client, const struct coap_message *message)
+{
+    /*Local variables*/
+    coap_responseType notification;
+    uint32_t now = get_tick();
+    uint32_t last = (uint32_t)client->observe_sequence;
+    uint32_t latest = (uint32_t)message->observe;
+
+    if (message->type == TYPE_ACK || message->type == TYPE_RST)
+    {
+        return;
+    }
+
+    if (client->observer == NULL || message->code == 0 || !_token_is(message, client->observe_token))
+    {
+        _reply(client, TYPE_RST, message->id);
+        return;
+    }
+
+    if (message->type == TYPE_CON)
+    {
+        _reply(client, TYPE_ACK, message->id);
+    }
+
+    /*Notifications can be reordered, drop the ones older than the last delivered*/
+    if (message->observe >= 0 && client->observe_sequence >= 0 && (now - client->observe_time) < OBSERVE_FRESHNESS &&
+        !((last < latest && latest - last < (1U << 23)) || (last > latest && last - latest > (1U << 23))))
+    {
+        return;
+    }
+
+    client->observe_sequence = message->observe;
+    client->observe_time     = now;
+    client->stats.notifications++;
+
+    _to_response(message, &notification);
+    client->observer(&notification, client->observer_context);
+}
+
+/**
+ * @function _to_response
+ *
+ * @brief Converts a received message to what the handlers see.
+ */
+static void _to_response(const struct coap_message *message, coap_responseType *response)
+{
+    response->code    = message->code;
+    response->payload = message->payload;
+    response->length  = message->length;
+    response->offset  = 0;
+    response->more    = false;
+    response->observe = message->observe;
+
+    if (message->block2 >= 0)
+    {
+        response->offset = ((uint32_t)message->block2 >> 4) << ((message->block2 & 0x07) + 4);
+        response->more   = (message->block2 & 0x08) != 0;
+    }
+}
+
+/**
+ * @function _build
+ *
+ * @brief Writes a message to the transmit buffer with the next message ID and the current token.
+ * @retval Length of the message, 0 if it does not fit COAP_MESSAGE_SIZE.
+ */
+static uint32_t _build(coap_clientType *client, uint8_t type, uint8_t code, const char *path, const struct coap_options *options, const uint8_t *payload, uint32_t length)
+{
+    /*Local variables*/
+    struct coap_writer writer = { client->tx, 4 + COAP_TOKEN_SIZE, 0, false };
+    const char *segment = path;
+
+    client->tx[0] = 0x40 | (type << 4) | COAP_TOKEN_SIZE;
+    client->tx[1] = code;
+    client->tx[2] = (uint8_t)(client->message_id >> 8);
+    client->tx[3] = (uint8_t)client->message_id;
+    memcpy(&client->tx[4], client->token, COAP_TOKEN_SIZE);
+    client->message_id++;
+
+    if (options->observe >= 0)
+    {
+        _put_uint(&writer, OPTION_OBSERVE, options->observe);
+    }
+
+    /*One Uri-Path option per segment*/
+    while (segment != NULL && *segment != '\0')
+    {
+        const char *end = strchr(segment, '/');
+        uint32_t size = (end != NULL) ? (uint32_t)(end - segment) : strlen(segment);
+
+        if (size != 0)
+        {
+            _put_option(&writer, OPTION_URI_PATH, (const uint8_t *)segment, size);
+        }
+
+        segment = (end != NULL) ? end + 1 : NULL;
+    }
+
+    if (options->format >= 0)
+    {
+        _put_uint(&writer, OPTION_CONTENT_FORMAT, options->format);
+    }
+
+    if (options->block2 >= 0)
+    {
+        _put_uint(&writer, OPTION_BLOCK2, options->block2);
+    }
+
+    if (options->block1 >= 0)
+    {
+        _put_uint(&writer, OPTION_BLOCK1, options->block1);
+    }
+
+    if (length != 0)
+    {
+        if (writer.position + 1 + length > COAP_MESSAGE_SIZE)
+        {
+            return 0;
+        }
+
+        client->tx[writer.position++] = 0xFF;
+        memcpy(&client->tx[writer.position], payload, length);
+        writer.position += length;
+    }
+
+    return writer.overflow ? 0 : writer.position;
+}
+
+/**
+ * @function _put_option
+ *
+ * @brief Appends an option, its number is coded as the delta from the previous one.
+ */
+static void _put_option(struct coap_writer *writer, uint16_t number, const uint8_t *value, uint32_t length)
+{
+    /*Local variables*/
+    uint32_t fields[2] = { number - writer->last, length };
+    uint8_t nibbles[2];
+    uint8_t extended[4];
+    uint32_t extra = 0;
+
+    /*Delta and length: 0-12 in the nibble, 13 + 1 byte, 14 + 2 bytes*/
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        if (fields[i] < 13)
+        {
+            nibbles[i] = fields[i];
+        }
+        else if (fields[i] < 269)
+        {
+            nibbles[i] = 13;
+            extended[extra++] = fields[i] - 13;
+        }
+        else
+        {
+            nibbles[i] = 14;
+            extended[extra++] = (fields[i] - 269) >> 8;
+            extended[extra++] = (fields[i] - 269);
+        }
+    }
+
+    if (writer->overflow || writer->position + 1 + extra + length > COAP_MESSAGE_SIZE)
+    {
+        writer->overflow = true;
+        return;
+    }
+
+    writer->buffer[writer->position++] = (nibbles[0] << 4) | nibbles[1];
+    memcpy(&writer->buffer[writer->position], extended, extra);
+    writer->position += extra;
+    memcpy(&writer->buffer[writer->position], value, length);
+    writer->position += length;
+    writer->last = number;
+}
+
+/**
+ * @function _put_uint
+ *
+ * @brief Appends an option holding an unsigned integer in as few bytes as possible, none for 0.
+ */
+static void _put_uint(struct coap_writer *writer, uint16_t number, uint32_t value)
+{
+    /*Local variables*/
+    uint8_t bytes[4];
+    uint32_t length = 0;
+
+    for (int32_t shift = 24; shift >= 0; shift -= 8)
+    {
+        if (length != 0 || (value >> shift) != 0)
+        {
+            bytes[length++] = (uint8_t)(value >> shift);
+        }
+    }
+
+    _put_option(writer, number, bytes, length);
+}
+
+/**
+ * @function _parse
+ *
+ * @brief Splits a received message into header, token, the options the client uses and payload.
+ * @retval false if it is not a valid CoAP message.
+ */
+static bool _parse(const uint8_t *data, uint32_t length, struct coap_message *message)
+{
+    /*Local variables*/
+    uint32_t position;
+    uint32_t number = 0;
+
+    if (length < 4 || (data[0] >> 6) != 1 || (data[0] & 0x0F) > 8)
+    {
+        return false;
+    }
+
+    message->type         = (data[0] >> 4) & 0x03;
+    message->token_length = data[0] & 0x0F;
+    message->code         = data[1];
+    message->id           = ((uint16_t)data[2] << 8) | data[3];
+    message->token        = &data[4];
+    message->observe      = -1;
+    message->block1       = -1;
+    message->block2       = -1;
+    message->payload      = NULL;
+    message->length       = 0;
+
+    position = 4 + message->token_length;
+    if (position > length)
+    {
+        return false;
+    }
+
+    while (position < length)
+    {
+        uint32_t fields[2];
+        uint32_t value = 0;
+
+        if (data[position] == 0xFF)
+        {
+            /*A payload marker with no payload is a format error*/
+            if (position + 1 == length)
+            {
+                return false;
+            }
+
+            message->payload = &data[position + 1];
+            message->length  = length - position - 1;
+            break;
+        }
+
+        fields[0] = data[position] >> 4;
+        fields[1] = data[position] & 0x0F;
+        position++;
+
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            if (fields[i] == 13)
+            {
+                if (position + 1 > length)
+                {
+                    return false;
+                }
+
+                fields[i] = 13 + data[position];
+                position += 1;
+            }
+            else if (fields[i] == 14)
+            {
+                if (position + 2 > length)
+                {
+                    return false;
+                }
+
+                fields[i] = 269 + (((uint32_t)data[position] << 8) | data[position + 1]);
+                position += 2;
+            }
+            else if (fields[i] == 15)
+            {
+                return false;
+            }
+        }
+
+        number += fields[0];
+
+        if (position + fields[1] > length)
+        {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < fields[1] && i < 3; i++)
+        {
+            value = (value << 8) | data[position + i];
+        }
+
+        switch (number)
+        {
+            case OPTION_OBSERVE: message->observe = value; break;
+            case OPTION_BLOCK1:  message->block1  = value; break;
+            case OPTION_BLOCK2:  message->block2  = value; break;
+            default: break;
+        }
+
+        position += fields[1];
+    }
+
+    return true;
+}
+
+/**
+ * @function _token_is
+ *
+ * @brief Tells if a message carries one of the client's tokens.
+ */
+static bool _token_is(const struct coap_message *message, const uint8_t *token)
+{
+    return message->token_length == COAP_TOKEN_SIZE && memcmp(message->token, token, COAP_TOKEN_SIZE) == 0;
+}
+
+/**
+ * @function _reply
+ *
+ * @brief Sends an empty ACK or RST for a message of the server.
+ */
+static void _reply(coap_clientType *client, uint8_t type, uint16_t id)
+{
+    /*Local variables*/
+    uint8_t message[4] = { 0x40 | (type << 4), 0, (uint8_t)(id >> 8), (uint8_t)id };
+
+    socket_send(client->socket, message, sizeof(message));
+}
+
+/**
+ * @function _new_token
+ *
+ * @brief Draws a token for a new request.
+ */
+static void _new_token(coap_clientType *client, uint8_t *token)
+{
+    /*Local variables*/
+    uint32_t value = _random(client);
+
+    for (uint32_t i = 0; i < COAP_TOKEN_SIZE; i++)
+    {
+        token[i] = (uint8_t)(value >> (8 * (i & 3)));
+    }
+}
+
+/**
+ * @function _random
+ *
+ * @brief xorshift32, for tokens, the first message ID and the timeout jitter.
+ */
+static uint32_t _random(coap_clientType *client)
+{
+    /*Local variables*/
+    uint32_t x = client->random;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    client->random = x;
+
+    return x;
+}
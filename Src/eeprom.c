@@ -0,0 +1,103 @@
+/*
+ * eeprom.c
+ */
+
+
+#include <eeprom.h>
+#include <string.h>
+
+
+/*Function prototypes*/
+static int _wait_ready(void);
+
+
+/**
+ * @function eeprom_read
+ *
+ * @brief Reads bytes from the data EEPROM, it is memory mapped.
+ * @param offset: First byte, from the start of the data EEPROM.
+ * @param data: Receives the bytes.
+ * @param length: Number of bytes.
+ */
+void eeprom_read(uint32_t offset, void *data, uint32_t length)
+{
+    memcpy(data, (const void *)(DATA_EEPROM_BASE + offset), length);
+}
+
+/**
+ * @function eeprom_write
+ *
+ * @brief Writes whole words to the data EEPROM, the words that already hold the value are skipped.
+ *
+ * A word is erased and programmed in one operation of about 3.2 ms, the core
+ * stalls meanwhile. Skipping the unchanged words keeps writing the same record
+ * on every join free of wear.
+ *
+ * @param offset: First byte, a multiple of 4.
+ * @param data: The bytes to write.
+ * @param length: Number of bytes, a multiple of 4.
+ * @retval 0 on success, -1 on a misaligned or out of range request or a programming error.
+ */
+int eeprom_write(uint32_t offset, const void *data, uint32_t length)
+{
+    /*Local variables*/
+    const uint8_t *bytes = (const uint8_t *)data;
+    volatile uint32_t *word = (volatile uint32_t *)(DATA_EEPROM_BASE + offset);
+    int result = 0;
+
+    if ((offset % 4) != 0 || (length % 4) != 0 || offset + length > EEPROM_SIZE)
+    {
+        return -1;
+    }
+
+    /*Unlock the data EEPROM*/
+    if (FLASH->PECR & FLASH_PECR_PELOCK)
+    {
+        FLASH->PEKEYR = EEPROM_PEKEY1;
+        FLASH->PEKEYR = EEPROM_PEKEY2;
+    }
+
+    for (uint32_t i = 0; i < length / 4 && result == 0; i++)
+    {
+        uint32_t value;
+
+        memcpy(&value, &bytes[i * 4], sizeof(value));
+
+        if (word[i] == value)
+        {
+            continue;
+        }
+
+        word[i] = value;
+        result = _wait_ready();
+    }
+
+    /*Lock it again*/
+    FLASH->PECR |= FLASH_PECR_PELOCK;
+
+    return result;
+}
+
+/**
+ * @function _wait_ready
+ *
+ * @brief Waits for the programming of a word to finish and clears its flags.
+ * @retval 0 on success, -1 if the word was not programmed.
+ */
+static int _wait_ready(void)
+{
+    /*Local variables*/
+    const uint32_t errors = FLASH_SR_WRPERR | FLASH_SR_PGAERR | FLASH_SR_SIZERR;
+    uint32_t status;
+
+    while (FLASH->SR & FLASH_SR_BSY)
+    {
+    }
+
+    status = FLASH->SR;
+
+    /*The flags are cleared by writing 1*/
+    FLASH->SR = status & (errors | FLASH_SR_EOP);
+
+    return (status & errors) ? -1 : 0;
+}
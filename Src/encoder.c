@@ -0,0 +1,478 @@
+/*
+ * encoder.c
+ */
+
+
+#include <encoder.h>
+#include <string.h>
+
+
+/*CBOR major types (RFC 8949)*/
+#define CBOR_UNSIGNED          0
+#define CBOR_NEGATIVE          1
+#define CBOR_BYTES             2
+#define CBOR_ARRAY             4
+#define CBOR_MAP               5
+#define CBOR_TAG               6
+/*Initial bytes of the indefinite-length containers and of their end*/
+#define CBOR_ARRAY_INDEFINITE  0x9F
+#define CBOR_MAP_INDEFINITE    0xBF
+#define CBOR_BREAK             0xFF
+/*Tag of a decimal fraction [exponent, mantissa]*/
+#define CBOR_TAG_DECIMAL       4
+
+/*Function prototypes*/
+static void _put(encoderType *encoder, const void *data, uint32_t length);
+static void _open(encoderType *encoder, bool map, uint32_t count);
+static void _cbor_head(encoderType *encoder, uint8_t major, uint32_t value);
+static void _cbor_int(encoderType *encoder, int32_t value);
+static void _cbor_map(encoderType *encoder, uint32_t count);
+static void _cbor_array(encoderType *encoder, uint32_t count);
+static void _cbor_end(encoderType *encoder);
+static void _cbor_key(encoderType *encoder, uint32_t key);
+static void _cbor_fixed(encoderType *encoder, int32_t value, uint8_t decimals);
+static void _cbor_bytes(encoderType *encoder, const uint8_t *data, uint32_t length);
+static void _json_separator(encoderType *encoder);
+static void _json_digits(encoderType *encoder, uint32_t value, uint8_t width);
+static void _json_map(encoderType *encoder, uint32_t count);
+static void _json_array(encoderType *encoder, uint32_t count);
+static void _json_end(encoderType *encoder);
+static void _json_key(encoderType *encoder, uint32_t key);
+static void _json_integer(encoderType *encoder, int32_t value);
+static void _json_fixed(encoderType *encoder, int32_t value, uint8_t decimals);
+static void _json_bytes(encoderType *encoder, const uint8_t *data, uint32_t length);
+
+/*Compact binary format, a 6 byte MAC takes 7 bytes and a small integer 1*/
+const encoder_opsType encoder_cbor =
+{
+    _cbor_map,
+    _cbor_array,
+    _cbor_end,
+    _cbor_key,
+    _cbor_int,
+    _cbor_fixed,
+    _cbor_bytes
+};
+
+/*Text format, for servers that only read JSON*/
+const encoder_opsType encoder_json =
+{
+    _json_map,
+    _json_array,
+    _json_end,
+    _json_key,
+    _json_integer,
+    _json_fixed,
+    _json_bytes
+};
+
+
+/**
+ * @function encoder_init
+ *
+ * @brief Starts an empty payload.
+ * @param encoder: The encoder.
+ * @param ops: Payload format, &encoder_cbor or &encoder_json.
+ * @param buffer: Destination, usually the buffer the datagram is transmitted from.
+ * @param size: Size of the destination.
+ */
+void encoder_init(encoderType *encoder, const encoder_opsType *ops, void *buffer, uint32_t size)
+{
+    encoder->ops      = ops;
+    encoder->buffer   = (uint8_t *)buffer;
+    encoder->size     = size;
+    encoder->length   = 0;
+    encoder->overflow = false;
+    encoder->depth    = 0;
+}
+
+/**
+ * @function encoder_map
+ *
+ * @brief Starts a map.
+ * @param count: Number of key/value pairs, ENCODER_INDEFINITE if not known yet.
+ */
+void encoder_map(encoderType *encoder, uint32_t count)
+{
+    encoder->ops->map(encoder, count);
+    _open(encoder, true, count);
+}
+
+/**
+ * @function encoder_array
+ *
+ * @brief Starts an array.
+ * @param count: Number of items, ENCODER_INDEFINITE if not known yet.
+ */
+void encoder_array(encoderType *encoder, uint32_t count)
+{
+    encoder->ops->array(encoder, count);
+    _open(encoder, false, count);
+}
+
+/**
+ * @function encoder_end
+ *
+ * @brief Closes the innermost map or array.
+ */
+void encoder_end(encoderType *encoder)
+{
+    if (encoder->depth == 0)
+    {
+        return;
+    }
+
+    encoder->ops->end(encoder);
+    encoder->depth--;
+}
+
+/**
+ * @function encoder_key
+ *
+ * @brief Writes the key of the next value of a map.
+ * @note Outside of a map nothing is written and overflow is set.
+ */
+void encoder_key(encoderType *encoder, uint32_t key)
+{
+    /*A key outside of a map cannot be written*/
+    if (encoder->depth == 0 || !encoder->levels[encoder->depth - 1].map)
+    {
+        encoder->overflow = true;
+        return;
+    }
+
+    encoder->ops->key(encoder, key);
+    encoder->levels[encoder->depth - 1].items++;
+}
+
+/**
+ * @function encoder_integer
+ *
+ * @brief Writes a signed integer.
+ */
+void encoder_integer(encoderType *encoder, int32_t value)
+{
+    encoder->ops->integer(encoder, value);
+
+    if (encoder->depth != 0)
+    {
+        encoder->levels[encoder->depth - 1].items++;
+    }
+}
+
+/**
+ * @function encoder_fixed
+ *
+ * @brief Writes a fixed-point value.
+ * @param value: The value scaled by 10^decimals, e.g. 2345 for 23.45.
+ * @param decimals: Number of decimal digits.
+ */
+void encoder_fixed(encoderType *encoder, int32_t value, uint8_t decimals)
+{
+    encoder->ops->fixed(encoder, value, decimals);
+
+    if (encoder->depth != 0)
+    {
+        encoder->levels[encoder->depth - 1].items++;
+    }
+}
+
+/**
+ * @function encoder_bytes
+ *
+ * @brief Writes a byte string, e.g. a MAC address as its 6 raw bytes.
+ */
+void encoder_bytes(encoderType *encoder, const uint8_t *data, uint32_t length)
+{
+    encoder->ops->bytes(encoder, data, length);
+
+    if (encoder->depth != 0)
+    {
+        encoder->levels[encoder->depth - 1].items++;
+    }
+}
+
+/**
+ * @function _put
+ *
+ * @brief Appends bytes, nothing more is written once something did not fit.
+ */
+static void _put(encoderType *encoder, const void *data, uint32_t length)
+{
+    if (encoder->overflow || length > encoder->size - encoder->length)
+    {
+        encoder->overflow = true;
+        return;
+    }
+
+    memcpy(&encoder->buffer[encoder->length], data, length);
+    encoder->length += length;
+}
+
+/**
+ * @function _open
+ *
+ * @brief Counts the new container as an item of its parent and enters it.
+ */
+static void _open(encoderType *encoder, bool map, uint32_t count)
+{
+    if (encoder->depth != 0)
+    {
+        encoder->levels[encoder->depth - 1].items++;
+    }
+
+    if (encoder->depth >= ENCODER_MAX_DEPTH)
+    {
+        encoder->overflow = true;
+        return;
+    }
+
+    encoder->levels[encoder->depth].map        = map;
+    encoder->levels[encoder->depth].indefinite = (count == ENCODER_INDEFINITE);
+    encoder->levels[encoder->depth].items      = 0;
+    encoder->depth++;
+}
+
+/**
+ * @function _cbor_head
+ *
+ * @brief Writes the initial byte of a data item and its argument in the fewest bytes.
+ */
+static void _cbor_head(encoderType *encoder, uint8_t major, uint32_t value)
+{
+    /*Local variables*/
+    uint8_t head[5];
+    uint32_t length;
+
+    if (value < 24)
+    {
+        head[0] = (major << 5) | value;
+        length  = 1;
+    }
+    else if (value <= 0xFF)
+    {
+        head[0] = (major << 5) | 24;
+        head[1] = value;
+        length  = 2;
+    }
+    else if (value <= 0xFFFF)
+    {
+        head[0] = (major << 5) | 25;
+        head[1] = value >> 8;
+        head[2] = value;
+        length  = 3;
+    }
+    else
+    {
+        head[0] = (major << 5) | 26;
+        head[1] = value >> 24;
+        head[2] = value >> 16;
+        head[3] = value >> 8;
+        head[4] = value;
+        length  = 5;
+    }
+
+    _put(encoder, head, length);
+}
+
+static void _cbor_int(encoderType *encoder, int32_t value)
+{
+    if (value >= 0)
+    {
+        _cbor_head(encoder, CBOR_UNSIGNED, (uint32_t)value);
+    }
+    else
+    {
+        /*-1 - n is encoded as n*/
+        _cbor_head(encoder, CBOR_NEGATIVE, (uint32_t)(-(value + 1)));
+    }
+}
+
+static void _cbor_map(encoderType *encoder, uint32_t count)
+{
+    if (count == ENCODER_INDEFINITE)
+    {
+        uint8_t head = CBOR_MAP_INDEFINITE;
+
+        _put(encoder, &head, 1);
+    }
+    else
+    {
+        _cbor_head(encoder, CBOR_MAP, count);
+    }
+}
+
+static void _cbor_array(encoderType *encoder, uint32_t count)
+{
+    if (count == ENCODER_INDEFINITE)
+    {
+        uint8_t head = CBOR_ARRAY_INDEFINITE;
+
+        _put(encoder, &head, 1);
+    }
+    else
+    {
+        _cbor_head(encoder, CBOR_ARRAY, count);
+    }
+}
+
+static void _cbor_end(encoderType *encoder)
+{
+    /*Definite-length containers end by their count*/
+    if (encoder->levels[encoder->depth - 1].indefinite)
+    {
+        uint8_t head = CBOR_BREAK;
+
+        _put(encoder, &head, 1);
+    }
+}
+
+static void _cbor_key(encoderType *encoder, uint32_t key)
+{
+    _cbor_head(encoder, CBOR_UNSIGNED, key);
+}
+
+static void _cbor_fixed(encoderType *encoder, int32_t value, uint8_t decimals)
+{
+    /*Decimal fraction: tag 4 followed by [exponent, mantissa]*/
+    _cbor_head(encoder, CBOR_TAG, CBOR_TAG_DECIMAL);
+    _cbor_head(encoder, CBOR_ARRAY, 2);
+    _cbor_int(encoder, -(int32_t)decimals);
+    _cbor_int(encoder, value);
+}
+
+static void _cbor_bytes(encoderType *encoder, const uint8_t *data, uint32_t length)
+{
+    _cbor_head(encoder, CBOR_BYTES, length);
+    _put(encoder, data, length);
+}
+
+/**
+ * @function _json_separator
+ *
+ * @brief Writes the ',' or ':' that precedes the next key or value.
+ */
+static void _json_separator(encoderType *encoder)
+{
+    /*Local variables*/
+    uint16_t items;
+
+    if (encoder->depth == 0)
+    {
+        return;
+    }
+
+    items = encoder->levels[encoder->depth - 1].items;
+
+    if (encoder->levels[encoder->depth - 1].map && (items % 2) != 0)
+    {
+        _put(encoder, ":", 1);
+    }
+    else if (items != 0)
+    {
+        _put(encoder, ",", 1);
+    }
+}
+
+/**
+ * @function _json_digits
+ *
+ * @brief Writes a decimal number, padded with zeros to width digits.
+ */
+static void _json_digits(encoderType *encoder, uint32_t value, uint8_t width)
+{
+    /*Local variables*/
+    char digits[10];
+    uint32_t count = 0;
+
+    do
+    {
+        digits[sizeof(digits) - 1 - count++] = '0' + (value % 10);
+        value /= 10;
+    } while ((value != 0 || count < width) && count < sizeof(digits));
+
+    _put(encoder, &digits[sizeof(digits) - count], count);
+}
+
+static void _json_map(encoderType *encoder, uint32_t count)
+{
+    _json_separator(encoder);
+    _put(encoder, "{", 1);
+}
+
+static void _json_array(encoderType *encoder, uint32_t count)
+{
+    _json_separator(encoder);
+    _put(encoder, "[", 1);
+}
+
+static void _json_end(encoderType *encoder)
+{
+    _put(encoder, encoder->levels[encoder->depth - 1].map ? "}" : "]", 1);
+}
+
+static void _json_key(encoderType *encoder, uint32_t key)
+{
+    _json_separator(encoder);
+    _put(encoder, "\"", 1);
+    _json_digits(encoder, key, 1);
+    _put(encoder, "\"", 1);
+}
+
+static void _json_integer(encoderType *encoder, int32_t value)
+{
+    _json_separator(encoder);
+
+    if (value < 0)
+    {
+        _put(encoder, "-", 1);
+    }
+
+    _json_digits(encoder, (value < 0) ? (uint32_t)(-(value + 1)) + 1 : (uint32_t)value, 1);
+}
+
+static void _json_fixed(encoderType *encoder, int32_t value, uint8_t decimals)
+{
+    /*Local variables*/
+    uint32_t magnitude = (value < 0) ? (uint32_t)(-(value + 1)) + 1 : (uint32_t)value;
+    uint32_t scale = 1;
+
+    for (uint8_t i = 0; i < decimals; i++)
+    {
+        scale *= 10;
+    }
+
+    _json_separator(encoder);
+
+    if (value < 0)
+    {
+        _put(encoder, "-", 1);
+    }
+
+    _json_digits(encoder, magnitude / scale, 1);
+
+    if (decimals != 0)
+    {
+        _put(encoder, ".", 1);
+        _json_digits(encoder, magnitude % scale, decimals);
+    }
+}
+
+static void _json_bytes(encoderType *encoder, const uint8_t *data, uint32_t length)
+{
+    /*Local variables*/
+    static const char hex[] = "0123456789abcdef";
+
+    /*Lowercase hex string*/
+    _json_separator(encoder);
+    _put(encoder, "\"", 1);
+
+    for (uint32_t i = 0; i < length; i++)
+    {
+        char pair[2] = { hex[data[i] >> 4], hex[data[i] & 0x0F] };
+
+        _put(encoder, pair, 2);
+    }
+
+    _put(encoder, "\"", 1);
+}
@@ -15,13 +15,21 @@
 #include <timebase.h>       // SysTick timer
 #include <wifi.h>           // WiFi functionality
 #include <adc.h>            // Get internal temperature calculation functions
+#include <temperature.h>    // Internal temperature sensor
 #include <rtc.h>            // RTC Clock and Alarms
 #include <pwr.h>            // Low power functionalities
+#include <at_engine.h>      // AT command engine
+#include <modem_cache.h>    // Facts about the WiFi module kept in the RTC backup registers
+#include <telemetry.h>      // Samples batched across sleep cycles
+#include <rudp.h>           // Acknowledged and retransmitted datagrams
 
 /*Definitions*/
 #define NUM_OF_STATES       7     // Number of states of the FSM
 #define MAX_RETRIES         5     // Number of retries if something fails in FSM
-#define SLEEP_TIME          1800  // Time in seconds
+#define BUSY_BACKOFF        200   // Time in ms to let the WiFi module finish its previous command
+#define KEEP_CONNECTION     1     // The UDP link stays open while the MCU sleeps, it is closed only after a failure
+#define RELIABLE_UPLINK     0     // The batch goes behind a rudp header and is retransmitted until acknowledged, the server must speak rudp
+#define BURST_TIMEOUT       100   // Time in ms the MCU stays out of Stop mode for a line that never goes idle
 
 /**
  * @brief State machine states.
@@ -40,6 +48,13 @@ enum states
 
 typedef enum states stateType;
 
+/*A kept link is reused by the next wake-up, AT+CIPSTART and AT+CIPCLOSE are only sent after a failure*/
+#if KEEP_CONNECTION
+#define AFTER_UPLOAD        POWER_DOWN
+#else
+#define AFTER_UPLOAD        CLOSE_CONNECTION
+#endif
+
 struct stateflow
 {
     char *state_name;                      // State name (optional, for debugging)
@@ -69,6 +84,12 @@ int FSM_close_connection();
 int FSM_power_down();
 
 
+/*Local variables, kept in SRAM through Stop mode*/
+#if RELIABLE_UPLINK
+static rudpType uplink;              // Reliable connection to the server
+static uint32_t batch_samples = 0;   // Samples in the datagram in flight
+#endif
+
 /*Global variables*/
 rtcType RTClock =
 {
@@ -92,7 +113,7 @@ stateflowType state_table[NUM_OF_STATES] =
     { "[1] READ TIME FROM NTP SERVER",   FSM_read_time,             {OPEN_CONNECTION},   OPEN_CONNECTION,  WIFI_INIT },         // READ_TIME (state 1)
     { "[2] OPEN UDP CONNECTION",         FSM_open_connection,       {SEND_DATA},         SEND_DATA,        WIFI_INIT },         // OPEN_CONNECTION (state 2)
     { "[3] SEND UDP DATA",               FSM_send_data,             {RECEIVE_DATA},      RECEIVE_DATA,     CLOSE_CONNECTION },  // SEND_DATA (state 3)
-    { "[4] RECEIVE UDP DATA",            FSM_receive_data,          {CLOSE_CONNECTION},  CLOSE_CONNECTION, SEND_DATA },         // RECEIVE_DATA (state 4)
+    { "[4] RECEIVE UDP DATA",            FSM_receive_data,          {AFTER_UPLOAD},      AFTER_UPLOAD,     SEND_DATA },         // RECEIVE_DATA (state 4)
     { "[5] CLOSE CONNECTION",            FSM_close_connection,      {POWER_DOWN},        POWER_DOWN,       OPEN_CONNECTION },   // CLOSE_CONNECTION (state 5)
     { "[6] POWER DOWN",                  FSM_power_down,            {WIFI_INIT},         STOP,             WIFI_INIT }          // POWER_DOWN (state 6)
 };
@@ -113,6 +134,14 @@ int main(void)
     /*Initialize UART1 peripheral for communication with ESP32 module*/
     uart1_init();
 
+    /*Track the unsolicited result codes of the ESP32 module*/
+    WiFi_urc_init();
+
+#if RELIABLE_UPLINK
+    /*Sequence numbers start over, the first datagram tells the server so*/
+    rudp_init(&uplink);
+#endif
+
 #ifdef DEBUG_SYSTEM
     /*Check the system clock*/
     if (READ_BIT(RCC->CFGR, RCC_CFGR_SWS) == RCC_CFGR_SWS_HSI)
@@ -128,6 +157,9 @@ int main(void)
     /*Initialize RTC peripheral*/
     rtc_init(RTClock);
 
+    /*Restore the facts about the WiFi module learned before the reset*/
+    modem_cache_init();
+
     /*Test device peripherals*/
     initiate_testing();
 
@@ -136,25 +168,75 @@ int main(void)
 
     while (1)
     {
-        /*Query the WiFi connection status*/
-        WiFi_status();
+        /*Sample on every wake-up, the batch is kept in SRAM through Stop mode*/
+        if (temperature_read(&node.temperature_value))
+        {
+            telemetry_add(node.temperature_value);
+        }
+#ifdef DEBUG_SYSTEM
+        else
+        {
+            LOG_ERR("Temperature sensor did not answer, no sample");
+        }
+#endif
+
+        /*Bring the radio up only when the batch is due*/
+        if (telemetry_upload_due())
+        {
+            /*Query the WiFi connection status*/
+            WiFi_status();
 
 
-        /*Start server update*/
-        server_update();
+            /*Start server update*/
+            server_update();
+        }
 
 
 #ifdef DEBUG_SYSTEM
+        /*Learned command latencies, they survive the Stop mode that follows*/
+        at_timeout_print();
+        {
+            uint32_t hits, misses;
+
+            const WiFi_join_statsType *joins = WiFi_join_stats();
+
+            modem_cache_stats(&hits, &misses);
+            printf("Modem cache: %lu hits, %lu misses%c%c", hits, misses, RETURN, NEWLINE);
+            printf("Joins: %lu fast (%lu ms average), %lu full scan (%lu ms average), %lu fallbacks, %lu sticky lease, %lu DHCP%c%c",
+                   joins->fast_joins, joins->fast_joins ? joins->fast_time / joins->fast_joins : 0,
+                   joins->full_joins, joins->full_joins ? joins->full_time / joins->full_joins : 0,
+                   joins->fallbacks, joins->sticky, joins->dhcp, RETURN, NEWLINE);
+        }
+        printf("Telemetry: %lu samples waiting%c%c", telemetry_count(), RETURN, NEWLINE);
         LOG_INF("Going to sleep");
 #endif
         /*Avoid conflicts with low power mode*/
         Disable_SysTick();
         /*Set the alarm in seconds*/
-        RTC_set_alarm(SLEEP_TIME);
+        RTC_set_alarm(TELEMETRY_SAMPLE_PERIOD);
         /*Prepare the system for low power consumption*/
         prepare_LowPower();
-        /*Enter stop mode with voltage regulator off*/
-        enter_SleepMode();
+        /*Enter stop mode with voltage regulator off, serve the unsolicited result codes
+          that wake the MCU up and go back to sleep until the RTC alarm fires*/
+        do
+        {
+            uint32_t woken;
+
+            enter_SleepMode();
+
+            /*Timeouts of the AT engine need the tick while awake*/
+            Resume_SysTick();
+            woken = get_tick();
+
+            /*The DMA only runs outside Stop mode, sleep with it until IDLE closes the burst*/
+            while (uart1_rx_active() && (get_tick() - woken) < BURST_TIMEOUT)
+            {
+                enter_CoreSleep();
+            }
+
+            at_poll();
+            Disable_SysTick();
+        } while (!mcu_alarm_pending());
         /*Resume SysTick timer*/
         Resume_SysTick();
 
@@ -236,7 +318,7 @@ static void initiate_testing(void)
     if (wifi_state != 0)
     {
         /*Wake-up the WiFi module*/
-        result_code = send_command("AT+SLEEP=0", "OK", NULL, "OK", 0, 1000);
+        result_code = send_command("AT+SLEEP=0", NULL, NULL, "OK", 1000);
         if (result_code != 0)
         {
             LOG_WRN("Couldn't wake-up the WiFi module");
@@ -246,7 +328,7 @@ static void initiate_testing(void)
     }
 
     /*Disable echo mode*/
-    result_code = send_command("ATE0", "OK", NULL, "OK", 0, 1000);
+    result_code = send_command("ATE0", NULL, NULL, "OK", 1000);
     if (result_code != 0)
     {
         LOG_WRN("Couldn't disable echo mode");
@@ -386,7 +468,11 @@ static void initiate_testing(void)
  *
  * @internal
  * - FSM starts at the `WIFI_INIT` state.
+ * - With `KEEP_CONNECTION` an acknowledged batch goes straight to `POWER_DOWN`, the link is only
+ *   closed after a failed send, and reopened by the next `OPEN_CONNECTION`.
  * - Retries counter is incremented with each failure.
+ * - A failed state moves on immediately, unless the WiFi module answered busy, in which case
+ *   the FSM waits `BUSY_BACKOFF` ms first.
  * - Stops when the FSM reaches the `STOP` state or when the maximum retries are exceeded.
  *
  * @debug Output is provided if `DEBUG_SYSTEM` is defined.
@@ -425,6 +511,12 @@ void server_update()
 
             /*Decrease the number of retries*/
             retries++;
+
+            /*Failures are reported as soon as the module answers, back off only if it was busy*/
+            if (WiFi_last_result()->code == WIFI_BUSY)
+            {
+                delay_ms(BUSY_BACKOFF);
+            }
         }
         else if (result == 0)
         {
@@ -494,6 +586,10 @@ int FSM_read_time()
  * @function FSM_open_connection
  *
  * @brief Connects to a specified server domain name, and port number.
+ *
+ * With KEEP_CONNECTION the link opened by an earlier wake-up is still open and
+ * reused without a command, unless the module reported it closed meanwhile.
+ *
  * @retval 0 on success, -1 otherwise.
  */
 int FSM_open_connection()
@@ -510,22 +606,46 @@ int FSM_open_connection()
         return -1;
     }
 
+#if RELIABLE_UPLINK
+    /*Datagrams still in flight from an earlier wake-up are retransmitted through it*/
+    rudp_bind(&uplink, WiFi_connection_socket());
+#endif
+
     return 0;
 }
 
 /**
  * function FMS_send_data
  *
- * @brief Sends a JSON schema to the connected server.
+ * @brief Sends the batch of samples to the connected server in one datagram.
+ *
+ * With RELIABLE_UPLINK the datagram goes through the reliable connection, the
+ * samples are only dropped once the server acknowledged it, see FSM_receive_data.
+ * A batch still in flight is not sent again, it is retransmitted under its
+ * sequence number. Otherwise the batch is a plain datagram, dropped once the
+ * module reported it sent.
+ *
  * @retval 0 on success, -1 otherwise.
  */
+#if RELIABLE_UPLINK
 int FSM_send_data()
 {
     /*Local variables*/
     int result = -1;
+    static uint8_t payload[RUDP_HEADER_SIZE + TELEMETRY_DATAGRAM_SIZE];
+    encoderType encoder;
 
-    /*Start a UDP connection*/
-    result = WiFi_send_udp();
+    if (rudp_pending(&uplink) != 0)
+    {
+        return 0;
+    }
+
+    /*Encode the samples taken since the last upload straight into the datagram, behind its header*/
+    encoder_init(&encoder, &TELEMETRY_ENCODER, &payload[RUDP_HEADER_SIZE], TELEMETRY_DATAGRAM_SIZE);
+    batch_samples = telemetry_encode(&encoder);
+
+    /*Send the batch*/
+    result = rudp_send(&uplink, payload, RUDP_HEADER_SIZE + encoder.length);
 
     /*Check the result code*/
     if (result != 0)
@@ -535,34 +655,108 @@ int FSM_send_data()
 
     return 0;
 }
+#else
+int FSM_send_data()
+{
+    /*Local variables*/
+    int result = -1;
+    static uint8_t payload[TELEMETRY_DATAGRAM_SIZE];
+    encoderType encoder;
+    uint32_t count;
+
+    /*Encode the samples taken since the last upload straight into the datagram*/
+    encoder_init(&encoder, &TELEMETRY_ENCODER, payload, sizeof(payload));
+    count = telemetry_encode(&encoder);
+
+    /*Send the batch*/
+    result = WiFi_send_data((const char *)payload, encoder.length);
+    if (result == 0)
+    {
+        telemetry_uploaded(count);
+    }
+
+    /*Check the result code*/
+    if (result != 0)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+#endif
 
 /**
  * @function FSM_receive_data
  *
- * @brief Receives a JSON schema from the connected server
+ * @brief Receives what the server sends back and prints it.
+ *
+ * With RELIABLE_UPLINK it waits until the server acknowledged the batch, which
+ * is retransmitted as its timeout expires. Once acknowledged its samples are
+ * dropped, a batch given up is encoded again by FSM_send_data.
+ *
  * @retval 0 on success, -1 otherwise.
  */
+#if RELIABLE_UPLINK
 int FSM_receive_data()
 {
     /*Local variables*/
     int result = -1;
-    char response_payload[100];
+    uint8_t response_payload[MAX_RECEIVE_SIZE];
+    uint32_t length = 0;
+
+    do
+    {
+        result = rudp_poll(&uplink, response_payload, sizeof(response_payload), &length, 2000);
+
+        /*The payload is binary, print the part that was stored*/
+        if (result == WIFI_OK && length != 0)
+        {
+            if (length > sizeof(response_payload) - RUDP_HEADER_SIZE)
+            {
+                length = sizeof(response_payload) - RUDP_HEADER_SIZE;
+            }
+
+            printf("\tRECEIVE: %.*s%c%c%c%c", (int)length, (const char *)response_payload, RETURN, NEWLINE, RETURN, NEWLINE);
+        }
+    } while (result == WIFI_OK && rudp_pending(&uplink) != 0);
+
+    if (result != WIFI_OK)
+    {
+        LOG_ERR("The server did not acknowledge the batch");
+        return -1;
+    }
+
+    telemetry_uploaded(batch_samples);
 
-    /*Clear buffer*/
-    memset(response_payload, 0, sizeof(response_payload));
+    return 0;
+}
+#else
+int FSM_receive_data()
+{
+    /*Local variables*/
+    int result = -1;
+    uint8_t response_payload[MAX_RECEIVE_SIZE];
+    uint32_t length = 0;
 
     /*Receive data*/
-    result = WiFi_receive_data(response_payload);
+    result = WiFi_receive_data(response_payload, sizeof(response_payload), &length, 2000);
     if (result != 0)
     {
         LOG_ERR("In receiving data from server");
         return -1;
     }
 
-    printf("\tRECEIVE: %s%c%c%c%c", response_payload, RETURN, NEWLINE, RETURN, NEWLINE);
+    /*The payload is binary, print the part that was stored*/
+    if (length > sizeof(response_payload))
+    {
+        length = sizeof(response_payload);
+    }
+
+    printf("\tRECEIVE: %.*s%c%c%c%c", (int)length, (const char *)response_payload, RETURN, NEWLINE, RETURN, NEWLINE);
 
     return 0;
 }
+#endif
 
 /**
  * @function FSM_close_connection
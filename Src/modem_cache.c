@@ -0,0 +1,165 @@
+/*
+ * modem_cache.c
+ */
+
+
+#include <modem_cache.h>
+
+
+/*
+ * Layout of the RTC backup registers, the only 20 bytes that survive both Stop and
+ * Standby mode:
+ *
+ *  BKP0R  [31:16] MODEM_CACHE_MAGIC   [4:0] valid bit of each fact
+ *  BKP1R  MAC[0..3]
+ *  BKP2R  MAC[4..5]  MUX  RECVTYPE
+ *  BKP3R  IP[0..3]
+ *  BKP4R  [31:16] hits  [15:0] misses
+ */
+#define CACHE_MAGIC_POS        16U
+
+/*Where each fact lives, as a byte offset in BKP1R..BKP3R*/
+static const struct
+{
+    uint8_t offset;           // First byte
+    uint8_t size;             // Number of bytes
+    uint8_t invalidated_by;   // Bit mask of modem_event_t
+} fact_layout[FACT_COUNT] =
+{
+    { 0, 6, 0                                                 },  // FACT_MAC
+    { 6, 1, (1U << EVENT_RESTART)                             },  // FACT_MUX
+    { 7, 1, (1U << EVENT_RESTART)                             },  // FACT_RECVTYPE
+    { 8, 4, (1U << EVENT_RESTART) | (1U << EVENT_DISCONNECT)  },  // FACT_IP
+    { 0, 0, (1U << EVENT_RESTART)                             }   // FACT_SYSSTORE, the valid bit is the fact
+};
+
+/*Function prototypes*/
+static void _count(bool hit);
+
+
+/**
+ * @function modem_cache_init
+ *
+ * @brief Starts with an empty cache unless the backup registers hold a valid one.
+ * @pre rtc_init() has enabled access to the backup domain.
+ */
+void modem_cache_init(void)
+{
+    /*Backup registers are write protected while DBP is cleared*/
+    PWR->CR |= PWR_CR_DBP;
+
+    if ((RTC->BKP0R >> CACHE_MAGIC_POS) != MODEM_CACHE_MAGIC)
+    {
+        RTC->BKP0R = (MODEM_CACHE_MAGIC << CACHE_MAGIC_POS);
+        RTC->BKP4R = 0;
+    }
+}
+
+/**
+ * @function modem_cache_get
+ *
+ * @brief Reads a fact without asking the module.
+ * @param fact: The fact to read.
+ * @param value: Receives the fact, as many bytes as the fact has.
+ * @retval true on a hit, false if the module has to be asked.
+ */
+bool modem_cache_get(modem_fact_t fact, void *value)
+{
+    /*Local variables*/
+    volatile uint32_t *data = &RTC->BKP1R;
+    uint8_t *bytes = (uint8_t *)value;
+
+    if (!(RTC->BKP0R & (1U << fact)))
+    {
+        _count(false);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < fact_layout[fact].size; i++)
+    {
+        uint32_t offset = fact_layout[fact].offset + i;
+
+        bytes[i] = (uint8_t)(data[offset / 4] >> ((offset % 4) * 8));
+    }
+
+    _count(true);
+
+    return true;
+}
+
+/**
+ * @function modem_cache_put
+ *
+ * @brief Stores a fact the module has just reported.
+ * @param fact: The fact to store.
+ * @param value: The fact, as many bytes as the fact has.
+ */
+void modem_cache_put(modem_fact_t fact, const void *value)
+{
+    /*Local variables*/
+    volatile uint32_t *data = &RTC->BKP1R;
+    const uint8_t *bytes = (const uint8_t *)value;
+
+    for (uint32_t i = 0; i < fact_layout[fact].size; i++)
+    {
+        uint32_t offset = fact_layout[fact].offset + i;
+        uint32_t shift = (offset % 4) * 8;
+
+        data[offset / 4] = (data[offset / 4] & ~(0xFFU << shift)) | ((uint32_t)bytes[i] << shift);
+    }
+
+    RTC->BKP0R |= (1U << fact);
+}
+
+/**
+ * @function modem_cache_invalidate
+ *
+ * @brief Forgets the facts an event makes stale.
+ * @param event: What the module reported.
+ */
+void modem_cache_invalidate(modem_event_t event)
+{
+    for (uint32_t fact = 0; fact < FACT_COUNT; fact++)
+    {
+        if (fact_layout[fact].invalidated_by & (1U << event))
+        {
+            RTC->BKP0R &= ~(1U << fact);
+        }
+    }
+}
+
+/**
+ * @function modem_cache_stats
+ *
+ * @brief Reports how many lookups the cache answered since it was created.
+ * @param hits: Receives the lookups answered without the module.
+ * @param misses: Receives the lookups that needed the module.
+ */
+void modem_cache_stats(uint32_t *hits, uint32_t *misses)
+{
+    *hits   = RTC->BKP4R >> 16;
+    *misses = RTC->BKP4R & 0xFFFFU;
+}
+
+/**
+ * @function _count
+ *
+ * @brief Increments the hit or miss counter, they saturate at 65535.
+ */
+static void _count(bool hit)
+{
+    /*Local variables*/
+    uint32_t hits = RTC->BKP4R >> 16;
+    uint32_t misses = RTC->BKP4R & 0xFFFFU;
+
+    if (hit && hits < 0xFFFFU)
+    {
+        hits++;
+    }
+    else if (!hit && misses < 0xFFFFU)
+    {
+        misses++;
+    }
+
+    RTC->BKP4R = (hits << 16) | misses;
+}
@@ -0,0 +1,454 @@
+/*
+ * mqtt.c
+ */
+
+
+#include <mqtt.h>
+#include <at_engine.h>
+#include <at_parse.h>
+#include <urc.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+
+/*
+ * The MQTT client of the ESP-AT firmware (AT+MQTT* commands) keeps the TCP
+ * connection to the broker and answers its pings on its own, also while the
+ * module is in modem sleep and the MCU in Stop mode. The session is opened with
+ * clean session off and automatic reconnection on, so the broker keeps the
+ * subscriptions and the QoS 1 messages of the node while it is away, and a
+ * wake-up that finds the session open only publishes.
+ *
+ * Only link 0 of the module is used. The state below lives in SRAM, which Stop
+ * mode retains, and is corrected by "+MQTTCONNECTED", "+MQTTDISCONNECTED" and
+ * "ready" as the module reports them.
+ */
+#define MQTT_LINK              0
+
+/*States of AT+MQTTCONN? from which the module is configured and connected*/
+#define MQTT_MODULE_CONFIGURED 2
+#define MQTT_MODULE_CONNECTED  4
+
+/*Data line of AT+MQTTCONN?, "+MQTTCONN:<link>,<state>,<scheme>,..."*/
+struct mqtt_conn_line
+{
+    int8_t link;
+    int8_t state;
+};
+
+static const at_fieldType mqtt_conn_fields[] =
+{
+    AT_INT(struct mqtt_conn_line, link, ','),
+    AT_INT(struct mqtt_conn_line, state, ',')
+};
+
+static const at_schemaType mqtt_conn_schema = AT_SCHEMA("+MQTTCONN:", mqtt_conn_fields);
+
+/*Function prototypes*/
+static WiFi_res_t _configure(void);
+static void _urc_connected(const char *line, uint32_t length);
+static void _urc_disconnected(const char *line, uint32_t length);
+static void _urc_received(const char *line, uint32_t length);
+
+/*Local variables, kept in SRAM through Stop mode*/
+static mqtt_state_t state = MQTT_UNKNOWN;          // Connection to the broker
+static bool configured = false;                    // AT+MQTTUSERCFG and AT+MQTTCONNCFG were accepted
+static mqtt_messageType queue[MQTT_QUEUE_SIZE];    // Received messages not read yet
+static uint32_t queue_head = 0;                    // Oldest message
+static uint32_t queue_count = 0;                   // Messages in the queue
+static mqtt_statsType stats;
+
+
+/**
+ * @function mqtt_init
+ *
+ * @brief Registers the result codes that report the session and the received messages.
+ *
+ * The state of the session is unknown until the module is asked or reports it,
+ * a session the module kept open across a reset of the MCU is reused.
+ *
+ * @pre Call once, after WiFi_urc_init().
+ */
+void mqtt_init(void)
+{
+    state       = MQTT_UNKNOWN;
+    configured  = false;
+    queue_head  = 0;
+    queue_count = 0;
+    memset(&stats, 0, sizeof(stats));
+
+    urc_register("+MQTTCONNECTED:", _urc_connected);
+    urc_register("+MQTTDISCONNECTED:", _urc_disconnected);
+    urc_register("+MQTTSUBRECV:", _urc_received);
+}
+
+/**
+ * @function mqtt_connect
+ *
+ * @brief Opens the persistent session with the broker, unless it is open already.
+ *
+ * An open session costs no command. After a reset of the MCU the module is
+ * asked once with AT+MQTTCONN?, otherwise the client ID and the session options
+ * are set only when the module lost them and AT+MQTTCONN does the handshake.
+ *
+ * @retval WIFI_OK once the session is open, the result of the command that failed otherwise.
+ */
+WiFi_res_t mqtt_connect(void)
+{
+    /*Local variables*/
+    char command[AT_COMMAND_SIZE] = {0};
+    struct mqtt_conn_line conn = { -1, -1 };
+    WiFi_res_t result_code;
+
+    if (state == MQTT_UNKNOWN)
+    {
+        result_code = send_command("AT+MQTTCONN?", &mqtt_conn_schema, &conn, "OK", 1000);
+        if (result_code != WIFI_OK)
+        {
+            return result_code;
+        }
+
+        configured = (conn.state >= MQTT_MODULE_CONFIGURED);
+        state = (conn.state >= MQTT_MODULE_CONNECTED) ? MQTT_CONNECTED : MQTT_DISCONNECTED;
+    }
+
+    if (state == MQTT_CONNECTED)
+    {
+        stats.reuses++;
+        return WIFI_OK;
+    }
+
+    if (!configured)
+    {
+        result_code = _configure();
+        if (result_code != WIFI_OK)
+        {
+            return result_code;
+        }
+    }
+
+    /*The module reconnects on its own from now on, "+MQTTCONNECTED" precedes the OK*/
+    snprintf(command, sizeof(command), "AT+MQTTCONN=%d,\"%s\",%u,1", MQTT_LINK, MQTT_BROKER, MQTT_PORT);
+
+    result_code = send_command(command, NULL, NULL, "OK", 10000);
+    if (result_code != WIFI_OK)
+    {
+#ifdef DEBUG_SYSTEM
+        LOG_WRN("MQTT broker unreachable");
+#endif
+        /*The module may be reconnecting by itself, ask it next time*/
+        state = MQTT_UNKNOWN;
+        return result_code;
+    }
+
+    state = MQTT_CONNECTED;
+    stats.connects++;
+
+    return WIFI_OK;
+}
+
+/**
+ * @function mqtt_publish
+ *
+ * @brief Publishes a message, opening the session first if needed.
+ *
+ * The payload goes out with AT+MQTTPUBRAW after the module's prompt, so binary
+ * data is allowed. At QoS 1 the module reports +MQTTPUB:OK only once the broker
+ * acknowledged the message.
+ *
+ * @param topic: Topic, without double quotes or commas.
+ * @param payload: The message.
+ * @param length: Length of the message.
+ * @param qos: MQTT_QOS0 or MQTT_QOS1.
+ * @param retain: The broker keeps the message for later subscribers.
+ * @retval WIFI_OK once the module reported +MQTTPUB:OK, WIFI_FAIL as soon as it reported
+ *         +MQTTPUB:FAIL, the result of the command that failed otherwise.
+ */
+WiFi_res_t mqtt_publish(const char *topic, const uint8_t *payload, uint32_t length, mqtt_qos_t qos, bool retain)
+{
+    /*Local variables*/
+    char command[AT_COMMAND_SIZE] = {0};
+    WiFi_res_t result_code;
+    int written;
+
+    written = snprintf(command, sizeof(command), "AT+MQTTPUBRAW=%d,\"%s\",%lu,%d,%d", MQTT_LINK, topic, (unsigned long)length, qos, retain ? 1 : 0);
+    if (written < 0 || (uint32_t)written >= sizeof(command) - 2)
+    {
+        return WIFI_FAIL;
+    }
+
+    result_code = mqtt_connect();
+    if (result_code != WIFI_OK)
+    {
+        return result_code;
+    }
+
+    result_code = send_payload(command, (const char *)payload, length, "+MQTTPUB:OK", "+MQTTPUB:FAIL", (qos == MQTT_QOS0) ? 2000 : 5000);
+    if (result_code != WIFI_OK)
+    {
+        stats.publish_failures++;
+        return result_code;
+    }
+
+    stats.published++;
+
+    return WIFI_OK;
+}
+
+/**
+ * @function mqtt_subscribe
+ *
+ * @brief Subscribes to a topic, opening the session first if needed.
+ *
+ * The broker keeps the subscription in the persistent session and the module
+ * renews it when it reconnects, so it is needed once, not on every wake-up.
+ * Messages are queued for mqtt_receive() as "+MQTTSUBRECV" reports them.
+ *
+ * @param topic: Topic filter, without double quotes or commas.
+ * @param qos: MQTT_QOS0 or MQTT_QOS1.
+ * @retval WIFI_OK once the broker accepted the subscription, the result of the command that failed otherwise.
+ */
+WiFi_res_t mqtt_subscribe(const char *topic, mqtt_qos_t qos)
+{
+    /*Local variables*/
+    char command[AT_COMMAND_SIZE] = {0};
+    WiFi_res_t result_code;
+    int written;
+
+    written = snprintf(command, sizeof(command), "AT+MQTTSUB=%d,\"%s\",%d", MQTT_LINK, topic, qos);
+    if (written < 0 || (uint32_t)written >= sizeof(command) - 2)
+    {
+        return WIFI_FAIL;
+    }
+
+    result_code = mqtt_connect();
+    if (result_code != WIFI_OK)
+    {
+        return result_code;
+    }
+
+    return send_command(command, NULL, NULL, "OK", 5000);
+}
+
+/**
+ * @function mqtt_receive
+ *
+ * @brief Takes the oldest message received on a subscribed topic.
+ * @param message: Receives the message.
+ * @retval true if a message was taken, false if none is waiting.
+ */
+bool mqtt_receive(mqtt_messageType *message)
+{
+    /*Serve the lines received since the last call*/
+    at_poll();
+
+    if (queue_count == 0)
+    {
+        return false;
+    }
+
+    *message = queue[queue_head];
+    queue_head = (queue_head + 1) % MQTT_QUEUE_SIZE;
+    queue_count--;
+
+    return true;
+}
+
+/**
+ * @function mqtt_disconnect
+ *
+ * @brief Closes the connection and releases the MQTT client of the module.
+ *
+ * The broker keeps the session, the next mqtt_connect() resumes it with the
+ * subscriptions and the QoS 1 messages sent meanwhile.
+ *
+ * @retval The result of AT+MQTTCLEAN.
+ */
+WiFi_res_t mqtt_disconnect(void)
+{
+    /*Local variables*/
+    char command[20] = {0};
+    WiFi_res_t result_code;
+
+    snprintf(command, sizeof(command), "AT+MQTTCLEAN=%d", MQTT_LINK);
+
+    result_code = send_command(command, NULL, NULL, "OK", 2000);
+    if (result_code == WIFI_OK)
+    {
+        state = MQTT_DISCONNECTED;
+        configured = false;
+    }
+
+    return result_code;
+}
+
+/**
+ * @function mqtt_state
+ *
+ * @brief Returns the state of the connection to the broker.
+ */
+mqtt_state_t mqtt_state(void)
+{
+    return state;
+}
+
+/**
+ * @function mqtt_stats
+ *
+ * @brief Returns the traffic of the client.
+ */
+const mqtt_statsType *mqtt_stats(void)
+{
+    return &stats;
+}
+
+/**
+ * @function mqtt_session_lost
+ *
+ * @brief The module restarted and forgot its MQTT client, the broker still keeps the session.
+ * @pre Called by the "ready" handler of wifi.c.
+ */
+void mqtt_session_lost(void)
+{
+    state = MQTT_DISCONNECTED;
+    configured = false;
+}
+
+/**
+ * @function _configure
+ *
+ * @brief Sets the client ID and the session options of link 0.
+ * @retval The result of the command that failed, WIFI_OK if both were accepted.
+ */
+static WiFi_res_t _configure(void)
+{
+    /*Local variables*/
+    char command[AT_COMMAND_SIZE] = {0};
+    WiFi_res_t result_code;
+
+    /*MQTT over TCP, no user name, password nor certificates*/
+    snprintf(command, sizeof(command), "AT+MQTTUSERCFG=%d,1,\"%s\",\"\",\"\",0,0,\"\"", MQTT_LINK, MQTT_CLIENT_ID);
+
+    result_code = send_command(command, NULL, NULL, "OK", 1000);
+    if (result_code != WIFI_OK)
+    {
+        return result_code;
+    }
+
+    /*Keepalive of a sleep period, clean session off, no last will*/
+    snprintf(command, sizeof(command), "AT+MQTTCONNCFG=%d,%d,1,\"\",\"\",0,0", MQTT_LINK, MQTT_KEEPALIVE);
+
+    result_code = send_command(command, NULL, NULL, "OK", 1000);
+    if (result_code != WIFI_OK)
+    {
+        return result_code;
+    }
+
+    configured = true;
+
+    return WIFI_OK;
+}
+
+/**
+ * @function _urc_connected
+ *
+ * @brief The module connected to the broker, also when it reconnected by itself.
+ */
+static void _urc_connected(const char *line, uint32_t length)
+{
+    state = MQTT_CONNECTED;
+    configured = true;
+}
+
+/**
+ * @function _urc_disconnected
+ *
+ * @brief The connection to the broker dropped, the module is reconnecting.
+ */
+static void _urc_disconnected(const char *line, uint32_t length)
+{
+    state = MQTT_DISCONNECTED;
+}
+
+/**
+ * @function _urc_received
+ *
+ * @brief Queues a message received on a subscribed topic.
+ *
+ * "+MQTTSUBRECV:<link>,"<topic>",<len>,<data>" arrives as a line, so only the
+ * part of the payload that fits URC_LINE_SIZE and MQTT_PAYLOAD_SIZE is kept and
+ * payloads with line breaks are cut at the first one. A full queue drops the new
+ * message, the oldest ones are read first.
+ */
+static void _urc_received(const char *line, uint32_t length)
+{
+    /*Local variables*/
+    const char *end = line + length;
+    const char *topic;
+    const char *data;
+    char *next;
+    mqtt_messageType *message;
+    uint32_t topic_length;
+    uint32_t total;
+    uint32_t stored;
+
+    /*Skip the link ID*/
+    topic = strchr(line, ',');
+    if (topic == NULL || topic[1] != '"')
+    {
+        return;
+    }
+
+    topic += 2;
+
+    data = strchr(topic, '"');
+    if (data == NULL || data[1] != ',')
+    {
+        return;
+    }
+
+    topic_length = data - topic;
+
+    total = strtoul(data + 2, &next, 10);
+    if (*next != ',')
+    {
+        return;
+    }
+
+    data = next + 1;
+
+    if (queue_count >= MQTT_QUEUE_SIZE)
+    {
+        stats.dropped++;
+        return;
+    }
+
+    message = &queue[(queue_head + queue_count) % MQTT_QUEUE_SIZE];
+
+    if (topic_length >= MQTT_TOPIC_SIZE)
+    {
+        topic_length = MQTT_TOPIC_SIZE - 1;
+    }
+
+    memcpy(message->topic, topic, topic_length);
+    message->topic[topic_length] = '\0';
+
+    stored = end - data;
+    if (stored > total)
+    {
+        stored = total;
+    }
+
+    if (stored > MQTT_PAYLOAD_SIZE)
+    {
+        stored = MQTT_PAYLOAD_SIZE;
+    }
+
+    memcpy(message->payload, data, stored);
+    message->length = stored;
+    message->total  = total;
+
+    queue_count++;
+    stats.received++;
+}
@@ -16,18 +16,62 @@
 #include <pwr.h>
 
 /**
- * @brief Receives responses from ESP32 module.
+ * @brief Receives responses from ESP32 module and feeds the command transmitter.
+ * The received bytes are moved by DMA1 channel 3; on the receive side this handler
+ * only runs once the line goes idle, which marks the end of a response burst.
  */
 void USART1_IRQHandler(void)
 {
-    /* Read RXNE bit to check if incoming data has arrived to RX_BUFFER */
-    if (READ_BIT(USART1->ISR, USART_ISR_RXNE))
+    /* Check if the line went idle after a burst */
+    if (READ_BIT(USART1->ISR, USART_ISR_IDLE))
     {
-        /* Read RDR register to retrieve data */
-        uart_receive_buffer[uart_receive_index] = (USART1->RDR & 0xFF);
+        /* Clear the IDLE flag */
+        USART1->ICR = USART_ICR_IDLECF;
 
-        /* Update circular buffer index */
-        uart_receive_index = (uart_receive_index + 1) % SIZE_OF_INCOMING_DATA;
+        /* Publish the burst to the AT layer */
+        uart1_rx_idle();
+    }
+
+    /* Woken up from Stop mode by incoming data, the MCU stays awake for the DMA until IDLE */
+    if (READ_BIT(USART1->ISR, USART_ISR_WUF))
+    {
+        USART1->ICR = USART_ICR_WUCF;
+        uart1_rx_wakeup();
+    }
+
+    /* An overrun stops the DMA requests, clear it and publish what was received to resume reception.
+       Framing and noise errors raise the same interrupt, the DMA already took their bytes */
+    if (READ_BIT(USART1->ISR, USART_ISR_ORE | USART_ISR_FE | USART_ISR_NE))
+    {
+        USART1->ICR = USART_ICR_ORECF | USART_ICR_FECF | USART_ICR_NCF;
+        uart1_rx_update();
+    }
+
+    /* Move the next queued command byte to the transmitter */
+    uart1_tx_irq();
+}
+
+/**
+ * @brief Feeds the console transmitter from its queue.
+ */
+void USART2_IRQHandler(void)
+{
+    uart2_tx_irq();
+}
+
+/**
+ * @brief Tracks the USART1 receive DMA on half and full transfer events, so
+ * long responses are published even if the line never goes idle.
+ */
+void DMA1_Channel2_3_IRQHandler(void)
+{
+    if (READ_BIT(DMA1->ISR, DMA_ISR_HTIF3 | DMA_ISR_TCIF3))
+    {
+        /* Clear channel 3 flags */
+        DMA1->IFCR = DMA_IFCR_CGIF3;
+
+        /* Publish the received bytes */
+        uart1_rx_update();
     }
 }
 
@@ -14,6 +14,10 @@
 #include <adc.h>
 
 
+/*Local variables*/
+static volatile bool alarm_wakeup = false;   // The RTC alarm ended the last Stop period
+
+
 /**
  * @function enter_SleepMode
  *
@@ -41,6 +45,24 @@ void enter_SleepMode(void)
 
     /* Wait for an interrupt to wake up */
     __WFI(); // Enter low-power state
+
+    /* Back to plain sleep, so the WFI of the AT layer waits do not stop the clocks */
+    SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+}
+
+/**
+ * @function enter_CoreSleep
+ *
+ * @brief Enter into sleep mode, only the core stops.
+ * The DMA, the peripherals and SysTick keep running and any interrupt wakes the core.
+ */
+void enter_CoreSleep(void)
+{
+    /* Sleep instead of Stop */
+    SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+
+    /* Wait for an interrupt to wake up */
+    __WFI();
 }
 
 /**
@@ -59,8 +81,10 @@ void prepare_LowPower(void)
     ADC1->CR &= ~ADC_CR_ADVREGEN; // Disable voltage regulator
 
     /**** UART ****/
-    USART1->CR1 &= ~USART_CR1_UE; // USART1 in low power
+    uart1_flush(100);             // Let queued bytes leave the wire
+    uart2_flush(100);
     USART2->CR1 &= ~USART_CR1_UE; // USART2 in low power
+    /* USART1 stays enabled: unsolicited result codes wake the MCU from Stop mode */
 
     //TODO: Disable or sleep peripherals in use
 
@@ -75,8 +99,24 @@ void mcu_WakeUp()
     adc1_init();
 
     /**** UART ****/
-    uart1_init();
-    uart2_init();
+    uart2_init();   // USART1 kept running through Stop mode
 
     //TODO: Enable or wake up peripherals in use
+
+    alarm_wakeup = true;
+}
+
+/**
+ * @function mcu_alarm_pending
+ *
+ * @brief Tells whether the RTC alarm ended the Stop period, and clears the flag.
+ * @retval false if the MCU was woken up by something else, e.g. the WiFi module.
+ */
+bool mcu_alarm_pending()
+{
+    bool pending = alarm_wakeup;
+
+    alarm_wakeup = false;
+
+    return pending;
 }
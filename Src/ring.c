@@ -0,0 +1,357 @@
+/*
+ * ring.c
+ */
+
+
+#include <ring.h>
+#include <string.h>
+
+
+/**
+ * @function ring_init
+ *
+ * @brief Attaches the storage to the ring and resets its counters.
+ * @param ring: The ring to initialize.
+ * @param buffer: Storage of the ring.
+ * @param size: Size of the storage, must be a power of two.
+ * @retval None.
+ */
+void ring_init(ringType *ring, volatile char *buffer, uint32_t size)
+{
+    ring->buffer    = buffer;
+    ring->size      = size;
+    ring->head      = 0;
+    ring->tail      = 0;
+    ring->overflows = 0;
+}
+
+/**
+ * @function ring_produced
+ *
+ * @brief Publishes bytes already placed in the storage by the producer (e.g. DMA).
+ * @note Producer side. If the consumer lagged more than a full lap, the lost
+ * bytes are added to the overflow counter.
+ * @param ring: The ring.
+ * @param length: Number of new bytes.
+ * @retval None.
+ */
+void ring_produced(ringType *ring, uint32_t length)
+{
+    uint32_t head = ring->head + length;
+    uint32_t used = head - ring->tail;
+
+    if (used > ring->size)
+    {
+        /*The oldest bytes were overwritten*/
+        ring->overflows += used - ring->size;
+    }
+
+    ring->head = head;
+}
+
+/**
+ * @function ring_write
+ *
+ * @brief Copies bytes into the ring.
+ * @note Producer side. Never overwrites unread bytes.
+ * @param ring: The ring.
+ * @param data: Bytes to write.
+ * @param length: Number of bytes to write.
+ * @retval Number of bytes written, limited by the free space.
+ */
+uint32_t ring_write(ringType *ring, const char *data, uint32_t length)
+{
+    uint32_t head = ring->head;
+    uint32_t count = ring_free(ring);
+
+    if (count > length)
+    {
+        count = length;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        ring->buffer[(head + i) & (ring->size - 1)] = data[i];
+    }
+
+    /*Publish after the bytes are in place*/
+    ring->head = head + count;
+
+    return count;
+}
+
+/**
+ * @function ring_available
+ *
+ * @brief Returns the number of unread bytes.
+ * @note Consumer side. After an overflow the tail is moved to the oldest byte
+ * still present, so the reader never sees a torn lap.
+ * @param ring: The ring.
+ * @retval Number of unread bytes.
+ */
+uint32_t ring_available(ringType *ring)
+{
+    uint32_t used = ring->head - ring->tail;
+
+    if (used > ring->size)
+    {
+        /*Resynchronize with the producer*/
+        ring->tail = ring->head - ring->size;
+        used = ring->size;
+    }
+
+    return used;
+}
+
+/**
+ * @function ring_fill
+ *
+ * @brief Returns the number of unread bytes without touching the counters.
+ * @note Either side. Unlike ring_available() it never resynchronizes the tail, so
+ * the producer can ask whether anything is queued. Capped at the ring size after
+ * an overflow.
+ * @param ring: The ring.
+ * @retval Number of unread bytes.
+ */
+uint32_t ring_fill(ringType *ring)
+{
+    uint32_t used = ring->head - ring->tail;
+
+    return (used > ring->size) ? ring->size : used;
+}
+
+/**
+ * @function ring_free
+ *
+ * @brief Returns the number of bytes that can be written without overwriting.
+ * @note Producer side.
+ * @param ring: The ring.
+ * @retval Number of free bytes.
+ */
+uint32_t ring_free(ringType *ring)
+{
+    uint32_t used = ring->head - ring->tail;
+
+    return (used >= ring->size) ? 0 : (ring->size - used);
+}
+
+/**
+ * @function ring_at
+ *
+ * @brief Returns an unread byte without consuming it.
+ * @note Consumer side. The caller ensures offset < ring_available().
+ * @param ring: The ring.
+ * @param offset: Position relative to the tail.
+ * @retval The byte.
+ */
+char ring_at(ringType *ring, uint32_t offset)
+{
+    return ring->buffer[(ring->tail + offset) & (ring->size - 1)];
+}
+
+/**
+ * @function ring_spans
+ *
+ * @brief Describes unread bytes as at most two contiguous spans.
+ * @note Consumer side. The spans stay valid until the bytes are consumed.
+ * @param ring: The ring.
+ * @param offset: Start position relative to the tail.
+ * @param length: Number of bytes wanted, limited by the unread bytes.
+ * @param spans: Receives the spans, the second one is used when the range wraps.
+ * @retval Number of spans filled (0, 1 or 2).
+ */
+uint32_t ring_spans(ringType *ring, uint32_t offset, uint32_t length, ring_spanType spans[2])
+{
+    uint32_t available = ring_available(ring);
+    uint32_t start, first;
+
+    if (offset >= available)
+    {
+        return 0;
+    }
+
+    if (length > available - offset)
+    {
+        length = available - offset;
+    }
+
+    if (length == 0)
+    {
+        return 0;
+    }
+
+    start = (ring->tail + offset) & (ring->size - 1);
+    first = ring->size - start;
+
+    spans[0].data = (const char *)&ring->buffer[start];
+
+    if (length <= first)
+    {
+        spans[0].length = length;
+        return 1;
+    }
+
+    spans[0].length = first;
+    spans[1].data   = (const char *)&ring->buffer[0];
+    spans[1].length = length - first;
+
+    return 2;
+}
+
+/**
+ * @function ring_peek
+ *
+ * @brief Copies unread bytes without consuming them.
+ * @note Consumer side.
+ * @param ring: The ring.
+ * @param offset: Start position relative to the tail.
+ * @param data: Destination buffer.
+ * @param length: Maximum number of bytes to copy.
+ * @retval Number of bytes copied.
+ */
+uint32_t ring_peek(ringType *ring, uint32_t offset, char *data, uint32_t length)
+{
+    ring_spanType spans[2];
+    uint32_t count = ring_spans(ring, offset, length, spans);
+    uint32_t copied = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        memcpy(&data[copied], spans[i].data, spans[i].length);
+        copied += spans[i].length;
+    }
+
+    return copied;
+}
+
+/**
+ * @function ring_read
+ *
+ * @brief Copies unread bytes and consumes them.
+ * @note Consumer side.
+ * @param ring: The ring.
+ * @param data: Destination buffer.
+ * @param length: Maximum number of bytes to copy.
+ * @retval Number of bytes copied.
+ */
+uint32_t ring_read(ringType *ring, char *data, uint32_t length)
+{
+    uint32_t copied = ring_peek(ring, 0, data, length);
+
+    ring_consume(ring, copied);
+
+    return copied;
+}
+
+/**
+ * @function ring_consume
+ *
+ * @brief Releases unread bytes back to the producer.
+ * @note Consumer side.
+ * @param ring: The ring.
+ * @param length: Number of bytes to release, limited by the unread bytes.
+ * @retval None.
+ */
+void ring_consume(ringType *ring, uint32_t length)
+{
+    uint32_t available = ring_available(ring);
+
+    if (length > available)
+    {
+        length = available;
+    }
+
+    ring->tail += length;
+}
+
+/**
+ * @function ring_view
+ *
+ * @brief Describes unread bytes in place, without copying them.
+ * @note Consumer side. The view stays valid until the bytes are consumed, provided
+ * the producer does not lap the ring in the meantime.
+ * @param ring: The ring.
+ * @param offset: Start position relative to the tail.
+ * @param length: Number of bytes wanted, limited by the unread bytes.
+ * @param view: Receives the view.
+ * @retval Number of bytes in the view.
+ */
+uint32_t ring_view(ringType *ring, uint32_t offset, uint32_t length, ring_viewType *view)
+{
+    view->count  = ring_spans(ring, offset, length, view->spans);
+    view->length = 0;
+
+    for (uint32_t i = 0; i < view->count; i++)
+    {
+        view->length += view->spans[i].length;
+    }
+
+    return view->length;
+}
+
+/**
+ * @function ring_view_init
+ *
+ * @brief Describes a plain buffer as a view, for data that is not in a ring.
+ * @param view: Receives the view.
+ * @param data: The buffer.
+ * @param length: Number of bytes in the buffer.
+ * @retval None.
+ */
+void ring_view_init(ring_viewType *view, const char *data, uint32_t length)
+{
+    view->spans[0].data   = data;
+    view->spans[0].length = length;
+    view->count           = (length != 0) ? 1 : 0;
+    view->length          = length;
+}
+
+/**
+ * @function ring_view_at
+ *
+ * @brief Returns a byte of a view.
+ * @note The caller ensures index < view->length.
+ * @param view: The view.
+ * @param index: Position in the view.
+ * @retval The byte.
+ */
+char ring_view_at(const ring_viewType *view, uint32_t index)
+{
+    if (index < view->spans[0].length)
+    {
+        return view->spans[0].data[index];
+    }
+
+    return view->spans[1].data[index - view->spans[0].length];
+}
+
+/**
+ * @function ring_view_find
+ *
+ * @brief Finds a string in a view, also when it straddles the wrap.
+ * @param view: The view.
+ * @param from: Position where the search starts.
+ * @param text: NUL terminated string to find.
+ * @retval Position of the first match, -1 if there is none.
+ */
+int32_t ring_view_find(const ring_viewType *view, uint32_t from, const char *text)
+{
+    uint32_t length = strlen(text);
+
+    for (uint32_t i = from; i + length <= view->length; i++)
+    {
+        uint32_t j = 0;
+
+        while (j < length && ring_view_at(view, i + j) == text[j])
+        {
+            j++;
+        }
+
+        if (j == length)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
@@ -34,10 +34,6 @@ int rtc_init(rtcType rtc)
     /* Enable access to RTC and Backup registers */
     PWR->CR |= PWR_CR_DBP;
 
-    /* Reset the RTC */
-    RCC->CSR |= RCC_CSR_RTCRST;
-    RCC->CSR &= ~RCC_CSR_RTCRST;
-
     /* Enable low speed internal clock (LSI) */
     RCC->CSR |= RCC_CSR_LSION;
 
@@ -51,12 +47,21 @@ int rtc_init(rtcType rtc)
         return -1;
     }
 
-    /* Select LSI as RTC clock source */
-    RCC->CSR &= ~RCC_CSR_RTCSEL;        /* Clear the RTC clock source selection */
-    RCC->CSR |= RCC_CSR_RTCSEL_LSI;     /* Set LSI as RTC clock source */
+    /* Reset the RTC only if it is not running from LSI yet: the reset also clears the
+       backup registers, which keep the modem cache across resets and NTP updates */
+    if ((RCC->CSR & (RCC_CSR_RTCEN | RCC_CSR_RTCSEL)) != (RCC_CSR_RTCEN | RCC_CSR_RTCSEL_LSI))
+    {
+        /* Reset the RTC */
+        RCC->CSR |= RCC_CSR_RTCRST;
+        RCC->CSR &= ~RCC_CSR_RTCRST;
+
+        /* Select LSI as RTC clock source */
+        RCC->CSR &= ~RCC_CSR_RTCSEL;        /* Clear the RTC clock source selection */
+        RCC->CSR |= RCC_CSR_RTCSEL_LSI;     /* Set LSI as RTC clock source */
 
-    /* Enable the RTC clock */
-    RCC->CSR |= RCC_CSR_RTCEN;
+        /* Enable the RTC clock */
+        RCC->CSR |= RCC_CSR_RTCEN;
+    }
 
     /* Unlock the RTC write protection */
     RTC->WPR = UNLOCK_KEY_1;  /* First key */
@@ -0,0 +1,87 @@
+/*
+ * rtt.c
+ */
+
+
+#include <rtt.h>
+
+
+/**
+ * @function rtt_sample
+ *
+ * @brief Feeds an observed round trip to the estimator.
+ * @param rtt: The estimator, zeroed before its first sample.
+ * @param elapsed: The round trip in ms.
+ */
+void rtt_sample(rtt_estimatorType *rtt, uint32_t elapsed)
+{
+    /*Local variables*/
+    int32_t delta;
+
+    if (rtt->samples == 0)
+    {
+        rtt->smoothed  = elapsed << 3;
+        rtt->deviation = elapsed << 1;
+    }
+    else
+    {
+        /*smoothed += (elapsed - smoothed) / 8, deviation += (|delta| - deviation) / 4*/
+        delta = (int32_t)elapsed - (int32_t)(rtt->smoothed >> 3);
+        rtt->smoothed += delta;
+
+        if (delta < 0)
+        {
+            delta = -delta;
+        }
+
+        delta -= (int32_t)(rtt->deviation >> 2);
+        rtt->deviation += delta;
+    }
+
+    if (rtt->samples < UINT16_MAX)
+    {
+        rtt->samples++;
+    }
+}
+
+/**
+ * @function rtt_mean
+ *
+ * @brief Mean round trip in ms.
+ */
+uint32_t rtt_mean(const rtt_estimatorType *rtt)
+{
+    return rtt->smoothed >> 3;
+}
+
+/**
+ * @function rtt_deviation
+ *
+ * @brief Mean deviation of the round trip in ms.
+ */
+uint32_t rtt_deviation(const rtt_estimatorType *rtt)
+{
+    return rtt->deviation >> 2;
+}
+
+/**
+ * @function rtt_timeout
+ *
+ * @brief Timeout derived from the estimate: mean plus four mean deviations, within the limits.
+ * @param rtt: The estimator.
+ * @param floor: Shortest timeout in ms.
+ * @param ceiling: Longest timeout in ms.
+ * @retval Timeout in ms.
+ */
+uint32_t rtt_timeout(const rtt_estimatorType *rtt, uint32_t floor, uint32_t ceiling)
+{
+    /*Local variables*/
+    uint32_t timeout = (rtt->smoothed >> 3) + rtt->deviation;
+
+    if (timeout < floor)
+    {
+        return floor;
+    }
+
+    return (timeout > ceiling) ? ceiling : timeout;
+}
@@ -0,0 +1,408 @@
+/*
+ * rudp.c
+ */
+
+
+#include <rudp.h>
+#include <string.h>
+
+
+/*
+ * Header in front of every datagram, little endian:
+ *
+ *  [0]     flags, RUDP_FLAG_*
+ *  [1..2]  sequence number of the payload
+ *  [3..4]  cumulative ACK: next sequence number expected from the peer
+ *  [5..6]  selective ACK: bit i set if expected + 1 + i was received
+ *
+ * Both ends run the same protocol. Up to RUDP_WINDOW datagrams are in flight.
+ * Each one is retransmitted when the timeout derived from the measured round
+ * trip time expires, and given up after RUDP_MAX_TRANSMISSIONS transmissions.
+ * The receiver acknowledges every datagram. It delivers each sequence number
+ * once, in the order it arrives; the sequence number is in the header for
+ * peers that need the original order.
+ */
+#define SACK_BITS              16
+
+/*Function prototypes*/
+static void _write_header(const rudpType *rudp, uint8_t *header, uint8_t flags, uint16_t sequence);
+static uint16_t _get16(const uint8_t *bytes);
+static bool _retransmit(rudpType *rudp, uint32_t *wait);
+static bool _acknowledge(rudpType *rudp, uint16_t cumulative, uint16_t mask);
+static bool _accept(rudpType *rudp, uint16_t sequence, uint8_t flags);
+
+
+/**
+ * @function rudp_init
+ *
+ * @brief Starts a connection from scratch, the first datagrams carry RUDP_FLAG_SYN.
+ * @param rudp: The connection, it has to outlive every datagram it sends.
+ */
+void rudp_init(rudpType *rudp)
+{
+    memset(rudp, 0, sizeof(*rudp));
+    rudp->socket = -1;
+    rudp->rto    = RUDP_RTO_INITIAL;
+}
+
+/**
+ * @function rudp_bind
+ *
+ * @brief Sends and receives the datagrams of a connection through a socket.
+ *
+ * The state of the connection outlives the socket: after the socket is closed
+ * and opened again, the datagrams still in flight are retransmitted through the
+ * new one.
+ *
+ * @param rudp: The connection.
+ * @param socket: UDP socket to the peer.
+ */
+void rudp_bind(rudpType *rudp, socket_handleType socket)
+{
+    rudp->socket = socket;
+}
+
+/**
+ * @function rudp_send
+ *
+ * @brief Sends a datagram and keeps it in the window until the peer acknowledges it.
+ *
+ * The datagram is not copied, the buffer has to stay untouched until
+ * rudp_pending() no longer counts it. Its first RUDP_HEADER_SIZE bytes are
+ * reserved for the header, the payload follows them.
+ *
+ * @param rudp: The connection.
+ * @param datagram: Header room followed by the payload.
+ * @param length: Length of the datagram, header included.
+ * @retval WIFI_OK once the datagram is in the window, also when its first transmission
+ * failed, rudp_poll() retransmits it. WIFI_BUSY if the window is full, WIFI_FAIL for a bad length.
+ */
+WiFi_res_t rudp_send(rudpType *rudp, uint8_t *datagram, uint32_t length)
+{
+    /*Local variables*/
+    struct rudp_slot *slot = NULL;
+
+    if (length < RUDP_HEADER_SIZE || length > UINT16_MAX)
+    {
+        return WIFI_FAIL;
+    }
+
+    for (uint32_t i = 0; i < RUDP_WINDOW; i++)
+    {
+        if (rudp->slots[i].datagram == NULL)
+        {
+            slot = (slot == NULL) ? &rudp->slots[i] : slot;
+        }
+        /*The peer only tracks RUDP_WINDOW sequence numbers past the oldest one in flight*/
+        else if ((uint16_t)(rudp->next_sequence - rudp->slots[i].sequence) >= RUDP_WINDOW)
+        {
+            return WIFI_BUSY;
+        }
+    }
+
+    if (slot == NULL)
+    {
+        return WIFI_BUSY;
+    }
+
+    slot->datagram      = datagram;
+    slot->length        = length;
+    slot->sequence      = rudp->next_sequence++;
+    slot->sent          = get_tick();
+    slot->transmissions = 1;
+
+    _write_header(rudp, datagram, RUDP_FLAG_DATA, slot->sequence);
+    socket_send(rudp->socket, datagram, length);
+
+    rudp->stats.sent++;
+
+    return WIFI_OK;
+}
+
+/**
+ * @function rudp_poll
+ *
+ * @brief Runs the connection: receives, acknowledges and retransmits.
+ *
+ * Returns as soon as a new datagram of the peer is delivered, or the last
+ * datagram in flight is acknowledged, or the timeout expires. Duplicates are
+ * acknowledged again and dropped.
+ *
+ * @param rudp: The connection.
+ * @param buffer: Receives the payload of a datagram of the peer. The header is read into it too,
+ * so the payload gets size - RUDP_HEADER_SIZE bytes at most.
+ * @param size: Size of the buffer.
+ * @param length: Receives the length of the payload, 0 if none was delivered.
+ * @param timeout: Time to wait in ms.
+ * @retval WIFI_OK if a payload was delivered or nothing is left in flight,
+ * WIFI_FAIL if a datagram was given up, WIFI_TIMEOUT otherwise.
+ */
+WiFi_res_t rudp_poll(rudpType *rudp, uint8_t *buffer, uint32_t size, uint32_t *length, uint32_t timeout)
+{
+    /*Local variables*/
+    uint32_t start = get_tick();
+    uint8_t ack[RUDP_HEADER_SIZE];
+    uint32_t received;
+    uint32_t elapsed;
+    uint32_t wait;
+
+    *length = 0;
+
+    if (size < RUDP_HEADER_SIZE)
+    {
+        return WIFI_FAIL;
+    }
+
+    while ((elapsed = get_tick() - start) < timeout)
+    {
+        wait = timeout - elapsed;
+
+        if (_retransmit(rudp, &wait))
+        {
+            return WIFI_FAIL;
+        }
+
+        if (socket_receive(rudp->socket, buffer, size, &received, wait) != WIFI_OK || received < RUDP_HEADER_SIZE)
+        {
+            continue;
+        }
+
+        if ((buffer[0] & RUDP_FLAG_ACK) && _acknowledge(rudp, _get16(&buffer[3]), _get16(&buffer[5])))
+        {
+            return WIFI_OK;
+        }
+
+        if (buffer[0] & RUDP_FLAG_DATA)
+        {
+            bool fresh = _accept(rudp, _get16(&buffer[1]), buffer[0]);
+
+            _write_header(rudp, ack, 0, rudp->next_sequence);
+            socket_send(rudp->socket, ack, sizeof(ack));
+
+            if (fresh)
+            {
+                received -= RUDP_HEADER_SIZE;
+                memmove(buffer, &buffer[RUDP_HEADER_SIZE], (received < size - RUDP_HEADER_SIZE) ? received : size - RUDP_HEADER_SIZE);
+                *length = received;
+                return WIFI_OK;
+            }
+        }
+    }
+
+    return WIFI_TIMEOUT;
+}
+
+/**
+ * @function rudp_pending
+ *
+ * @brief Returns the number of datagrams in flight.
+ */
+uint32_t rudp_pending(const rudpType *rudp)
+{
+    /*Local variables*/
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < RUDP_WINDOW; i++)
+    {
+        if (rudp->slots[i].datagram != NULL)
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * @function _write_header
+ *
+ * @brief Writes a header with the current acknowledgement of the peer's datagrams.
+ */
+static void _write_header(const rudpType *rudp, uint8_t *header, uint8_t flags, uint16_t sequence)
+{
+    if (!rudp->synced)
+    {
+        flags |= RUDP_FLAG_SYN;
+    }
+
+    if (rudp->peer_synced)
+    {
+        flags |= RUDP_FLAG_ACK;
+    }
+
+    header[0] = flags;
+    header[1] = (uint8_t)sequence;
+    header[2] = (uint8_t)(sequence >> 8);
+    header[3] = (uint8_t)rudp->expected;
+    header[4] = (uint8_t)(rudp->expected >> 8);
+    header[5] = (uint8_t)rudp->received_mask;
+    header[6] = (uint8_t)(rudp->received_mask >> 8);
+}
+
+/**
+ * @function _get16
+ *
+ * @brief Reads a little endian 16 bit field.
+ */
+static uint16_t _get16(const uint8_t *bytes)
+{
+    return bytes[0] | ((uint16_t)bytes[1] << 8);
+}
+
+/**
+ * @function _retransmit
+ *
+ * @brief Sends again the datagrams whose timeout expired, gives up on the ones sent too often.
+ * @param wait: Shortened to the time left until the next timeout expires.
+ * @retval true if a datagram was given up.
+ */
+static bool _retransmit(rudpType *rudp, uint32_t *wait)
+{
+    /*Local variables*/
+    uint32_t now = get_tick();
+    bool expired = false;
+    bool lost = false;
+
+    for (uint32_t i = 0; i < RUDP_WINDOW; i++)
+    {
+        struct rudp_slot *slot = &rudp->slots[i];
+        uint32_t age;
+
+        if (slot->datagram == NULL)
+        {
+            continue;
+        }
+
+        age = now - slot->sent;
+
+        if (age < rudp->rto)
+        {
+            if (rudp->rto - age < *wait)
+            {
+                *wait = rudp->rto - age;
+            }
+
+            continue;
+        }
+
+        if (slot->transmissions >= RUDP_MAX_TRANSMISSIONS)
+        {
+            slot->datagram = NULL;
+            rudp->stats.lost++;
+            lost = true;
+            continue;
+        }
+
+        /*The acknowledgement fields may have moved on since the last transmission*/
+        _write_header(rudp, slot->datagram, RUDP_FLAG_DATA, slot->sequence);
+        socket_send(rudp->socket, slot->datagram, slot->length);
+
+        slot->sent = get_tick();
+        slot->transmissions++;
+        rudp->stats.retransmits++;
+        expired = true;
+    }
+
+    /*Back off once per expiry, a new RTT sample restores the timeout*/
+    if (expired)
+    {
+        rudp->rto = (rudp->rto * 2 < RUDP_RTO_MAX) ? rudp->rto * 2 : RUDP_RTO_MAX;
+
+        if (rudp->rto < *wait)
+        {
+            *wait = rudp->rto;
+        }
+    }
+
+    return lost;
+}
+
+/**
+ * @function _acknowledge
+ *
+ * @brief Releases the datagrams the peer acknowledged, cumulatively or selectively.
+ * @retval true if this emptied the window.
+ */
+static bool _acknowledge(rudpType *rudp, uint16_t cumulative, uint16_t mask)
+{
+    /*Local variables*/
+    uint32_t now = get_tick();
+    bool released = false;
+
+    rudp->synced = true;
+
+    for (uint32_t i = 0; i < RUDP_WINDOW; i++)
+    {
+        struct rudp_slot *slot = &rudp->slots[i];
+        int16_t distance = (int16_t)(slot->sequence - cumulative);
+
+        if (slot->datagram == NULL)
+        {
+            continue;
+        }
+
+        if (distance < 0 || (distance >= 1 && distance <= SACK_BITS && (mask & (1U << (distance - 1)))))
+        {
+            /*Karn's algorithm: a retransmitted datagram does not tell which copy was acknowledged*/
+            if (slot->transmissions == 1)
+            {
+                rtt_sample(&rudp->rtt, now - slot->sent);
+                rudp->rto = rtt_timeout(&rudp->rtt, RUDP_RTO_MIN, RUDP_RTO_MAX);
+            }
+
+            slot->datagram = NULL;
+            rudp->stats.acknowledged++;
+            released = true;
+        }
+    }
+
+    return released && rudp_pending(rudp) == 0;
+}
+
+/**
+ * @function _accept
+ *
+ * @brief Records a sequence number of the peer.
+ * @retval true if it was not received before.
+ */
+static bool _accept(rudpType *rudp, uint16_t sequence, uint8_t flags)
+{
+    /*Local variables*/
+    int16_t distance = (int16_t)(sequence - rudp->expected);
+    bool received;
+
+    /*The first datagram of the peer, or the peer started again*/
+    if (!rudp->peer_synced || ((flags & RUDP_FLAG_SYN) && (distance < -SACK_BITS || distance > SACK_BITS)))
+    {
+        rudp->expected      = sequence;
+        rudp->received_mask = 0;
+        rudp->peer_synced   = true;
+        distance = 0;
+    }
+
+    if (distance < 0 || distance > SACK_BITS ||
+        (distance > 0 && (rudp->received_mask & (1U << (distance - 1)))))
+    {
+        rudp->stats.duplicates++;
+        return false;
+    }
+
+    if (distance > 0)
+    {
+        rudp->received_mask |= (1U << (distance - 1));
+    }
+    else
+    {
+        /*Move past this one and every one received ahead of it*/
+        do
+        {
+            received = rudp->received_mask & 1;
+            rudp->received_mask >>= 1;
+            rudp->expected++;
+        } while (received);
+    }
+
+    rudp->stats.received++;
+
+    return true;
+}
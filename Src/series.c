@@ -0,0 +1,232 @@
+/*
+ * series.c
+ */
+
+
+#include <series.h>
+#include <string.h>
+
+
+/*
+ * Stream format, one record per sample, every field a zig-zag LEB128 varint:
+ *
+ *  sample 0   time                  value[0] ... value[channels-1]
+ *  sample 1   time - time0          value[i] - previous value[i]
+ *  sample n   delta - previous delta  (delta-of-delta, 0 for a steady period)
+ *
+ * A steady sample period and a slowly changing value take 1 byte each. Only
+ * shifts, additions and compares are used, the Cortex-M0+ has no divider. The
+ * stream has no header: the decoder has to know the number of channels.
+ */
+
+/*Function prototypes*/
+static uint32_t _put_varint(uint8_t *out, int32_t value);
+static bool _get_varint(series_decoderType *decoder, int32_t *value);
+
+
+/**
+ * @function series_init
+ *
+ * @brief Starts an empty series.
+ * @param series: The encoder.
+ * @param buffer: Where the compressed samples are written.
+ * @param size: Size of the buffer.
+ * @param channels: Values per sample, up to SERIES_CHANNELS.
+ */
+void series_init(series_encoderType *series, void *buffer, uint32_t size, uint8_t channels)
+{
+    series->buffer     = (uint8_t *)buffer;
+    series->size       = size;
+    series->length     = 0;
+    series->count      = 0;
+    series->channels   = (channels > SERIES_CHANNELS) ? SERIES_CHANNELS : channels;
+    series->first_time = 0;
+    series->last_time  = 0;
+    series->last_delta = 0;
+    memset(series->last_values, 0, sizeof(series->last_values));
+}
+
+/**
+ * @function series_append
+ *
+ * @brief Compresses a sample and appends it.
+ * @param series: The encoder.
+ * @param time: Timestamp of the sample, not earlier than the previous one.
+ * @param values: One value per channel.
+ * @retval 0 on success, -1 if the buffer has no room for the sample, the series is left untouched.
+ */
+int series_append(series_encoderType *series, uint32_t time, const int32_t *values)
+{
+    /*Local variables*/
+    uint8_t record[SERIES_MAX_SAMPLE];
+    uint32_t length = 0;
+    int32_t delta = (int32_t)(time - series->last_time);
+
+    if (series->count == 0)
+    {
+        length += _put_varint(&record[length], (int32_t)time);
+        delta = 0;
+    }
+    else if (series->count == 1)
+    {
+        length += _put_varint(&record[length], delta);
+    }
+    else
+    {
+        length += _put_varint(&record[length], delta - series->last_delta);
+    }
+
+    for (uint32_t i = 0; i < series->channels; i++)
+    {
+        length += _put_varint(&record[length], values[i] - series->last_values[i]);
+    }
+
+    if (length > series->size - series->length)
+    {
+        return -1;
+    }
+
+    memcpy(&series->buffer[series->length], record, length);
+    series->length += length;
+
+    if (series->count == 0)
+    {
+        series->first_time = time;
+    }
+
+    series->last_delta = delta;
+    series->last_time  = time;
+    memcpy(series->last_values, values, series->channels * sizeof(int32_t));
+    series->count++;
+
+    return 0;
+}
+
+/**
+ * @function series_decoder_init
+ *
+ * @brief Starts reading a compressed series, on the target or on the server.
+ * @param decoder: The decoder.
+ * @param buffer: The compressed samples.
+ * @param length: Number of bytes.
+ * @param channels: Values per sample, as given to series_init().
+ */
+void series_decoder_init(series_decoderType *decoder, const void *buffer, uint32_t length, uint8_t channels)
+{
+    decoder->buffer     = (const uint8_t *)buffer;
+    decoder->length     = length;
+    decoder->position   = 0;
+    decoder->count      = 0;
+    decoder->channels   = (channels > SERIES_CHANNELS) ? SERIES_CHANNELS : channels;
+    decoder->last_time  = 0;
+    decoder->last_delta = 0;
+    memset(decoder->last_values, 0, sizeof(decoder->last_values));
+}
+
+/**
+ * @function series_next
+ *
+ * @brief Reads the next sample.
+ * @param decoder: The decoder.
+ * @param time: Receives the timestamp.
+ * @param values: Receives one value per channel.
+ * @retval 1 if a sample was read, 0 at the end of the series, -1 if it is truncated.
+ */
+int series_next(series_decoderType *decoder, uint32_t *time, int32_t *values)
+{
+    /*Local variables*/
+    int32_t field;
+    int32_t delta;
+
+    if (decoder->position >= decoder->length)
+    {
+        return 0;
+    }
+
+    if (!_get_varint(decoder, &field))
+    {
+        return -1;
+    }
+
+    if (decoder->count == 0)
+    {
+        decoder->last_time = (uint32_t)field;
+        delta = 0;
+    }
+    else
+    {
+        delta = (decoder->count == 1) ? field : decoder->last_delta + field;
+        decoder->last_time += delta;
+    }
+
+    decoder->last_delta = delta;
+
+    for (uint32_t i = 0; i < decoder->channels; i++)
+    {
+        if (!_get_varint(decoder, &field))
+        {
+            return -1;
+        }
+
+        decoder->last_values[i] += field;
+        values[i] = decoder->last_values[i];
+    }
+
+    *time = decoder->last_time;
+    decoder->count++;
+
+    return 1;
+}
+
+/**
+ * @function _put_varint
+ *
+ * @brief Writes a signed value as a zig-zag LEB128 varint, 7 bits per byte.
+ * @retval Number of bytes written, 1 to 5.
+ */
+static uint32_t _put_varint(uint8_t *out, int32_t value)
+{
+    /*Local variables*/
+    uint32_t zigzag = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+    uint32_t length = 0;
+
+    while (zigzag >= 0x80)
+    {
+        out[length++] = (uint8_t)(zigzag | 0x80);
+        zigzag >>= 7;
+    }
+
+    out[length++] = (uint8_t)zigzag;
+
+    return length;
+}
+
+/**
+ * @function _get_varint
+ *
+ * @brief Reads a zig-zag LEB128 varint.
+ * @retval false if the buffer ends inside the varint.
+ */
+static bool _get_varint(series_decoderType *decoder, int32_t *value)
+{
+    /*Local variables*/
+    uint32_t zigzag = 0;
+    uint32_t shift = 0;
+    uint8_t byte;
+
+    do
+    {
+        if (decoder->position >= decoder->length || shift > 28)
+        {
+            return false;
+        }
+
+        byte = decoder->buffer[decoder->position++];
+        zigzag |= (uint32_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    *value = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+
+    return true;
+}
@@ -0,0 +1,587 @@
+/*
+ * socket.c
+ */
+
+
+#include <socket.h>
+#include <urc.h>
+#include <ring.h>
+#include <string.h>
+#include <stdlib.h>
+
+
+/*
+ * Every link has a receive queue of whole datagrams, each stored as a 2 byte
+ * little endian length followed by the payload. A datagram is written into the
+ * queue as its chunks arrive and only published once complete, so
+ * socket_receive() never sees part of one. In single connection mode
+ * (WIFI_CIPMUX 0) only link 0 exists and the commands carry no link ID.
+ */
+#define RX_HEADER_SIZE         2
+
+/*State of a link of the module*/
+struct socket_link
+{
+    socketStatus_t state;            // Reported by "<link>,CONNECT" and "<link>,CLOSED"
+    uint8_t protocol;                // socket_protocol_t
+    char host[SOCKET_HOST_SIZE];     // Remote host the link was opened to
+    uint16_t port;                   // Remote port
+    uint16_t local_port;             // Local port, UDP only
+    uint32_t announced;              // Bytes announced by "+IPD,<link>,<len>" in passive receive mode
+    bool receiving;                  // A datagram is being written to the queue
+    uint32_t written;                // Bytes of it written, header included
+    ringType rx;                     // Datagrams not read yet
+    char rx_buffer[SOCKET_RX_SIZE];
+    socket_statsType stats;
+};
+
+/*Function prototypes*/
+static int8_t _link_of(int8_t link);
+static bool _valid(socket_handleType handle);
+static WiFi_res_t _start(socket_handleType handle, socket_protocol_t protocol, const char *host, uint16_t port, uint16_t local_port);
+static void _rx_put(struct socket_link *link, uint32_t position, const char *data, uint32_t length);
+static void _urc_single(const char *line, uint32_t length);
+static void _urc_link(const char *line, uint32_t length);
+static void _urc_ipd(const char *line, uint32_t length);
+static void _set_state(int8_t handle, const char *event);
+
+/*Local variables*/
+static struct socket_link links[SOCKET_LINKS];   // Links of the module, the index is the link ID
+static int8_t fetching = -1;                     // Link whose AT+CIPRECVDATA reply is expected, -1 if none
+
+
+/**
+ * @function socket_init
+ *
+ * @brief Forgets every link and registers the result codes that report them.
+ *
+ * The state of the links is unknown until they are opened or reported, a link
+ * the module kept open across a reset of the MCU is closed when it is reused.
+ *
+ * @pre Called by WiFi_urc_init().
+ */
+void socket_init(void)
+{
+    /*Prefixes of "<link>,CONNECT" and "<link>,CLOSED"*/
+    static const char *const link_prefixes[SOCKET_LINKS] = { "0,", "1,", "2,", "3,", "4," };
+
+    for (uint32_t i = 0; i < SOCKET_LINKS; i++)
+    {
+        memset(&links[i], 0, sizeof(links[i]));
+        links[i].state = SOCKET_UNKNOWN;
+        ring_init(&links[i].rx, links[i].rx_buffer, sizeof(links[i].rx_buffer));
+    }
+
+    fetching = -1;
+
+    if (WIFI_CIPMUX == 0)
+    {
+        urc_register("CONNECT", _urc_single);
+        urc_register("CLOSED", _urc_single);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < SOCKET_LINKS; i++)
+        {
+            urc_register(link_prefixes[i], _urc_link);
+        }
+    }
+
+    urc_register("+IPD,", _urc_ipd);
+}
+
+/**
+ * @function socket_open
+ *
+ * @brief Opens a link to a server, or returns the one already open to it.
+ *
+ * Links stay open side by side, so a collector and a configuration server are
+ * reached without closing one to open the other. A link already open to the
+ * same host, port and protocol is returned without a command.
+ *
+ * @param protocol: SOCKET_UDP or SOCKET_TCP.
+ * @param host: IP address or host name of the server.
+ * @param port: Remote port.
+ * @param local_port: Local port of a UDP link, 0 to let the module pick one.
+ * @retval Handle of the socket, -1 if no link is free or the module refused it, see WiFi_last_result().
+ */
+socket_handleType socket_open(socket_protocol_t protocol, const char *host, uint16_t port, uint16_t local_port)
+{
+    /*Local variables*/
+    uint32_t count = (WIFI_CIPMUX == 0) ? 1 : SOCKET_LINKS;
+    socket_handleType handle = -1;
+
+    if (strlen(host) >= SOCKET_HOST_SIZE)
+    {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        struct socket_link *link = &links[i];
+
+        if (link->state == SOCKET_OPEN && link->protocol == protocol && link->port == port && strcmp(link->host, host) == 0)
+        {
+            link->stats.reuses++;
+            return i;
+        }
+
+        if (handle < 0 && link->state != SOCKET_OPEN)
+        {
+            handle = i;
+        }
+    }
+
+    /*The single link is taken by another server, it has to go*/
+    if (handle < 0 && WIFI_CIPMUX == 0)
+    {
+        socket_close(0);
+        handle = 0;
+    }
+
+    if (handle < 0)
+    {
+#ifdef DEBUG_SYSTEM
+        LOG_WRN("No free link");
+#endif
+        return -1;
+    }
+
+    if (_start(handle, protocol, host, port, local_port) != WIFI_OK)
+    {
+        /*A link left open before the MCU restarted, close it and try once more*/
+        if (links[handle].state != SOCKET_UNKNOWN || socket_close(handle) != WIFI_OK ||
+            _start(handle, protocol, host, port, local_port) != WIFI_OK)
+        {
+#ifdef DEBUG_SYSTEM
+            LOG_ERR("Could not open the link");
+#endif
+            return -1;
+        }
+    }
+
+    return handle;
+}
+
+/**
+ * @function socket_send
+ *
+ * @brief Sends a datagram, or a segment on a TCP link, and waits for SEND OK.
+ * @param handle: The socket.
+ * @param data: The payload, binary data allowed.
+ * @param length: Length of the payload, at most 2048 bytes.
+ * @retval The result of AT+CIPSEND, as WiFi_send_link(). WIFI_FAIL if the socket is not open.
+ */
+WiFi_res_t socket_send(socket_handleType handle, const uint8_t *data, uint32_t length)
+{
+    /*Local variables*/
+    WiFi_res_t result_code;
+
+    if (!socket_is_open(handle))
+    {
+        return WIFI_FAIL;
+    }
+
+    result_code = WiFi_send_link((WIFI_CIPMUX == 0) ? -1 : handle, (const char *)data, length);
+
+    if (result_code == WIFI_OK)
+    {
+        links[handle].stats.tx_datagrams++;
+        links[handle].stats.tx_bytes += length;
+    }
+    else
+    {
+        links[handle].stats.tx_failures++;
+    }
+
+    return result_code;
+}
+
+/**
+ * @function socket_receive
+ *
+ * @brief Reads the oldest datagram received on a socket.
+ *
+ * Datagrams are queued per link as the module pushes them, so one that arrived
+ * before the call is returned at once. In passive receive mode the datagram
+ * announced by "+IPD,<link>,<len>" is fetched with AT+CIPRECVDATA first.
+ *
+ * @param handle: The socket.
+ * @param buffer: Where the payload is stored.
+ * @param size: Size of the buffer, bytes beyond it are dropped.
+ * @param length: Receives the length of the datagram, larger than size if it was truncated.
+ * @param timeout: Time to wait for a datagram in ms.
+ * @retval WIFI_OK if a datagram was read, WIFI_TIMEOUT if none arrived in time,
+ * WIFI_FAIL for an invalid handle, or the result of AT+CIPRECVDATA if it failed.
+ */
+WiFi_res_t socket_receive(socket_handleType handle, uint8_t *buffer, uint32_t size, uint32_t *length, uint32_t timeout)
+{
+    /*Local variables*/
+    struct socket_link *link;
+    char command[MAX_COMMAND_SIZE] = {0};
+    uint8_t header[RX_HEADER_SIZE];
+    uint32_t start = get_tick();
+    uint32_t datagram;
+    WiFi_res_t result_code;
+
+    if (!_valid(handle))
+    {
+        return WIFI_FAIL;
+    }
+
+    link = &links[handle];
+
+    while (ring_available(&link->rx) < RX_HEADER_SIZE)
+    {
+        if ((get_tick() - start) >= timeout)
+        {
+            return WIFI_TIMEOUT;
+        }
+
+        /*Passive receive mode: the module only announced the datagram*/
+        if (link->announced != 0)
+        {
+            if (WIFI_CIPMUX == 0)
+            {
+                snprintf(command, sizeof(command), "AT+CIPRECVDATA=%lu", (unsigned long)link->announced);
+            }
+            else
+            {
+                snprintf(command, sizeof(command), "AT+CIPRECVDATA=%d,%lu", handle, (unsigned long)link->announced);
+            }
+
+            link->announced = 0;
+
+            /*The "+CIPRECVDATA:<len>," frame does not name the link*/
+            fetching = handle;
+            result_code = send_command(command, NULL, NULL, "OK", 2000);
+            fetching = -1;
+
+            if (result_code != WIFI_OK)
+            {
+                return result_code;
+            }
+
+            continue;
+        }
+
+        at_poll();
+
+        if (ring_available(&link->rx) < RX_HEADER_SIZE)
+        {
+            __WFI();
+        }
+    }
+
+    ring_read(&link->rx, (char *)header, sizeof(header));
+    datagram = header[0] | ((uint32_t)header[1] << 8);
+
+    ring_read(&link->rx, (char *)buffer, (datagram < size) ? datagram : size);
+    if (datagram > size)
+    {
+        ring_consume(&link->rx, datagram - size);
+    }
+
+    *length = datagram;
+
+    return WIFI_OK;
+}
+
+/**
+ * @function socket_close
+ *
+ * @brief Closes a socket, datagrams still queued are dropped.
+ * @param handle: The socket.
+ * @retval The result of AT+CIPCLOSE, WIFI_FAIL for an invalid handle.
+ */
+WiFi_res_t socket_close(socket_handleType handle)
+{
+    /*Local variables*/
+    char command[MAX_COMMAND_SIZE] = {0};
+    WiFi_res_t result_code;
+
+    if (!_valid(handle))
+    {
+        return WIFI_FAIL;
+    }
+
+    if (WIFI_CIPMUX == 0)
+    {
+        snprintf(command, sizeof(command), "AT+CIPCLOSE");
+    }
+    else
+    {
+        snprintf(command, sizeof(command), "AT+CIPCLOSE=%d", handle);
+    }
+
+    result_code = send_command(command, NULL, NULL, "OK", 2000);
+    if (result_code != WIFI_OK)
+    {
+#ifdef DEBUG_SYSTEM
+        LOG_ERR("Could not close the link");
+#endif
+        return result_code;
+    }
+
+    links[handle].state = SOCKET_CLOSED;
+
+    return result_code;
+}
+
+/**
+ * @function socket_is_open
+ *
+ * @brief Tells if the module reports a socket as open.
+ */
+bool socket_is_open(socket_handleType handle)
+{
+    return _valid(handle) && links[handle].state == SOCKET_OPEN;
+}
+
+/**
+ * @function socket_stats
+ *
+ * @brief Returns the traffic counters of a link, they survive closing and reopening it.
+ * @retval NULL for an invalid handle.
+ */
+const socket_statsType *socket_stats(socket_handleType handle)
+{
+    return _valid(handle) ? &links[handle].stats : NULL;
+}
+
+/**
+ * @function socket_data_received
+ *
+ * @brief Queues the payload of a datagram on its link as it arrives.
+ *
+ * A datagram that does not fit the free space of the queue is dropped whole,
+ * the ones already queued are kept.
+ *
+ * @param chunk: Payload bytes of a frame, see at_data_register().
+ */
+void socket_data_received(const at_chunkType *chunk)
+{
+    /*Local variables*/
+    int8_t index = _link_of(chunk->link);
+    struct socket_link *link;
+    uint8_t header[RX_HEADER_SIZE];
+
+    if (index < 0)
+    {
+        return;
+    }
+
+    link = &links[index];
+
+    /*A new datagram, a partial one is abandoned*/
+    if (chunk->offset == 0)
+    {
+        link->receiving = false;
+
+        if (chunk->total + RX_HEADER_SIZE > ring_free(&link->rx) || chunk->total > 0xFFFFU)
+        {
+            link->stats.rx_dropped++;
+            return;
+        }
+
+        header[0] = (uint8_t)chunk->total;
+        header[1] = (uint8_t)(chunk->total >> 8);
+        _rx_put(link, 0, (const char *)header, sizeof(header));
+
+        link->receiving = true;
+        link->written   = RX_HEADER_SIZE;
+    }
+
+    /*The start of the datagram was dropped*/
+    if (!link->receiving || chunk->offset + RX_HEADER_SIZE != link->written)
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < chunk->view.count; i++)
+    {
+        _rx_put(link, link->written, chunk->view.spans[i].data, chunk->view.spans[i].length);
+        link->written += chunk->view.spans[i].length;
+    }
+
+    /*Publish the whole datagram at once*/
+    if (link->written == chunk->total + RX_HEADER_SIZE)
+    {
+        ring_produced(&link->rx, link->written);
+        link->receiving = false;
+        link->stats.rx_datagrams++;
+        link->stats.rx_bytes += chunk->total;
+    }
+}
+
+/**
+ * @function socket_links_lost
+ *
+ * @brief Marks every link closed, the station left the AP or the module restarted.
+ */
+void socket_links_lost(void)
+{
+    for (uint32_t i = 0; i < SOCKET_LINKS; i++)
+    {
+        links[i].state     = SOCKET_CLOSED;
+        links[i].announced = 0;
+        links[i].receiving = false;
+    }
+}
+
+/**
+ * @function _link_of
+ *
+ * @brief Maps the link ID of a frame to a link, -1 if there is none.
+ */
+static int8_t _link_of(int8_t link)
+{
+    /*Single connection mode, or the reply of AT+CIPRECVDATA*/
+    if (link < 0)
+    {
+        return (fetching >= 0) ? fetching : 0;
+    }
+
+    return (link < SOCKET_LINKS) ? link : -1;
+}
+
+/**
+ * @function _valid
+ *
+ * @brief Tells if a handle names a link of the current connection mode.
+ */
+static bool _valid(socket_handleType handle)
+{
+    return handle >= 0 && handle < ((WIFI_CIPMUX == 0) ? 1 : SOCKET_LINKS);
+}
+
+/**
+ * @function _start
+ *
+ * @brief Sends AT+CIPSTART for a link and records it as open.
+ * @retval The result of the command.
+ */
+static WiFi_res_t _start(socket_handleType handle, socket_protocol_t protocol, const char *host, uint16_t port, uint16_t local_port)
+{
+    /*Local variables*/
+    struct socket_link *link = &links[handle];
+    char command[AT_COMMAND_SIZE] = {0};
+    const char *type = (protocol == SOCKET_TCP) ? "TCP" : "UDP";
+    uint32_t length = 0;
+    WiFi_res_t result_code;
+
+    length += snprintf(&command[length], sizeof(command) - length, "AT+CIPSTART=");
+
+    if (WIFI_CIPMUX != 0)
+    {
+        length += snprintf(&command[length], sizeof(command) - length, "%d,", handle);
+    }
+
+    length += snprintf(&command[length], sizeof(command) - length, "\"%s\",\"%s\",%u", type, host, port);
+
+    if (protocol == SOCKET_UDP && local_port != 0)
+    {
+        snprintf(&command[length], sizeof(command) - length, ",%u", local_port);
+    }
+
+    result_code = send_command(command, NULL, NULL, "OK", (protocol == SOCKET_TCP) ? 5000 : 2000);
+    if (result_code != WIFI_OK)
+    {
+        return result_code;
+    }
+
+    link->state      = SOCKET_OPEN;
+    link->protocol   = protocol;
+    link->port       = port;
+    link->local_port = local_port;
+    link->announced  = 0;
+    link->receiving  = false;
+    strcpy(link->host, host);
+    link->stats.opens++;
+
+    /*Datagrams of the previous server are stale*/
+    ring_consume(&link->rx, ring_available(&link->rx));
+
+    return result_code;
+}
+
+/**
+ * @function _rx_put
+ *
+ * @brief Writes bytes ahead of the head of a receive queue without publishing them.
+ * @param position: Offset from the head.
+ */
+static void _rx_put(struct socket_link *link, uint32_t position, const char *data, uint32_t length)
+{
+    /*Local variables*/
+    uint32_t head = link->rx.head + position;
+
+    for (uint32_t i = 0; i < length; i++)
+    {
+        link->rx.buffer[(head + i) & (link->rx.size - 1)] = data[i];
+    }
+}
+
+/**
+ * @function _urc_single
+ *
+ * @brief The link of single connection mode opened ("CONNECT") or closed ("CLOSED").
+ */
+static void _urc_single(const char *line, uint32_t length)
+{
+    _set_state(0, line);
+}
+
+/**
+ * @function _urc_link
+ *
+ * @brief A link opened ("<link>,CONNECT") or closed ("<link>,CLOSED").
+ */
+static void _urc_link(const char *line, uint32_t length)
+{
+    _set_state(line[0] - '0', &line[2]);
+}
+
+/**
+ * @function _set_state
+ *
+ * @brief Applies a CONNECT or CLOSED event to a link, anything else ("CONNECT FAIL") is ignored.
+ */
+static void _set_state(int8_t handle, const char *event)
+{
+    if (strcmp(event, "CONNECT") == 0)
+    {
+        links[handle].state = SOCKET_OPEN;
+    }
+    else if (strcmp(event, "CLOSED") == 0)
+    {
+        links[handle].state     = SOCKET_CLOSED;
+        links[handle].announced = 0;
+    }
+}
+
+/**
+ * @function _urc_ipd
+ *
+ * @brief Passive receive mode: the module holds a datagram of the length announced.
+ *
+ * In active mode the "+IPD,<link>,<len>:" header is followed by the payload, the
+ * engine hands that to socket_data_received() and the line never reaches this handler.
+ */
+static void _urc_ipd(const char *line, uint32_t length)
+{
+    /*Local variables*/
+    const char *last = strrchr(line, ',');
+    int8_t index = 0;
+
+    /*"+IPD,<len>" or "+IPD,<link>,<len>"*/
+    if (last != &line[strlen("+IPD,") - 1])
+    {
+        index = _link_of(atoi(&line[strlen("+IPD,")]));
+    }
+
+    if (index >= 0)
+    {
+        links[index].announced = strtoul(last + 1, NULL, 10);
+    }
+}
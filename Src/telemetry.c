@@ -0,0 +1,229 @@
+/*
+ * telemetry.c
+ */
+
+
+#include <telemetry.h>
+#include <rtc.h>
+#include <wifi.h>
+
+
+/*Wake-ups between two uploads*/
+#define UPLOAD_WAKES    ((TELEMETRY_UPLOAD_PERIOD / TELEMETRY_SAMPLE_PERIOD) > 0 ? (TELEMETRY_UPLOAD_PERIOD / TELEMETRY_SAMPLE_PERIOD) : 1)
+/*Wake-ups between a failed upload and the first retry*/
+#define RETRY_WAKES     ((TELEMETRY_RETRY_PERIOD / TELEMETRY_SAMPLE_PERIOD) > 0 ? (TELEMETRY_RETRY_PERIOD / TELEMETRY_SAMPLE_PERIOD) : 1)
+
+/*Function prototypes*/
+static void _drop_samples(uint32_t count);
+static uint32_t _rtc_seconds(void);
+
+/*Local variables, kept in SRAM through Stop mode*/
+static uint8_t series_buffer[TELEMETRY_SERIES_SIZE];       // Samples not uploaded yet, compressed
+static series_encoderType series;                          // Time and temperature of each sample
+static uint32_t wakes = UPLOAD_WAKES;                      // Wake-ups since the last upload attempt, the first one uploads
+static uint32_t retry_wakes = 0;                           // Back-off after failed attempts, 0 after a success
+static bool attempting = false;                            // An upload was started and not acknowledged yet
+
+
+/**
+ * @function telemetry_add
+ *
+ * @brief Appends the sample of this wake-up to the batch.
+ *
+ * Each sample is compressed against the previous one as it is taken. Every
+ * sample depends on the ones before it, so when the buffer is full the new
+ * sample is dropped, the uplink has been failing for dozens of sample periods
+ * by then.
+ *
+ * @param temperature: Temperature of the board in 1/100 degrees Celsius.
+ */
+void telemetry_add(int32_t temperature)
+{
+    if (series.buffer == NULL)
+    {
+        series_init(&series, series_buffer, sizeof(series_buffer), 1);
+    }
+
+    series_append(&series, _rtc_seconds(), &temperature);
+
+    wakes++;
+}
+
+/**
+ * @function telemetry_upload_due
+ *
+ * @brief Decides if the radio has to be brought up on this wake-up.
+ *
+ * The batch goes out every TELEMETRY_UPLOAD_PERIOD, or earlier when it holds
+ * TELEMETRY_FILL_THRESHOLD bytes or its oldest sample is TELEMETRY_MAX_AGE old.
+ *
+ * A true result counts as an upload attempt. If telemetry_uploaded() is not
+ * called before the next wake-up asks again, the attempt failed, and the next
+ * one waits TELEMETRY_RETRY_PERIOD, doubled on each failure up to
+ * TELEMETRY_UPLOAD_PERIOD, whatever the fill level of the batch.
+ *
+ * @retval true if the batch has to be uploaded.
+ */
+bool telemetry_upload_due(void)
+{
+    /*Local variables*/
+    bool due;
+
+    if (attempting)
+    {
+        attempting  = false;
+        retry_wakes = (retry_wakes == 0) ? RETRY_WAKES : retry_wakes * 2;
+
+        if (retry_wakes > UPLOAD_WAKES)
+        {
+            retry_wakes = UPLOAD_WAKES;
+        }
+    }
+
+    if (retry_wakes != 0)
+    {
+        due = (wakes >= retry_wakes);
+    }
+    else
+    {
+        due = wakes >= UPLOAD_WAKES || series.length >= TELEMETRY_FILL_THRESHOLD
+           || (series.count != 0 && (_rtc_seconds() - series.first_time) >= TELEMETRY_MAX_AGE);
+    }
+
+    if (due)
+    {
+        attempting = true;
+        wakes      = 0;
+    }
+
+    return due;
+}
+
+/**
+ * @function telemetry_encode
+ *
+ * @brief Writes the batch as one datagram.
+ *
+ * { 1: MAC (6 bytes), 2: RSSI, 3: samples (bytes), 4: decimals of the temperature }
+ *
+ * The samples are the series stream of one channel, the temperature, see
+ * series.c for the format and series_next() to read it back. The keys are
+ * integers, JSON writes them as "1" to "4" and the samples in hex.
+ *
+ * @param encoder: Encoder of the datagram, started with encoder_init().
+ * @retval Number of samples in the datagram, 0 if it does not fit.
+ */
+uint32_t telemetry_encode(encoderType *encoder)
+{
+    encoder_map(encoder, 4);
+    encoder_key(encoder, 1);
+    encoder_bytes(encoder, node.mac, sizeof(node.mac));
+    encoder_key(encoder, 2);
+    encoder_integer(encoder, node.RSSI);
+    encoder_key(encoder, 3);
+    encoder_bytes(encoder, series_buffer, series.length);
+    encoder_key(encoder, 4);
+    encoder_integer(encoder, TELEMETRY_TEMPERATURE_DECIMALS);
+    encoder_end(encoder);
+
+    return encoder->overflow ? 0 : series.count;
+}
+
+/**
+ * @function telemetry_uploaded
+ *
+ * @brief Drops the samples the server acknowledged and ends the back-off.
+ *
+ * The acknowledgement may arrive on a later wake-up than the encoding, with
+ * samples added in between. Those are kept, the batch is the first `count`
+ * samples of the series.
+ *
+ * @param count: Samples in the datagram, as returned by telemetry_encode().
+ */
+void telemetry_uploaded(uint32_t count)
+{
+    if (count >= series.count)
+    {
+        series_init(&series, series_buffer, sizeof(series_buffer), 1);
+    }
+    else
+    {
+        _drop_samples(count);
+    }
+
+    attempting  = false;
+    retry_wakes = 0;
+}
+
+/**
+ * @function telemetry_count
+ *
+ * @brief Returns the number of samples waiting for an upload.
+ */
+uint32_t telemetry_count(void)
+{
+    return series.count;
+}
+
+/**
+ * @function _drop_samples
+ *
+ * @brief Removes the oldest samples of the series.
+ *
+ * Every sample is encoded against the one before it, so the samples that stay
+ * are decoded from a copy of the stream and encoded again from the first one.
+ *
+ * @param count: Number of samples to remove.
+ */
+static void _drop_samples(uint32_t count)
+{
+    /*Local variables*/
+    uint8_t sent[TELEMETRY_SERIES_SIZE];
+    series_decoderType decoder;
+    uint32_t length = series.length, index = 0, time;
+    int32_t temperature;
+
+    memcpy(sent, series_buffer, length);
+    series_decoder_init(&decoder, sent, length, 1);
+    series_init(&series, series_buffer, sizeof(series_buffer), 1);
+
+    while (series_next(&decoder, &time, &temperature) == 1)
+    {
+        if (index++ >= count)
+        {
+            series_append(&series, time, &temperature);
+        }
+    }
+}
+
+/**
+ * @function _rtc_seconds
+ *
+ * @brief Converts the RTC calendar to seconds since 2000-01-01 00:00:00.
+ */
+static uint32_t _rtc_seconds(void)
+{
+    /*Local variables*/
+    static const uint16_t month_days[12] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+    uint32_t year   = _RTC_convert_bcd2bin(_RTC_get_year());
+    uint32_t month  = _RTC_convert_bcd2bin(_RTC_get_month());
+    uint32_t date   = _RTC_convert_bcd2bin(_RTC_get_date());
+    uint32_t days;
+
+    if (month < 1 || month > 12)
+    {
+        month = 1;
+    }
+
+    /*2000 is a leap year, so is every fourth year up to 2099*/
+    days = year * 365 + (year + 3) / 4 + month_days[month - 1] + date - 1;
+    if (month > 2 && (year % 4) == 0)
+    {
+        days++;
+    }
+
+    return days * 86400U
+         + _RTC_convert_bcd2bin(_RTC_get_hour()) * 3600U
+         + _RTC_convert_bcd2bin(_RTC_get_minute()) * 60U
+         + _RTC_convert_bcd2bin(_RTC_get_second());
+}
@@ -0,0 +1,116 @@
+/*
+ * temperature.c
+ */
+
+
+#include <temperature.h>
+#include <timebase.h>
+
+
+/*Factory calibration of the internal temperature sensor and reference, measured at VDDA = 3.0 V*/
+#define VREFINT_CAL         (*(const uint16_t *)0x1FF80078U)   // VREFINT at 30 C
+#define TS_CAL1             (*(const uint16_t *)0x1FF8007AU)   // Temperature sensor at 30 C
+#define TS_CAL2             (*(const uint16_t *)0x1FF8007EU)   // Temperature sensor at 130 C
+
+/*Function prototypes*/
+static bool _adc_wait(uint32_t flag);
+
+
+/**
+ * @function temperature_read
+ *
+ * @brief Measures the internal temperature sensor of the MCU.
+ *
+ * VREFINT and the sensor are converted in one sequence. The sensor reading is scaled
+ * to VDDA = 3.0 V with VREFINT and its factory calibration, then interpolated between
+ * the 30 C and 130 C calibration points. The channel selection, sampling time and
+ * mode that adc1_init() set are restored afterwards.
+ *
+ * @param temperature: The temperature in 1/100 C, TELEMETRY_TEMPERATURE_DECIMALS.
+ * @retval false if the ADC did not complete a conversion, temperature is left unchanged.
+ */
+bool temperature_read(int32_t *temperature)
+{
+    /*Local variables*/
+    uint32_t chselr = ADC1->CHSELR, smpr = ADC1->SMPR, cfgr1 = ADC1->CFGR1;
+    uint32_t vrefint = 0, sensor = 0;
+    bool converted = false;
+
+    /*Sensor and reference on, both need 10 us to settle*/
+    ADC->CCR |= ADC_CCR_TSEN | ADC_CCR_VREFEN;
+    delay_ms(1);
+
+    /*A continuous conversion of adc1_init() would keep the configuration locked*/
+    if (ADC1->CR & ADC_CR_ADSTART)
+    {
+        ADC1->CR |= ADC_CR_ADSTP;
+        while (ADC1->CR & ADC_CR_ADSTP);
+    }
+
+    if (!(ADC1->CR & ADC_CR_ADEN))
+    {
+        ADC1->ISR = ADC_ISR_ADRDY;
+        ADC1->CR |= ADC_CR_ADEN;
+    }
+
+    if (_adc_wait(ADC_ISR_ADRDY))
+    {
+        /*Single conversion of channel 17 (VREFINT) then channel 18 (sensor), longest sampling time*/
+        ADC1->CFGR1 &= ~(ADC_CFGR1_CONT | ADC_CFGR1_SCANDIR | ADC_CFGR1_DISCEN);
+        ADC1->CHSELR = ADC_CHSELR_CHSEL17 | ADC_CHSELR_CHSEL18;
+        ADC1->SMPR   = ADC_SMPR_SMP;
+        ADC1->ISR    = ADC_ISR_EOC | ADC_ISR_EOS | ADC_ISR_OVR;
+        ADC1->CR    |= ADC_CR_ADSTART;
+
+        if (_adc_wait(ADC_ISR_EOC))
+        {
+            vrefint = ADC1->DR;
+
+            if (_adc_wait(ADC_ISR_EOC))
+            {
+                sensor    = ADC1->DR;
+                converted = (vrefint != 0);
+            }
+        }
+
+        ADC1->CHSELR = chselr;
+        ADC1->SMPR   = smpr;
+        ADC1->CFGR1  = cfgr1;
+    }
+
+    ADC->CCR &= ~(ADC_CCR_TSEN | ADC_CCR_VREFEN);
+
+    if (!converted)
+    {
+        return false;
+    }
+
+    /*Reading of the sensor as it would be at VDDA = 3.0 V*/
+    sensor = (sensor * VREFINT_CAL) / vrefint;
+
+    *temperature = 3000 + ((int32_t)sensor - (int32_t)TS_CAL1) * 10000 / ((int32_t)TS_CAL2 - (int32_t)TS_CAL1);
+
+    return true;
+}
+
+/**
+ * @function _adc_wait
+ *
+ * @brief Waits for a flag of the ADC, at most TEMPERATURE_ADC_TIMEOUT ms.
+ * @retval false if the flag was not set in time.
+ */
+static bool _adc_wait(uint32_t flag)
+{
+    /*Local variables*/
+    uint32_t start = get_tick();
+
+    while (!(ADC1->ISR & flag))
+    {
+        if (get_tick() - start > TEMPERATURE_ADC_TIMEOUT)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -10,11 +10,50 @@
 
 
 #include "uart.h"
+#include "timebase.h"
+
+
+/*BRR of USART1 needs at least 16 kernel clocks per bit with oversampling by 16*/
+#if (USART1_CLOCK / BAUDRATE) < 16
+#error "BAUDRATE is too high for the HSI16 kernel clock of USART1"
+#endif
+
+/*Transmit queue of a USART: the application produces, the TXE interrupt consumes*/
+struct uart_tx_queue
+{
+	USART_TypeDef *usart;          // Peripheral that drains the queue
+	ringType ring;                 // Queued bytes
+	void (*tx_complete)(void);     // Called once the queue has drained
+};
+
+typedef struct uart_tx_queue uart_tx_queueType;
+
+/*Local function prototypes (HELPER FUNCTIONS)*/
+static void uart_tx_write(uart_tx_queueType *queue, const char *data, uint32_t length);
+static void uart_tx_irq(uart_tx_queueType *queue);
+static int uart_tx_flush(uart_tx_queueType *queue, uint32_t timeout);
+
+
+/*Global variables*/
+volatile char uart_receive_buffer[SIZE_OF_INCOMING_DATA];  // Storage written by DMA1 channel 3
+ringType uart_receive_ring;                                  // Receive interrupts produce, AT layer consumes
+
+/*Local variables*/
+static uint32_t dma_last_position = 0;    // DMA write position seen by the previous update
+static uint32_t burst_length = 0;         // Bytes received in the burst still in progress
+static volatile uint32_t burst_ready = 0; // Byte count of the last burst closed by IDLE
+static volatile bool burst_active = false; // A start bit woke the MCU, IDLE has not closed the burst yet
+
+static volatile char usart1_tx_buffer[SIZE_OF_OUTGOING_DATA];
+static volatile char usart2_tx_buffer[SIZE_OF_CONSOLE_DATA];
+
+static uart_tx_queueType usart1_tx = { USART1, { usart1_tx_buffer, SIZE_OF_OUTGOING_DATA, 0, 0, 0 }, NULL };
+static uart_tx_queueType usart2_tx = { USART2, { usart2_tx_buffer, SIZE_OF_CONSOLE_DATA, 0, 0, 0 }, NULL };
 
 /**
  * PA2->TX, PA3->RX Both AF4
  */
-void uart2Init(void)
+void uart2_init(void)
 {
 	int usart_div = 0;
 
@@ -61,13 +100,339 @@ void uart2Init(void)
 	/*Enable peripheral*/
 	USART2->CR1 |= USART_CR1_UE;
 
+	/*Resume draining anything queued before the peripheral was disabled*/
+	if (ring_fill(&usart2_tx.ring) != 0)
+	{
+		USART2->CR1 |= USART_CR1_TXEIE;
+	}
+
+	/*Enable USART2 interrupt in NVIC*/
+	NVIC_EnableIRQ(USART2_IRQn);
+
+}
+
+/**
+ * PA9->TX, PA10->RX Both AF4
+ */
+void uart1_init(void)
+{
+	int usart_div = 0;
+
+	/*Enable clock access to GPIO port A*/
+	RCC->IOPENR |= RCC_IOPENR_GPIOAEN;
+
+	/****** PIN CONFIGURATION ******/
+
+	/*Set TX pin as alternate function mode*/
+	GPIOA->MODER |= GPIO_MODER_MODE9_1;
+	GPIOA->MODER &= ~GPIO_MODER_MODE9_0;
+
+	/*Define Alternate function type*/
+	MODIFY_REG(GPIOA->AFR[1], GPIO_AFRH_AFSEL9, (0x04 << GPIO_AFRH_AFSEL9_Pos));
+
+	/*Set RX pin as alternate function mode*/
+	GPIOA->MODER |= GPIO_MODER_MODE10_1;
+	GPIOA->MODER &= ~GPIO_MODER_MODE10_0;
+
+	/*Define alternate function type*/
+	MODIFY_REG(GPIOA->AFR[1], GPIO_AFRH_AFSEL10, (0x04 << GPIO_AFRH_AFSEL10_Pos));
+
+	/****** PERIPHERAL CONFIGURATION ******/
+
+	/*Enable clock access to USART1 and DMA1 peripherals*/
+	RCC->APB2ENR |= RCC_APB2ENR_USART1EN;
+	RCC->AHBENR |= RCC_AHBENR_DMA1EN;
+
+	/*Disable peripheral while it is being configured*/
+	USART1->CR1 &= ~USART_CR1_UE;
+
+	/*Clock USART1 from HSI16, so it keeps receiving in Stop mode*/
+	SET_BIT(RCC->CR, RCC_CR_HSION);
+	while (!READ_BIT(RCC->CR, RCC_CR_HSIRDY)) {}
+	MODIFY_REG(RCC->CCIPR, RCC_CCIPR_USART1SEL, RCC_CCIPR_USART1SEL_1);
+
+	/*Define word length*/
+	USART1->CR1 &= ~(USART_CR1_M0 | USART_CR1_M1);
+
+	/*Set oversampling by 16*/
+	USART1->CR1 &= ~USART_CR1_OVER8;
+
+	/*Set the baudrate, from the HSI16 kernel clock whatever the system clock is*/
+	usart_div = USART1_CLOCK / BAUDRATE;
+	USART1->BRR = usart_div;
+
+	/*Set one stop bit*/
+	MODIFY_REG(USART1->CR2, USART_CR2_STOP, (0x00 << USART_CR2_STOP_Pos));
+
+	/****** DMA CONFIGURATION ******/
+
+	/*Stop the channel and clear its pending flags*/
+	DMA1_Channel3->CCR &= ~DMA_CCR_EN;
+	DMA1->IFCR = DMA_IFCR_CGIF3;
+
+	/*Route USART1_RX request to channel 3*/
+	MODIFY_REG(DMA1_CSELR->CSELR, DMA_CSELR_C3S, (USART1_RX_DMA_REQUEST << DMA_CSELR_C3S_Pos));
+
+	/*Peripheral to memory, 8-bit both sides, memory increment, circular mode*/
+	DMA1_Channel3->CPAR = (uint32_t)&USART1->RDR;
+	DMA1_Channel3->CMAR = (uint32_t)uart_receive_buffer;
+	DMA1_Channel3->CNDTR = SIZE_OF_INCOMING_DATA;
+	DMA1_Channel3->CCR = DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_PL_0 | DMA_CCR_HTIE | DMA_CCR_TCIE;
+
+	/*Reset the receive ring*/
+	ring_init(&uart_receive_ring, uart_receive_buffer, SIZE_OF_INCOMING_DATA);
+	dma_last_position = 0;
+	burst_length = 0;
+	burst_ready = 0;
+	burst_active = false;
+
+	/*Start the channel*/
+	DMA1_Channel3->CCR |= DMA_CCR_EN;
+
+	/*Let the receiver feed the DMA instead of raising RXNE*/
+	USART1->CR3 |= USART_CR3_DMAR;
+
+	/*Raise an interrupt once the line stays idle after a burst, and on an overrun or a
+	  framing or noise error, which would otherwise stop the DMA requests unnoticed*/
+	USART1->ICR = USART_ICR_IDLECF | USART_ICR_ORECF | USART_ICR_FECF | USART_ICR_NCF;
+	USART1->CR1 |= USART_CR1_IDLEIE;
+	USART1->CR3 |= USART_CR3_EIE;
+
+	/*Wake the MCU from Stop mode on the start bit of unsolicited result codes*/
+	MODIFY_REG(USART1->CR3, USART_CR3_WUS, USART_CR3_WUS_1);
+	USART1->CR3 |= USART_CR3_WUFIE;
+	USART1->CR1 |= USART_CR1_UESM;
+	EXTI->IMR |= EXTI_IMR_IM25;
+
+	/*Enable transmiter and receiver*/
+	USART1->CR1 |= USART_CR1_TE | USART_CR1_RE;
+
+	/*Enable peripheral*/
+	USART1->CR1 |= USART_CR1_UE;
+
+	/*Resume draining anything queued before the peripheral was disabled*/
+	if (ring_fill(&usart1_tx.ring) != 0)
+	{
+		USART1->CR1 |= USART_CR1_TXEIE;
+	}
+
+	/*Enable USART1 and DMA1 channel 3 interrupts in NVIC*/
+	NVIC_EnableIRQ(USART1_IRQn);
+	NVIC_EnableIRQ(DMA1_Channel2_3_IRQn);
 }
 
 void uart_transmit_byte(uint8_t data)
 {
-	/*Write data to TDR register*/
-	USART2->TDR = (data & 0xFF);
+	uart_tx_write(&usart2_tx, (const char *)&data, 1);
+}
+
+void uart1_transmit(const char *data, uint32_t length)
+{
+	uart_tx_write(&usart1_tx, data, length);
+}
+
+int uart1_flush(uint32_t timeout)
+{
+	return uart_tx_flush(&usart1_tx, timeout);
+}
+
+int uart2_flush(uint32_t timeout)
+{
+	return uart_tx_flush(&usart2_tx, timeout);
+}
+
+void uart1_set_tx_callback(void (*callback)(void))
+{
+	usart1_tx.tx_complete = callback;
+}
 
-	/*Wait until the transmition is completed successfully*/
-	while (!(USART2->ISR & USART_ISR_TC)) {}
+void uart2_set_tx_callback(void (*callback)(void))
+{
+	usart2_tx.tx_complete = callback;
+}
+
+void uart1_tx_irq(void)
+{
+	uart_tx_irq(&usart1_tx);
+}
+
+void uart2_tx_irq(void)
+{
+	uart_tx_irq(&usart2_tx);
+}
+
+/**
+ * @function uart_tx_write
+ *
+ * @brief Helper function to copy data into a transmit queue and start the interrupt.
+ * @note Blocks only while the queue is full, so the call costs copy time instead
+ * of wire time as long as the queue keeps up.
+ * @param queue: Transmit queue of the USART.
+ * @param data: Bytes to transmit.
+ * @param length: Number of bytes to transmit.
+ * @retval None.
+ */
+static void uart_tx_write(uart_tx_queueType *queue, const char *data, uint32_t length)
+{
+	uint32_t written;
+
+	while (length != 0)
+	{
+		/*Queue as much as fits, the interrupt frees the rest of the space*/
+		written = ring_write(&queue->ring, data, length);
+		data += written;
+		length -= written;
+
+		/*Make sure the transmitter is being fed (CR1 is also written by the interrupt)*/
+		__disable_irq();
+		queue->usart->CR1 |= USART_CR1_TXEIE;
+		__enable_irq();
+	}
+}
+
+/**
+ * @function uart_tx_irq
+ *
+ * @brief Helper function to move the next queued byte into TDR. Once the queue is
+ * empty it waits for TC and reports the completion through the callback.
+ * @param queue: Transmit queue of the USART.
+ * @retval None.
+ */
+static void uart_tx_irq(uart_tx_queueType *queue)
+{
+	USART_TypeDef *usart = queue->usart;
+
+	if (READ_BIT(usart->CR1, USART_CR1_TXEIE) && READ_BIT(usart->ISR, USART_ISR_TXE))
+	{
+		if (ring_available(&queue->ring) != 0)
+		{
+			/*Write next byte to TDR register*/
+			usart->TDR = ring_at(&queue->ring, 0) & 0xFF;
+			ring_consume(&queue->ring, 1);
+		}
+		else
+		{
+			/*Queue drained, wait for the last byte to leave the shift register*/
+			usart->CR1 &= ~USART_CR1_TXEIE;
+			usart->CR1 |= USART_CR1_TCIE;
+		}
+	}
+
+	if (READ_BIT(usart->CR1, USART_CR1_TCIE) && READ_BIT(usart->ISR, USART_ISR_TC))
+	{
+		usart->CR1 &= ~USART_CR1_TCIE;
+
+		/*Report the completion if nothing new was queued meanwhile*/
+		if (ring_fill(&queue->ring) == 0 && queue->tx_complete != NULL)
+		{
+			queue->tx_complete();
+		}
+	}
+}
+
+/**
+ * @function uart_tx_flush
+ *
+ * @brief Helper function to wait until a transmit queue is drained.
+ * @param queue: Transmit queue of the USART.
+ * @param timeout: Maximum time to wait in ms.
+ * @retval 0 when flushed, -1 if the deadline expired first.
+ */
+static int uart_tx_flush(uart_tx_queueType *queue, uint32_t timeout)
+{
+	uint32_t start_time = get_tick();
+
+	/*Wait until every byte is written and the transmitter is idle*/
+	while ((ring_fill(&queue->ring) != 0) || READ_BIT(queue->usart->CR1, USART_CR1_TXEIE) || !READ_BIT(queue->usart->ISR, USART_ISR_TC))
+	{
+		if ((get_tick() - start_time) >= timeout)
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @function uart1_rx_update
+ *
+ * @brief Converts the DMA write position into the monotonic head index.
+ * @note Must be called at least twice per ring lap; the half and full transfer
+ * interrupts guarantee that even when the line never goes idle.
+ * @retval None.
+ */
+void uart1_rx_update(void)
+{
+	uint32_t position = SIZE_OF_INCOMING_DATA - DMA1_Channel3->CNDTR;
+	uint32_t received = (position - dma_last_position) & (SIZE_OF_INCOMING_DATA - 1);
+
+	dma_last_position = position;
+	burst_length += received;
+
+	/*Publish the new bytes to the consumer*/
+	ring_produced(&uart_receive_ring, received);
+}
+
+/**
+ * @function uart1_rx_idle
+ *
+ * @brief Closes the burst in progress so the AT layer wakes up once per chunk.
+ * @retval None.
+ */
+void uart1_rx_idle(void)
+{
+	uart1_rx_update();
+
+	if (burst_length != 0)
+	{
+		burst_ready = burst_length;
+		burst_length = 0;
+	}
+
+	burst_active = false;
+}
+
+/**
+ * @function uart1_rx_burst
+ *
+ * @brief Returns the size of the last burst closed by the IDLE interrupt.
+ * @retval Byte count of the burst, 0 if no new burst completed.
+ */
+uint32_t uart1_rx_burst(void)
+{
+	uint32_t length;
+
+	/*Disable global interrupts*/
+	__disable_irq();
+
+	length = burst_ready;
+	burst_ready = 0;
+
+	/*Enable global interrupts*/
+	__enable_irq();
+
+	return length;
+}
+
+/**
+ * @function uart1_rx_wakeup
+ *
+ * @brief Marks a burst as started, the IDLE interrupt ends it.
+ * @retval None.
+ */
+void uart1_rx_wakeup(void)
+{
+	burst_active = true;
+}
+
+/**
+ * @function uart1_rx_active
+ *
+ * @brief Tells whether the burst that woke the MCU from Stop mode is still arriving.
+ * @retval true until the IDLE interrupt closed the burst.
+ */
+bool uart1_rx_active(void)
+{
+	return burst_active;
 }
@@ -0,0 +1,71 @@
+/*
+ * urc.c
+ */
+
+
+#include <urc.h>
+
+
+/*Registered handler of an unsolicited result code*/
+struct urc_entry
+{
+    const char *prefix;           // Start of the line that selects the handler
+    uint8_t length;               // Length of the prefix
+    urc_handlerType handler;      // Called with the complete line
+};
+
+typedef struct urc_entry urc_entryType;
+
+/*Local variables*/
+static urc_entryType urc_table[URC_MAX_HANDLERS];   // Registered handlers
+static uint32_t urc_count = 0;                       // Number of registered handlers
+
+
+/**
+ * @function urc_register
+ *
+ * @brief Registers a handler for the lines that start with a prefix.
+ *
+ * Handlers run in the context of at_poll(), as soon as a complete line has been
+ * received, whether a command is in flight or not.
+ *
+ * @param prefix: Start of the line, e.g. "WIFI GOT IP". Must outlive the registration.
+ * @param handler: Function called with the complete line.
+ * @retval 0 on success, -1 if the table is full.
+ */
+int urc_register(const char *prefix, urc_handlerType handler)
+{
+    if (urc_count >= URC_MAX_HANDLERS)
+    {
+        return -1;
+    }
+
+    urc_table[urc_count].prefix  = prefix;
+    urc_table[urc_count].length  = strlen(prefix);
+    urc_table[urc_count].handler = handler;
+    urc_count++;
+
+    return 0;
+}
+
+/**
+ * @function urc_dispatch
+ *
+ * @brief Calls the handler whose prefix starts the line.
+ * @param line: NUL terminated line without \r\n.
+ * @param length: Length of the line.
+ * @retval true if a handler took the line.
+ */
+bool urc_dispatch(const char *line, uint32_t length)
+{
+    for (uint32_t i = 0; i < urc_count; i++)
+    {
+        if (length >= urc_table[i].length && memcmp(line, urc_table[i].prefix, urc_table[i].length) == 0)
+        {
+            urc_table[i].handler(line, length);
+            return true;
+        }
+    }
+
+    return false;
+}
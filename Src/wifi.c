@@ -10,108 +10,440 @@
 
 
 #include <wifi.h>
+#include <at_engine.h>
+#include <urc.h>
+#include <at_script.h>
+#include <at_parse.h>
+#include <modem_cache.h>
+#include <eeprom.h>
+#include <socket.h>
+#include <mqtt.h>
 #include <ctype.h>
 
 
+struct wifi_lease_record;
+struct station_address;
+
 /*Function prototypes*/
 static uint32_t _extract_month(char *month);
+static void _command_completed(at_handleType handle, const at_responseType *response, void *context);
+static void _urc_wifi_connected(const char *line, uint32_t length);
+static void _urc_wifi_got_ip(const char *line, uint32_t length);
+static void _urc_wifi_disconnect(const char *line, uint32_t length);
+static void _urc_time_updated(const char *line, uint32_t length);
+static void _urc_ready(const char *line, uint32_t length);
+static void _data_received(const at_chunkType *chunk, void *context);
+static void _idle(uint32_t duration);
+static WiFi_res_t _connect(void);
+static WiFi_res_t _join(void);
+static WiFi_res_t _set_address(const struct wifi_lease_record *address);
+static WiFi_res_t _query_address(struct station_address *address);
+static void _address_received(at_handleType handle, const at_responseType *response, void *context);
+static WiFi_res_t _send_payload(const char *command, const char *exp_end, const char *exp_fail, const char *payload, uint32_t length, uint32_t delay, uint8_t flags);
+static bool _skip_when_joined(void *context);
+static bool _skip_when_send_mode_known(void *context);
+static void _choose_send_mode(void);
+static void _resync(void);
+static bool _skip_when_sysstore_cached(void *context);
+static bool _skip_when_mux_set(void *context);
+static bool _skip_when_mux_cached(void *context);
+static bool _skip_when_recvtype_cached(void *context);
+static bool _restore_ip(void);
+static void _cache_ip(uint32_t ip);
+static bool _parse_ip(const char *text, uint32_t *ip);
+static bool _parse_bytes(const char *text, uint8_t *bytes, uint32_t count, char separator, uint32_t base);
 
 /*Global variables*/
 nucleoType node;     // Variable which contains details about nucleo information.
-int mux_mode;        // Variable that checks the UDP receive mode.
+
+/*Local variables*/
+static WiFi_resultType last_result;      // Details of the last command outcome
+static bool streaming = false;           // The module is in passthrough mode, every byte sent is socket data
+static uint8_t send_flags = AT_FLAG_PROMPT;   // AT_FLAG_PROMPT unless AT+GMR showed that the firmware takes the payload early
+static bool send_mode_known = (WIFI_EARLY_PAYLOAD_VERSION == 0xFFFF);  // send_flags is decided, by AT+GMR once per MCU reset
+static uint8_t early_rejects = 0;             // Early payloads rejected in a row
+static uint32_t stream_interval = WIFI_STREAM_INTERVAL;  // Packing interval of the module in passthrough mode in ms
+static socket_handleType server_socket = -1;  // Link of WiFi_open_connection, -1 when closed
+static WiFi_join_statsType join_stats;         // Joins per path, kept in SRAM through Stop mode
+
+/*Turns the value of a macro into a string literal*/
+#define _TEXT(value)    #value
+#define TEXT(value)     _TEXT(value)
+
+/*Active receive mode, in multiple connection mode the command takes a link ID, SOCKET_LINKS for all links*/
+#if WIFI_CIPMUX
+#define RECVTYPE_ACTIVE "AT+CIPRECVTYPE=" TEXT(SOCKET_LINKS) ",0"
+#else
+#define RECVTYPE_ACTIVE "AT+CIPRECVTYPE=0"
+#endif
+
+/*Response data lines, parsed by at_parse() straight into these structs*/
+struct int_reply
+{
+    int32_t value;              // "+CIPMUX:1", "+SLEEP:0"
+};
+
+/*Global variables*/
+struct int_reply mux_mode;   // Variable that checks the UDP receive mode.
+
+struct sntp_time
+{
+    char day[4];                // "+CIPSNTPTIME:Thu Aug 04 14:48:05 2021"
+    char month[4];
+    int32_t date;
+    int32_t hour;
+    int32_t minute;
+    int32_t second;
+    int32_t year;
+};
+
+struct link_status
+{
+    int32_t link_id;            // "+CIPSTATUS:0,"UDP","192.168.1.10",8080,8080,0"
+    char type[6];
+    char remote_ip[16];
+    int32_t remote_port;
+    int32_t local_port;
+    int32_t tetype;
+};
+
+struct ap_info
+{
+    char ssid[33];              // "+CWJAP:"ssid","aa:bb:cc:dd:ee:ff",6,-60,..."
+    char bssid[18];
+    int32_t channel;
+    int32_t rssi;
+};
+
+struct station_address
+{
+    char ip[16];                // "+CIPSTA:ip:"192.168.1.7""
+    char gateway[16];           // "+CIPSTA:gateway:"192.168.1.1""
+    char netmask[16];           // "+CIPSTA:netmask:"255.255.255.0""
+};
+
+struct firmware_version
+{
+    int32_t major;              // "AT version:2.2.0.0(c6fa6bf - ESP32 - Jul  2 2021 06:44:05)"
+    int32_t minor;
+};
+
+struct station_state
+{
+    int32_t state;              // "+CWSTATE:2,"ssid""
+    char ssid[33];
+};
+
+static const at_fieldType int_reply_fields[]    = { AT_INT(struct int_reply, value, ',') };
+static const at_fieldType sntp_time_fields[]    = { AT_STRING(struct sntp_time, day, ' '), AT_STRING(struct sntp_time, month, ' '),
+                                                    AT_INT(struct sntp_time, date, ' '), AT_INT(struct sntp_time, hour, ':'),
+                                                    AT_INT(struct sntp_time, minute, ':'), AT_INT(struct sntp_time, second, ' '),
+                                                    AT_INT(struct sntp_time, year, '\0') };
+static const at_fieldType link_status_fields[]  = { AT_INT(struct link_status, link_id, ','), AT_QUOTED(struct link_status, type, ','),
+                                                    AT_QUOTED(struct link_status, remote_ip, ','), AT_INT(struct link_status, remote_port, ','),
+                                                    AT_INT(struct link_status, local_port, ','), AT_INT(struct link_status, tetype, '\0') };
+static const at_fieldType ap_info_fields[]      = { AT_QUOTED(struct ap_info, ssid, ','), AT_QUOTED(struct ap_info, bssid, ','),
+                                                    AT_INT(struct ap_info, channel, ','), AT_INT(struct ap_info, rssi, ',') };
+static const at_fieldType station_fields[]      = { AT_INT(struct station_state, state, ','), AT_QUOTED(struct station_state, ssid, '\0') };
+static const at_fieldType station_ip_fields[]   = { AT_QUOTED(struct station_address, ip, '\0') };
+static const at_fieldType station_gw_fields[]   = { AT_QUOTED(struct station_address, gateway, '\0') };
+static const at_fieldType station_mask_fields[] = { AT_QUOTED(struct station_address, netmask, '\0') };
+static const at_fieldType version_fields[]      = { AT_INT(struct firmware_version, major, '.'), AT_INT(struct firmware_version, minor, '.') };
+static const at_fieldType mac_fields[]          = { AT_STRING(nucleoType, IMEI_num, '\0') };   // Kept with its quotes, sent as a JSON string
+
+static const at_schemaType cipmux_schema        = AT_SCHEMA("+CIPMUX:", int_reply_fields);
+static const at_schemaType sleep_schema         = AT_SCHEMA("+SLEEP:", int_reply_fields);
+static const at_schemaType sntp_time_schema     = AT_SCHEMA("+CIPSNTPTIME:", sntp_time_fields);
+static const at_schemaType link_status_schema   = AT_SCHEMA("+CIPSTATUS:", link_status_fields);
+static const at_schemaType ap_info_schema       = AT_SCHEMA("+CWJAP:", ap_info_fields);
+static const at_schemaType station_schema       = AT_SCHEMA("+CWSTATE:", station_fields);
+static const at_schemaType station_ip_schema    = AT_SCHEMA("+CIPSTA:ip:", station_ip_fields);
+static const at_schemaType station_gw_schema    = AT_SCHEMA("+CIPSTA:gateway:", station_gw_fields);
+static const at_schemaType station_mask_schema  = AT_SCHEMA("+CIPSTA:netmask:", station_mask_fields);
+static const at_schemaType version_schema       = AT_SCHEMA("AT version:", version_fields);
+static const at_schemaType mac_schema           = AT_SCHEMA("+CIPAPMAC:", mac_fields);
+
+/*Access point of the last full scan join, kept in the data EEPROM at WIFI_AP_EEPROM_OFFSET*/
+struct wifi_ap_record
+{
+    uint16_t magic;             // WIFI_AP_MAGIC once written
+    uint8_t channel;            // Channel the AP was found on
+    uint8_t reserved;
+    uint8_t bssid[6];           // MAC address of the AP
+    uint8_t padding[2];         // The EEPROM is written in words
+};
+
+/*Address of the station, the last DHCP lease is kept in the data EEPROM at WIFI_LEASE_EEPROM_OFFSET*/
+struct wifi_lease_record
+{
+    uint16_t magic;             // WIFI_LEASE_MAGIC once written
+    uint8_t reserved[2];
+    uint32_t ip;                // Packed as WIFI_IP()
+    uint32_t gateway;
+    uint32_t netmask;
+};
+
+/*Version of the module firmware, read once per MCU reset*/
+static struct firmware_version firmware;
+
+/*State of WiFi_init shared with the checks and parsers of its script*/
+struct wifi_init_context
+{
+    bool joined;                // The module was connected before the script started
+};
+
+/**
+ * @brief Steps of WiFi_init that precede the join, executed by at_script_run.
+ */
+static const at_stepType wifi_setup_steps[] =
+{
+    // Command                                  Terminator  Schema            Out          Skip                        Timeout  On fail           Retries  Flags
+    { "AT",                                    "OK",       NULL,             NULL,        NULL,                       1000,    AT_FAIL_CONTINUE, 0,       0                   },  // Check that the module is accessible
+    { "AT+GMR",                                "OK",       &version_schema,  &firmware,   _skip_when_send_mode_known, 1000,    AT_FAIL_CONTINUE, 0,       AT_STEP_INDEPENDENT },  // Firmware version, it decides how AT+CIPSEND takes its payload
+    { "AT+SYSSTORE=0",                         "OK",       NULL,             NULL,        _skip_when_sysstore_cached, 1000,    AT_FAIL_ABORT,    0,       AT_STEP_INDEPENDENT },  // Keep the settings in RAM, no flash write per join
+    { "AT+CWINIT=1",                           "OK",       NULL,             NULL,        _skip_when_joined,          1000,    AT_FAIL_ABORT,    0,       AT_STEP_INDEPENDENT },  // Initialize WiFi driver
+    { "AT+CWMODE=1",                           "OK",       NULL,             NULL,        _skip_when_joined,          1000,    AT_FAIL_ABORT,    0,       AT_STEP_INDEPENDENT }   // Station mode
+};
+
+static const at_scriptType wifi_setup_script =
+{
+    "WiFi setup",
+    wifi_setup_steps,
+    sizeof(wifi_setup_steps) / sizeof(wifi_setup_steps[0]),
+    WIFI_INIT_SCRIPT_FLAGS
+};
+
+/**
+ * @brief Steps of WiFi_init that follow the join, executed by at_script_run.
+ */
+static const at_stepType wifi_init_steps[] =
+{
+    // Command                                  Terminator  Schema            Out          Skip                        Timeout  On fail           Retries  Flags
+    { "AT+CWRECONNCFG=1,100",                  "OK",       NULL,             NULL,        _skip_when_joined,          1000,    AT_FAIL_RETRY,    1,       0                   },  // Reconnect every second, 100 times
+    { "AT+CIPMUX?",                            "OK",       &cipmux_schema,   &mux_mode,   _skip_when_mux_cached,      1000,    AT_FAIL_ABORT,    0,       AT_STEP_INDEPENDENT },  // Check connection mode
+    { "AT+CIPMUX=" TEXT(WIFI_CIPMUX),          "OK",       NULL,             NULL,        _skip_when_mux_set,         1000,    AT_FAIL_ABORT,    0,       0                   },  // Multiple connections, or single for passthrough
+    { RECVTYPE_ACTIVE,                         "OK",       NULL,             NULL,        _skip_when_recvtype_cached, 2000,    AT_FAIL_ABORT,    0,       0                   }   // Enable active receiving mode, data arrives as +IPD
+};
+
+static const at_scriptType wifi_init_script =
+{
+    "WiFi init",
+    wifi_init_steps,
+    sizeof(wifi_init_steps) / sizeof(wifi_init_steps[0]),
+    WIFI_INIT_SCRIPT_FLAGS
+};
+
+/*Streaming consumer of the socket data, set by WiFi_receive_stream*/
+struct wifi_receiver
+{
+    WiFi_chunkType handler;         // NULL if the data is queued on its link
+    void *context;                  // Passed back to the handler
+};
+
+static struct wifi_receiver receiver = { NULL, NULL };
+
+/*State shared between send_command and its completion callback*/
+struct command_wait
+{
+    bool done;                      // The engine completed the command
+    const at_schemaType *schema;    // Layout of the data to parse
+    void *out;                      // Destination of the parsed data
+    WiFi_resultType result;         // Outcome of the command
+};
+
+static WiFi_res_t _send_command(const char *command, const at_schemaType *schema, void *out, const char *exp_end, uint32_t delay, uint8_t flags);
+static WiFi_res_t _wait_command(struct command_wait *wait);
 
 
 /**
  * @function send_command
  *
- * @brief Sends a command to ESP32 and waits for the appropriate response. It saves
- * the response to the specified receive buffer for manipulation.
- * @note: In case you need to save data from the ESP32 response use variadic veriables and specify into the exp_parse the way
- * to retrieve data from the response.
+ * @brief Sends a command to ESP32 and waits for the appropriate response.
+ * @note: In case you need to save data from the ESP32 response pass the schema of its data line
+ * and the struct the schema describes, see at_parse().
+ * @note: This is the blocking form of at_submit(): the core sleeps (WFI) between UART events
+ * while the engine waits for the response.
  * @command: The command to be transmitted to the ESP32 device.
- * @exp: Looks to that expression in response buffer.
- * @exp_parse: Delimeters to parse the data, like "%d" for int, "%s" for string, "%c" for char and etc.
- * @num_of_exp: The number of parameters passed as variadic.
+ * @schema: Layout of the data line of the response, NULL if there is nothing to parse.
+ * @out: Struct that receives the parsed fields.
+ * @exp_end: Expected end of the response.
  * @delay: Total time to wait.
- * @retval OK on success, FAIL on failure.
+ * @retval WIFI_OK on success. WIFI_ERROR, WIFI_FAIL, WIFI_SEND_FAIL or WIFI_BUSY as soon as the
+ * module answers with that final result code, WIFI_TIMEOUT if nothing conclusive arrived in time.
  */
-WiFi_res_t send_command(const char *command, const char *exp, const char *exp_parse, const char *exp_end, uint32_t num_of_exp, uint32_t delay, ...)
+WiFi_res_t send_command(const char *command, const at_schemaType *schema, void *out, const char *exp_end, uint32_t delay)
 {
-    /* Variable declaration */
-    char response_buffer[SIZE_OF_INCOMING_DATA];  // Buffer to store the response from ESP32
-    char command_to_send[strlen(command) + 3];    // Buffer to store the formatted command to send, including newline characters
-    int response = WIFI_OK - 100;                 // Variable to hold the response status
-    uint32_t start_time = get_tick();             // Stores the start time of the command execution
+    return _send_command(command, schema, out, exp_end, delay, 0);
+}
 
-    /* Clear buffers */
-    memset(response_buffer, 0, sizeof(response_buffer)); // Clear the response buffer
-    memset(uart_receive_buffer, 0, sizeof(uart_receive_buffer)); // Clear the UART receive buffer
-    memset(command_to_send, 0, sizeof(command_to_send)); // Clear the command buffer
-    uart_receive_index = 0; // Reset UART receive index
 
-    /* Format and send the command */
-    snprintf(command_to_send, sizeof(command_to_send), "%s\r\n", command); // Format the command with newline
-    uart1_transmit(command_to_send, strlen(command_to_send)); // Transmit the command via UART
+/**
+ * @function _send_command
+ *
+ * @brief Sends a command with engine flags and waits for its terminator.
+ * @retval The final result of the command, as send_command.
+ */
+static WiFi_res_t _send_command(const char *command, const at_schemaType *schema, void *out, const char *exp_end, uint32_t delay, uint8_t flags)
+{
+    /* Variable declaration */
+    struct command_wait wait = { false, schema, out, { WIFI_FAIL, 0, 0 } };
+    at_handleType handle = -1;
 
-#ifdef DEBUG_SYSTEM
-    printf("%c>>>>", '\n'); // Start of debug output
-    printf(" Command:");
-    printf(" %s%c%c", command, '\r', '\n'); // Print the command being sent
-#endif
+    /* In passthrough mode the command would reach the server as data */
+    if (streaming)
+    {
+        last_result = wait.result;
+        return WIFI_FAIL;
+    }
 
-    /* Wait for the response from the device */
-    while (response < 0)
+    /* The engine copies the command together with \r\n */
+    if (strlen(command) + 2 >= AT_COMMAND_SIZE)
     {
-        /* Check for timeout */
-        if ((get_tick() - start_time) >= delay)
-        {
-#ifdef DEBUG_SYSTEM
-            LOG_WRN("Timeout occurred"); // Log a warning if a timeout occurs
-#endif
-            response = WIFI_TIMEOUT; // Set response status to timeout
-            break;
-        }
+        last_result = wait.result;
+        return WIFI_FAIL;
+    }
 
-        /* Check if the expected end of response is received */
-        if (strstr(uart_receive_buffer, exp_end))
-        {
-            strncpy(response_buffer, uart_receive_buffer, sizeof(response_buffer) - 1); // Copy response to buffer
-            response = WIFI_OK; // Set response status to success
+    /* Queue the command, waiting for a free slot if asynchronous users filled the queue */
+    while ((handle = at_submit(command, exp_end, delay, flags, _command_completed, &wait)) < 0)
+    {
+        at_poll();
+        __WFI();
+    }
 
-            /* Parse the response data if needed */
-            if (exp != NULL && exp_parse != NULL)
-            {
-                char *exp_start = strstr(response_buffer, exp); // Find the start of the expected data
-                if (exp_start != NULL)
-                {
-                    exp_start += strlen(exp);  // Move past the expected string
+    return _wait_command(&wait); // Return the final response status
+}
+
+
+/**
+ * @function send_payload
+ *
+ * @brief Sends a command that takes binary data after its ">" prompt, e.g. AT+MQTTPUBRAW.
+ *
+ * The payload is transmitted once the module prompts for it, exactly as given,
+ * and the command completes on exp_end as send_command() does.
+ *
+ * @param command: The command, without \r\n.
+ * @param payload: The data, binary data allowed.
+ * @param length: Length of the data, the one announced in the command.
+ * @param exp_end: Expected end of the response, after the data.
+ * @param exp_fail: Failure result of this command, e.g. "+MQTTPUB:FAIL", NULL if none.
+ * @param delay: Time allowed for the response in ms.
+ * @retval The final result of the command, as send_command.
+ */
+WiFi_res_t send_payload(const char *command, const char *payload, uint32_t length, const char *exp_end, const char *exp_fail, uint32_t delay)
+{
+    return _send_payload(command, exp_end, exp_fail, payload, length, delay, AT_FLAG_PROMPT);
+}
 
-                    va_list args;
-                    va_start(args, delay);
 
-                    /* Use vsscanf to read the variadic arguments */
-                    vsscanf(exp_start, exp_parse, args);
+/**
+ * @function _send_payload
+ *
+ * @brief Sends a command with its payload and waits for its terminator.
+ * @retval The final result of the command, as send_command.
+ */
+static WiFi_res_t _send_payload(const char *command, const char *exp_end, const char *exp_fail, const char *payload, uint32_t length, uint32_t delay, uint8_t flags)
+{
+    /* Variable declaration */
+    struct command_wait wait = { false, NULL, NULL, { WIFI_FAIL, 0, 0 } };
 
-                    va_end(args);
-                }
-            }
+    if (streaming)
+    {
+        last_result = wait.result;
+        return WIFI_FAIL;
+    }
 
-            break;
-        }
+    while (at_submit_data(command, exp_end, exp_fail, payload, length, delay, flags, _command_completed, &wait) < 0)
+    {
+        at_poll();
+        __WFI();
     }
 
-    /* Print the response if available */
-    if (response_buffer[0] != '\0')
+    return _wait_command(&wait);
+}
+
+
+/**
+ * @function _wait_command
+ *
+ * @brief Runs the engine until a submitted command completes, sleeps between UART events.
+ * @retval The final result of the command.
+ */
+static WiFi_res_t _wait_command(struct command_wait *wait)
+{
+    while (!wait->done)
     {
-        printf("%s\r\n", response_buffer); // Print the response buffer
+        at_poll();
+
+        if (!wait->done)
+        {
+            __WFI();
+        }
     }
 
-#ifdef DEBUG_SYSTEM
-    printf("<<<<");
-    printf("%c%c%c%c", RETURN, NEWLINE, RETURN, NEWLINE);
-#endif
+    /* Keep the details for callers that need more than the result code */
+    last_result = wait->result;
+
+    return wait->result.code;
+}
+
+
+/**
+ * @function WiFi_urc_init
+ *
+ * @brief Registers the handlers of the unsolicited result codes of the ESP32.
+ *
+ * The handlers keep `node.connection_status` and the state of every link up to
+ * date as the module reports changes, so they no longer have to be queried with
+ * `AT+CWSTATE?` and `AT+CIPSTATUS` on every cycle.
+ *
+ * @pre Call once, after uart1_init() and before any command is sent.
+ */
+void WiFi_urc_init(void)
+{
+    node.status_valid  = false;
+    node.time_synced   = false;
+
+    urc_register("WIFI CONNECTED", _urc_wifi_connected);
+    urc_register("WIFI GOT IP", _urc_wifi_got_ip);
+    urc_register("WIFI DISCONNECT", _urc_wifi_disconnect);
+    urc_register("+TIME_UPDATED", _urc_time_updated);
+    urc_register("ready", _urc_ready);
+
+    /*Link events and passive receive announcements*/
+    socket_init();
+
+    /*Socket data is framed by the engine and never parsed as text*/
+    at_data_register(_data_received, NULL);
+}
+
+
+/**
+ * @function WiFi_join_stats
+ *
+ * @brief Returns how many joins took the fast and the full scan path, and how long they took.
+ * @return Pointer to the counters, kept in SRAM through Stop mode.
+ */
+const WiFi_join_statsType *WiFi_join_stats(void)
+{
+    return &join_stats;
+}
 
-    return response; // Return the final response status
+
+/**
+ * @function WiFi_last_result
+ *
+ * @brief Returns the details of the last command sent to the ESP32.
+ *
+ * Besides the result code it carries the ESP-AT error code that precedes an
+ * ERROR reply ("ERR CODE:0x01090000") and the time the command took, so the
+ * caller can tell a rejected command from a busy module or a timeout.
+ *
+ * @return Pointer to the result of the last send_command call.
+ */
+const WiFi_resultType *WiFi_last_result(void)
+{
+    return &last_result;
 }
 
 
@@ -124,7 +456,7 @@ WiFi_res_t send_command(const char *command, const char *exp, const char *exp_pa
  * - Checks if the module is connected to a network.
  * - If not connected, initializes the WiFi driver, sets the WiFi mode to station mode,
  *   connects to the specified router, and configures reconnection settings.
- * - Configures the module for single connection mode.
+ * - Configures the connection mode, multiple links unless WIFI_CIPMUX selects a single one.
  * - Queries and retrieves the IP address assigned to the WiFi module.
  *
  * @return
@@ -132,13 +464,26 @@ WiFi_res_t send_command(const char *command, const char *exp, const char *exp_pa
  * - A non-zero error code if any command fails or if the initialization process encounters an issue.
  *
  * @details
- * - The function first checks the current connection status. If not connected, it initializes the WiFi driver
- *   with the `AT+CWINIT` command, sets the module to station mode with the `AT+CWMODE` command, and attempts
- *   to connect to the router using `AT+CWJAP`.
- * - It then sets the reconnection configuration to attempt reconnection at one-second intervals for up to 100 times.
- * - After ensuring a connection, the function configures the module for single connection mode using `AT+CIPMUX=0`.
- * - Finally, it queries and retrieves the IP address assigned to the module using the `AT+CIPSTA?` command.
- * - Debug information including the board’s IP address is printed if debugging is enabled.
+ * - The sequence is the `wifi_setup_steps` script, the join and the `wifi_init_steps` script,
+ *   executed by at_script_run(): each command is transmitted the moment the previous terminator
+ *   arrives, and with `WIFI_INIT_SCRIPT_FLAGS` set to `AT_SCRIPT_PIPELINE` the independent ones
+ *   do not even wait for it.
+ * - `AT+SYSSTORE=0` keeps the settings of the module in RAM, so no join writes its flash. It is
+ *   sent once per restart of the module.
+ * - `AT+GMR` is sent until its version decided how WiFi_send_link() hands over its payload,
+ *   see _choose_send_mode().
+ * - The join steps (`AT+CWINIT`, `AT+CWMODE`, `AT+CWJAP`, `AT+CWRECONNCFG`) are skipped if the
+ *   module was already connected when the function was called.
+ * - The join looks for the AP of the previous join first, by its BSSID, and falls back to a
+ *   full scan, see _join().
+ * - `AT+CIPMUX=<WIFI_CIPMUX>` is only sent if `AT+CIPMUX?` reported the other mode.
+ * - Before the join the address is set as `WIFI_ADDRESSING` selects: by DHCP, static, or the
+ *   last DHCP lease with a fallback to DHCP, see _connect().
+ * - `AT+CIPRECVTYPE` sets active receive mode for every link, its form follows `WIFI_CIPMUX`.
+ * - `AT+CIPMUX?`, `AT+CIPRECVTYPE` and `AT+CIPSTA?` are skipped while the modem cache in the RTC
+ *   backup registers still holds their outcome, see modem_cache.c. `AT+CIPSTA?` is also skipped
+ *   when the join set a known address. In sticky mode its reply is kept as the next lease.
+ * - The latency of the script is printed if debugging is enabled, next to the board's IP address.
  *
  * @pre Ensure that the WiFi module is powered on and ready to accept AT commands before calling this function.
  *
@@ -150,88 +495,76 @@ WiFi_res_t send_command(const char *command, const char *exp, const char *exp_pa
 WiFi_res_t WiFi_init()
 {
     /*Local variable declaration*/
-    char command[50] = {0};
+    struct wifi_init_context init = { node.connection_status == CONNECTED };
+    const uint8_t mux_mode_set = WIFI_CIPMUX, active_mode = 0;
+    struct station_address address = {0};
+    struct wifi_lease_record lease = { WIFI_LEASE_MAGIC, {0}, 0, 0, 0 };
+    at_script_reportType report;
+    WiFi_res_t result_code;
+
+    result_code = at_script_run(&wifi_setup_script, &init, &report);
+
+    /*Keep the details for callers that need more than the result code*/
+    last_result = report.result;
 
-    /*Check if the WiFi device is accessible*/
-    result_code = WiFi_check();
     if (result_code != WIFI_OK)
     {
-#ifdef DEBUG_SYSTEM
-        LOG_WRN("WiFi module isn't accessible");
-#endif
+        return result_code;
     }
 
-    /*Check the connection status*/
-    if (node.connection_status != CONNECTED)
-    {
-        /*Initialize WiFi driver*/
-        snprintf(command, sizeof(command), "AT+CWINIT=1");
-        result_code = send_command(command, NULL, NULL, "OK", 0, 1000);
-        if (result_code != WIFI_OK)
-        {
-             return result_code;
-        }
-
-        /*Set the wifi mode to station mode*/
-        snprintf(command, sizeof(command), "AT+CWMODE=1");
-        result_code = send_command(command, NULL, NULL, "OK", 0, 1000);
-        if (result_code != WIFI_OK)
-        {
-            return result_code;
-        }
+    /*Settings stay in RAM until the module restarts*/
+    modem_cache_put(FACT_SYSSTORE, NULL);
 
-        /*Connect to the local router*/
-        snprintf(command, sizeof(command), "AT+CWJAP=\"%s\",\"%s\"", SSID, PSWD);
-        result_code = send_command(command, NULL, NULL, "OK", 0, 5000);
-        if (result_code != WIFI_OK)
-        {
-            return result_code;
-        }
+    _choose_send_mode();
 
-        /*The ESP32 station tries to reconnect to AP at the interval of one second for 100 times*/
-        snprintf(command, sizeof(command), "AT+CWRECONNCFG=1,100");
-        result_code = send_command(command, NULL, NULL, "OK", 0, 1000);
+    if (!init.joined)
+    {
+        result_code = _connect();
         if (result_code != WIFI_OK)
         {
             return result_code;
         }
     }
 
-    /*Check connection mode*/
-    result_code = send_command("AT+CIPMUX?", "+CIPMUX:", "%d", "OK", 1, 1000, &mux_mode);
+    result_code = at_script_run(&wifi_init_script, &init, &report);
+
+    last_result = report.result;
+
     if (result_code != WIFI_OK)
     {
         return result_code;
     }
 
-    if (mux_mode)
+    /*The module is now in the configured connection mode and active receive mode, remember it*/
+    modem_cache_put(FACT_MUX, &mux_mode_set);
+    modem_cache_put(FACT_RECVTYPE, &active_mode);
+
+    /*The address is asked only if neither the cache nor the join set it*/
+    if (!_restore_ip())
     {
-        /*Change to single connection*/
-        result_code = send_command("AT+CIPMUX=0", "OK", NULL, "OK", 0, 1000);
+        result_code = _query_address(&address);
         if (result_code != WIFI_OK)
         {
             return result_code;
         }
-    }
 
-    /*Enable active receiving mode*/
-    result_code = send_command("AT+CIPRECVTYPE=1", "OK", NULL, "OK", 0, 2000);
-    if (result_code != 0)
-    {
-        return -1;
-    }
+        if (!_parse_ip(address.ip, &lease.ip))
+        {
+            return WIFI_FAIL;
+        }
 
-    /*Query the IP Address of an ESP32 Station*/
-    snprintf(command, sizeof(command), "AT+CIPSTA?");
-    result_code = send_command(command, "+CIPSTA:ip:", "%s", "OK", 1, 1000, node.board_ip);
-    if (result_code != WIFI_OK)
-    {
-        return result_code;
+        _cache_ip(lease.ip);
+
+        /*Next time the lease is set as a static address, unchanged words are not written again*/
+        if (WIFI_ADDRESSING == WIFI_ADDRESS_STICKY && _parse_ip(address.gateway, &lease.gateway) && _parse_ip(address.netmask, &lease.netmask))
+        {
+            eeprom_write(WIFI_LEASE_EEPROM_OFFSET, &lease, sizeof(lease));
+        }
     }
 
 #ifdef DEBUG_SYSTEM
     LOG_INF("BOARDS IP ADDRESS...");
-    printf("%s", node.board_ip);
+    printf("%u.%u.%u.%u", WIFI_IP_OCTETS(node.board_ip));
     printf("%c%c%c%c", RETURN, NEWLINE, RETURN, NEWLINE);
 #endif
 
@@ -274,12 +607,11 @@ WiFi_res_t WiFi_ntp_init(rtcType time)
     /*Local variable declaration*/
     WiFi_res_t result_code = -1;
     char command[50] = {0};
-    char month[4]={0},date[4]={0};
-    int num, hour, min, sec, year;
+    struct sntp_time now = {0};
 
     /*Set the desired time zone and the server to which we will connect to*/
     snprintf(command, sizeof(command), "AT+CIPSNTPCFG=1,2,\"2.gr.pool.ntp.org\"");
-    result_code = send_command(command, "+TIME_UPDATED", NULL, "OK", 0, 1000);
+    result_code = send_command(command, NULL, NULL, "OK", 1000);
 
     /*Check the result code*/
     if (result_code != 0)
@@ -289,7 +621,7 @@ WiFi_res_t WiFi_ntp_init(rtcType time)
 
     /*Read time from NTP server to update the RTC clock*/
     snprintf(command, sizeof(command), "AT+CIPSNTPTIME?");
-    result_code = send_command(command, "+CIPSNTPTIME:", "%s %s %d %d:%d:%d %d", "OK", 7, 2000, date, month, &num, &hour, &min, &sec, &year);
+    result_code = send_command(command, &sntp_time_schema, &now, "OK", 2000);
 
     /*Check the result code*/
     if (result_code != 0)
@@ -298,13 +630,13 @@ WiFi_res_t WiFi_ntp_init(rtcType time)
     }
 
     /*Update RTC parameters*/
-    time.hour   = _RTC_convert_bin2bcd(hour);
-    time.minute = _RTC_convert_bin2bcd(min);
-    time.second = _RTC_convert_bin2bcd(sec);
-    time.day    = _RTC_convert_bin2bcd(num);
-    time.month  = _RTC_convert_bin2bcd((_extract_month(month)-1));
+    time.hour   = _RTC_convert_bin2bcd(now.hour);
+    time.minute = _RTC_convert_bin2bcd(now.minute);
+    time.second = _RTC_convert_bin2bcd(now.second);
+    time.day    = _RTC_convert_bin2bcd(now.date);
+    time.month  = _RTC_convert_bin2bcd((_extract_month(now.month)-1));
     time.week   = 0x02;
-    time.year   = _RTC_convert_bin2bcd(year-2000);
+    time.year   = _RTC_convert_bin2bcd(now.year-2000);
 
     /*Update RTC*/
     rtc_init(time);
@@ -319,112 +651,95 @@ WiFi_res_t WiFi_ntp_init(rtcType time)
  *
  * @brief Opens a UDP connection to a specified server IP and port.
  *
- * This function checks the current UDP connection status and, if no connection is present,
- * initiates a new UDP connection to the specified server IP address and port number.
+ * This function opens the socket that WiFi_send_data(), WiFi_receive_data() and
+ * WiFi_close_connection() work on. Other servers can be reached at the same time
+ * through their own sockets, see socket_open().
  *
  * @param server_ip The IP address of the server to connect to.
- * @param port_number The port number on the server to connect to.
+ * @param port_number The port number on the server to connect to, also used as the local port.
  *
  * @return
- * - `WIFI_OK` (0) if the connection is successfully opened.
- * - A non-zero error code if the connection could not be established or if there was an issue checking the UDP status.
+ * - `WIFI_OK` (0) if the connection is open.
+ * - A non-zero error code if the connection could not be established.
  *
  * @details
- * - The function first checks the status of existing UDP connections using the `AT+CIPSTATUS` command.
- * - If no active UDP connection is found (indicated by `link_id` not being 4), it attempts to open a new UDP connection
- *   using the `AT+CIPSTART` command with the provided `server_ip` and `port_number`.
- * - The status of the connection attempt is logged, and appropriate warnings or errors are generated based on the result.
+ * - If the link state is known from the `<link>,CONNECT`/`<link>,CLOSED` unsolicited result codes
+ *   and the link to the server is still open, no command is sent. The link table lives in SRAM,
+ *   so a link left open before Stop mode is found again after the wake-up.
+ * - Otherwise a free link is opened with `AT+CIPSTART=<link>,"UDP",...`.
+ * - A link still open to a previous server or port is closed once the new one is open.
  *
  * @pre Ensure that the WiFi module is initialized and ready to accept AT commands.
- *
- * @post The function attempts to open a UDP connection and updates the connection status accordingly.
- *
- * @warning The function assumes that the WiFi module correctly responds to the AT commands and handles responses in a timely manner.
  */
 WiFi_res_t WiFi_open_connection(const char * server_ip, int port_number)
 {
     /*Local variable declaration*/
-    WiFi_res_t result_code = -1;
-    int link_id, remote_port, local_port, tetype;
-    char type[10]={0}, remote_ip[10]={0};
-    char command[50] = {0};
+    socket_handleType handle;
 
-    /*Check the UDP connection status*/
-    snprintf(command, sizeof(command), "AT+CIPSTATUS");
-    result_code = send_command(command, "+CIPSTATUS:", "%d %s %s %d %d %d", "OK", 6, 2000, &link_id, type, remote_ip, &remote_port, &local_port, &tetype);
-
-    /*Check the result code*/
-    if (result_code != 0)
+    handle = socket_open(SOCKET_UDP, server_ip, port_number, port_number);
+    if (handle < 0)
     {
-#ifdef DEBUG_SYSTEM
-        LOG_WRN("Check the UDP command status");
-#endif
-        return result_code;
+        return (last_result.code != WIFI_OK) ? last_result.code : WIFI_FAIL;
     }
 
-    if (link_id != 4)
+    /*The server changed, the link kept for the previous one is of no use anymore*/
+    if (server_socket >= 0 && server_socket != handle && socket_is_open(server_socket))
     {
-        /*Start a UDP connection*/
-        snprintf(command, sizeof(command), "AT+CIPSTART=\"UDP\",\"%s\",%d,%d", server_ip, port_number, port_number);
-        result_code = send_command(command, "CONNECT", NULL, "OK", 0, 2000);
-        if (result_code != 0)
-        {
-#ifdef DEBUG_SYSTEM
-            LOG_ERR("Could not open the UDP connection");
-#endif
-        }
+        socket_close(server_socket);
     }
-    else if (link_id == 4)
-    {
+
+    server_socket = handle;
+
 #ifdef DEBUG_SYSTEM
+    if (socket_stats(server_socket)->reuses != 0)
+    {
         LOG_INF("Already connected to UDP server");
-#endif
     }
+#endif
 
-    return result_code;
+    return WIFI_OK;
 }
 
 
 /**
- * @function WiFi_close_connection
+ * @function WiFi_connection_socket
  *
- * @brief Closes an active UDP connection.
+ * @brief Returns the socket opened by WiFi_open_connection, for the layers built on it.
+ * @retval The socket handle, -1 while the connection is closed.
+ */
+int8_t WiFi_connection_socket(void)
+{
+    return server_socket;
+}
+
+
+/**
+ * @function WiFi_close_connection
  *
- * This function sends a command to close the current UDP connection by issuing the
- * `AT+CIPCLOSE` command. It verifies the closure of the connection based on the response.
+ * @brief Closes the connection opened by WiFi_open_connection.
  *
  * @return
  * - `WIFI_OK` (0) if the UDP connection is successfully closed.
  * - A non-zero error code if there is an issue closing the connection or if the command fails.
  *
  * @details
- * - The function constructs and sends the `AT+CIPCLOSE` command to the WiFi module.
- * - It then checks the response to confirm that the connection has been closed.
- * - An error is logged if the connection could not be closed properly.
+ * - The function sends `AT+CIPCLOSE=<link>` for the link of the server only, the other sockets stay open.
  *
  * @pre Ensure that a UDP connection is currently open before calling this function.
- *
- * @post The function attempts to close the active UDP connection and updates the connection status accordingly.
- *
- * @warning The function assumes that the WiFi module correctly responds to the `AT+CIPCLOSE` command and handles responses in a timely manner.
  */
 WiFi_res_t WiFi_close_connection()
 {
     /*Local variable declaration*/
     WiFi_res_t result_code = -1;
-    char command[50] = {0};
 
-    /*Start a UDP connection*/
-    snprintf(command, sizeof(command), "AT+CIPCLOSE");
-    result_code = send_command(command, "CLOSED", NULL, "OK", 0, 2000);
+    result_code = socket_close(server_socket);
     if (result_code != 0)
     {
-#ifdef DEBUG_SYSTEM
-        LOG_ERR("Could not close the UDP connection");
-#endif
         return result_code;
     }
 
+    server_socket = -1;
+
     return result_code;
 }
 
@@ -432,56 +747,42 @@ WiFi_res_t WiFi_close_connection()
 /**
  * @function WiFi_send_udp
  *
- * @brief Sends a JSON payload to a UDP server.
+ * @brief Sends the MAC address and the RSSI of the board to a UDP server.
  *
- * This function constructs a JSON-formatted UDP frame containing specific data and sends it to a UDP server.
- * It performs the following tasks:
- * - Creates a JSON payload with the data to be sent.
- * - Issues the `AT+CIPSEND` command to specify the length of the payload and prepare for data transmission.
- * - Sends the actual JSON payload to the UDP server.
- * - Confirms the successful transmission of the data.
+ * This function encodes { 1: MAC, 2: RSSI } with WIFI_ENCODER, CBOR by default, straight into
+ * the buffer the datagram is transmitted from, and sends it as one datagram with WiFi_send_data().
+ * The MAC address is sent as its 6 raw bytes.
  *
  * @return
- * - `WIFI_OK` (0) if the JSON payload is successfully sent to the UDP server and acknowledged.
- * - A non-zero error code if there is an issue preparing for or sending the JSON data.
- *
- * @details
- * - The function constructs a JSON string using the `snprintf` function and calculates its length.
- * - It then sends a command to the WiFi module to indicate the length of the payload and prepare for sending the data.
- * - After receiving an acknowledgment prompt from the module, the function sends the JSON payload.
- * - The function checks for successful completion of the data send operation and logs an error if the operation fails.
+ * - `WIFI_OK` (0) if the payload is successfully sent to the UDP server and acknowledged.
+ * - A non-zero error code if there is an issue preparing for or sending the data.
  *
  * @pre Ensure that the WiFi module is properly initialized and connected to the UDP server before calling this function.
- *
- * @post The function sends JSON data to the UDP server and verifies that the server acknowledges receipt.
- *
- * @warning The function assumes that the WiFi module responds correctly to the `AT+CIPSEND` and data transmission commands within the specified timeout periods.
  */
 WiFi_res_t WiFi_send_udp()
 {
     /*Local variable declaration*/
     WiFi_res_t result_code = -1;
-    char command[50] = {0};
-    char payload[100] ={0};
-    int payload_len;
+    uint8_t payload[32];
+    encoderType encoder;
 
 
-    /*Create the UDP frame (JSON)*/
-    payload_len = snprintf(payload, sizeof(payload), "{\"1\":%s, \"2\":%d}", node.IMEI_num, node.RSSI);
+    /*Create the UDP frame*/
+    encoder_init(&encoder, &WIFI_ENCODER, payload, sizeof(payload));
+    encoder_map(&encoder, 2);
+    encoder_key(&encoder, 1);
+    encoder_bytes(&encoder, node.mac, sizeof(node.mac));
+    encoder_key(&encoder, 2);
+    encoder_integer(&encoder, node.RSSI);
+    encoder_end(&encoder);
 
-    /*Send JSON data to the UDP server*/
-    snprintf(command, sizeof(command), "AT+CIPSEND=%d", payload_len+2);
-    result_code = send_command(command, "OK", NULL, ">", 0, 2000);
-    if (result_code != 0)
+    if (encoder.overflow)
     {
-#ifdef DEBUG_SYSTEM
-        LOG_ERR("Could not send JSON data");
-#endif
-        return result_code;
+        return WIFI_FAIL;
     }
 
-    /*Send the actual data to the server*/
-    result_code = send_command(payload, "SEND OK", NULL, "SEND OK", 0, 2000);
+    /*Send the frame to the UDP server*/
+    result_code = WiFi_send_data((const char *)payload, encoder.length);
     if (result_code != 0)
     {
 #ifdef DEBUG_SYSTEM
@@ -495,41 +796,85 @@ WiFi_res_t WiFi_send_udp()
 
 
 /**
- * @function WiFi_receive_data
+ * @function WiFi_send_data
+ *
+ * @brief Sends a datagram on the link opened by WiFi_open_connection, see WiFi_send_link().
+ *
+ * @param payload The datagram, binary data allowed.
+ * @param length Length of the datagram, at most 2048 bytes.
+ *
+ * @return The result of WiFi_send_link(), `WIFI_FAIL` if the connection is not open.
+ */
+WiFi_res_t WiFi_send_data(const char *payload, uint32_t length)
+{
+    return socket_send(server_socket, (const uint8_t *)payload, length);
+}
+
+
+/**
+ * @function WiFi_send_link
  *
- * @brief Receives data from the Wi-Fi socket.
+ * @brief Sends a datagram on a link in a single round trip.
  *
- * This function first checks the length of the available socket data
- * using the "AT+CIPRECVLEN?" command. It then retrieves the data using
- * the "AT+CIPRECVDATA" command and stores it in the provided response buffer.
+ * `AT+CIPSEND=<len>` and the payload are written back to back, the module takes
+ * the payload from its UART buffer once it prints its `>` prompt and the command
+ * completes on `SEND OK`. The payload is sent exactly as given, no \r\n is added.
  *
- * @param response Pointer to the buffer where the received data will be stored.
- *                 The buffer should be large enough to hold the incoming data.
+ * Firmware older than WIFI_EARLY_PAYLOAD_VERSION, or firmware whose version
+ * WiFi_init() could not read, gets the payload only after its prompt. A rejected
+ * early payload may leave the module reading it as commands, so the UART is
+ * resynchronised with _resync() and the error is returned to the caller, which
+ * decides whether to send again. After WIFI_EARLY_PAYLOAD_REJECTS rejections in
+ * a row the payload waits for the prompt until the MCU resets.
  *
- * @return WiFi_res_t
- * - On success: returns 0 (success code).
- * - On failure: returns -1 error code.
+ * @param link Link ID in multiple connection mode, -1 in single connection mode.
+ * @param payload The datagram, binary data allowed.
+ * @param length Length of the datagram, at most 2048 bytes.
+ *
+ * @return
+ * - `WIFI_OK` (0) once the module reported `SEND OK`.
+ * - `WIFI_SEND_FAIL` if the module could not transmit it, another result code if the command failed.
  */
-WiFi_res_t WiFi_receive_data(char * response)
+WiFi_res_t WiFi_send_link(int8_t link, const char *payload, uint32_t length)
 {
     /*Local variable declaration*/
-    WiFi_res_t result_code = -1;
+    WiFi_res_t result_code;
     char command[50] = {0};
-    int payload_len = -1;
 
-    /*Obtain Socket Data Length*/
-    result_code = send_command("AT+CIPRECVLEN?", "+CIPRECVLEN:", "%d", "OK", 1, 2000, &payload_len);
-    if (result_code != 0)
+    if (link < 0)
     {
-        return result_code;
+        snprintf(command, sizeof(command), "AT+CIPSEND=%lu", (unsigned long)length);
+    }
+    else
+    {
+        snprintf(command, sizeof(command), "AT+CIPSEND=%d,%lu", link, (unsigned long)length);
     }
 
-    /*Obtain socket data*/
-    snprintf(command, sizeof(command), "AT+CIPRECVDATA=%d", payload_len);
-    result_code = send_command(command, "+CIPRECVDATA:", "%d,%[^\n]*[\n]", "OK", 2, 2000, &payload_len, response);
-    if (result_code != 0)
+    result_code = _send_payload(command, "SEND OK", NULL, payload, length, 2000, send_flags);
+
+    /*The payload may have been read as commands, wait for the module to answer again*/
+    if (!(send_flags & AT_FLAG_PROMPT) && (result_code == WIFI_ERROR || result_code == WIFI_BUSY))
     {
-        return result_code;
+        WiFi_resultType rejected = last_result;
+
+#ifdef DEBUG_SYSTEM
+        LOG_WRN("Payload before the prompt rejected, resynchronising");
+#endif
+        _resync();
+        last_result = rejected;
+
+        /*The firmware does not take the payload early after all*/
+        if (++early_rejects >= WIFI_EARLY_PAYLOAD_REJECTS)
+        {
+#ifdef DEBUG_SYSTEM
+            LOG_WRN("Waiting for the prompt from now on");
+#endif
+            send_flags |= AT_FLAG_PROMPT;
+        }
+    }
+    else if (result_code == WIFI_OK)
+    {
+        early_rejects = 0;
     }
 
     return result_code;
@@ -537,40 +882,225 @@ WiFi_res_t WiFi_receive_data(char * response)
 
 
 /**
- * @function WiFi_power_down
- *
- * @brief Puts the WiFi device into light-sleep mode.
- *
- * This function sends a command to the WiFi module to enter light-sleep mode, which is a low-power state
- * designed to reduce power consumption while keeping the device in a ready state.
- *
- * @return
- * - `WIFI_OK` (0) if the device successfully enters light-sleep mode.
- * - A non-zero error code if there is an issue setting the device to sleep mode or if the command fails.
+ * @function WiFi_stream_start
  *
- * @details
- * - The function constructs and sends the `AT+SLEEP=2` command to the WiFi module to initiate light-sleep mode.
- * - It waits for the response to confirm that the command was successfully executed.
- * - An error is logged if the device could not be set to sleep mode.
+ * @brief Enters passthrough (transparent) mode on the open UDP link.
  *
- * @pre Ensure that the WiFi module is properly initialized and ready to accept AT commands.
+ * Instead of an `AT+CIPSEND=<len>`, a wait for the `>` prompt and a wait for
+ * `SEND OK` per datagram, the MCU writes its frames continuously with
+ * WiFi_stream_write() and the module packs them into datagrams every `interval`
+ * ms, or whenever 2048 bytes have accumulated.
  *
- * @post The function attempts to set the device to light-sleep mode, reducing power consumption.
+ * @param interval Packing interval in ms, 0 to keep the module's current one (20 ms by default).
  *
- * @warning The function assumes that the WiFi module correctly responds to the `AT+SLEEP=2` command and handles responses in a timely manner.
+ * @return
+ * - `WIFI_OK` (0) once the module waits for data.
+ * - `WIFI_FAIL` (1) at once when the firmware is built with WIFI_CIPMUX 1, the default.
+ * - The result of the command that failed otherwise, the module is back in normal mode.
+ *
+ * @pre The UDP link is open in single connection mode, which needs a build with
+ *      WIFI_CIPMUX 0, and has a fixed remote host.
+ * @note While streaming, send_command() refuses to send and the received data only
+ *       reaches the handler set with WiFi_receive_stream().
  */
-WiFi_res_t WiFi_power_down()
+WiFi_res_t WiFi_stream_start(uint32_t interval)
 {
     /*Local variable declaration*/
-    WiFi_res_t result_code = -1;
+    WiFi_res_t result_code;
     char command[50] = {0};
 
-    /*Set the device to light-sleep mode.*/
-    snprintf(command, sizeof(command), "AT+SLEEP=1");
-    result_code = send_command(command, "OK", NULL, "OK", 0, 2000);
-    if (result_code != 0)
+    if (streaming)
     {
-#ifdef DEBUG_SYSTEM
+        return WIFI_OK;
+    }
+
+    /*The module only streams on the link of single connection mode*/
+    if (WIFI_CIPMUX != 0)
+    {
+#ifdef DEBUG_SYSTEM
+        LOG_WRN("Passthrough needs WIFI_CIPMUX 0");
+#endif
+        return WIFI_FAIL;
+    }
+
+    result_code = send_command("AT+CIPMODE=1", NULL, NULL, "OK", 1000);
+    if (result_code != WIFI_OK)
+    {
+        return result_code;
+    }
+
+    if (interval != 0)
+    {
+        snprintf(command, sizeof(command), "AT+TRANSINTVL=%lu", (unsigned long)interval);
+        result_code = send_command(command, NULL, NULL, "OK", 1000);
+        if (result_code != WIFI_OK)
+        {
+            send_command("AT+CIPMODE=0", NULL, NULL, "OK", 1000);
+            return result_code;
+        }
+
+        stream_interval = interval;
+    }
+
+    result_code = send_command("AT+CIPSEND", NULL, NULL, ">", 2000);
+    if (result_code != WIFI_OK)
+    {
+        send_command("AT+CIPMODE=0", NULL, NULL, "OK", 1000);
+        return result_code;
+    }
+
+    /*From now on every byte in either direction is socket data*/
+    at_passthrough(true);
+    streaming = true;
+
+    return WIFI_OK;
+}
+
+
+/**
+ * @function WiFi_stream_write
+ *
+ * @brief Writes a frame to the UDP link in passthrough mode.
+ *
+ * The frame is queued for the UART and the function returns, there is no
+ * handshake. Frames written within one packing interval may share a datagram,
+ * so the server has to be able to split them.
+ *
+ * @param data The frame.
+ * @param length Length of the frame.
+ *
+ * @return `WIFI_OK` (0), `WIFI_FAIL` if the module is not in passthrough mode.
+ */
+WiFi_res_t WiFi_stream_write(const uint8_t *data, uint32_t length)
+{
+    if (!streaming)
+    {
+        return WIFI_FAIL;
+    }
+
+    uart1_transmit((const char *)data, length);
+
+    /*Keep the receive path moving*/
+    at_poll();
+
+    return WIFI_OK;
+}
+
+
+/**
+ * @function WiFi_stream_stop
+ *
+ * @brief Leaves passthrough mode and returns the module to normal transmission.
+ *
+ * "+++" only ends the mode when the module receives it as a packet of its own, so
+ * the UART stays silent for a packing interval plus WIFI_STREAM_GUARD_TIME before
+ * it, and the module is given WIFI_STREAM_EXIT_TIME after it before the next
+ * command. Frames written earlier are all sent.
+ *
+ * @return The result of `AT+CIPMODE=0`.
+ */
+WiFi_res_t WiFi_stream_stop(void)
+{
+    if (!streaming)
+    {
+        return WIFI_OK;
+    }
+
+    /*The silence starts once the last frame has left the UART*/
+    uart1_flush(1000);
+    _idle(stream_interval + WIFI_STREAM_GUARD_TIME);
+
+    uart1_transmit("+++", strlen("+++"));
+    uart1_flush(1000);
+    _idle(WIFI_STREAM_EXIT_TIME);
+
+    at_passthrough(false);
+    streaming = false;
+
+    return send_command("AT+CIPMODE=0", NULL, NULL, "OK", 1000);
+}
+
+
+/**
+ * @function WiFi_receive_data
+ *
+ * @brief Receives a datagram on the link opened by WiFi_open_connection.
+ *
+ * In active receive mode the module pushes every datagram as "+IPD,<link>,<len>:<payload>",
+ * so it is delivered without any command. Exactly <len> bytes are read from the
+ * byte stream, binary data and newlines included, and queued on the link, see
+ * socket_receive(). A datagram that arrived before the call is returned at once.
+ *
+ * @param buffer Where the payload is stored.
+ * @param size Size of the buffer, bytes beyond it are dropped.
+ * @param length Receives the length of the datagram, larger than size if it was truncated.
+ * @param timeout Time to wait for the datagram in ms.
+ *
+ * @return WiFi_res_t
+ * - WIFI_OK if a datagram was received.
+ * - WIFI_TIMEOUT if none arrived in time, or the result of AT+CIPRECVDATA if it failed.
+ * - WIFI_FAIL if the connection is not open.
+ */
+WiFi_res_t WiFi_receive_data(uint8_t *buffer, uint32_t size, uint32_t *length, uint32_t timeout)
+{
+    return socket_receive(server_socket, buffer, size, length, timeout);
+}
+
+
+/**
+ * @function WiFi_receive_stream
+ *
+ * @brief Hands the socket data to a callback as it arrives, instead of buffering it.
+ *
+ * Meant for payloads larger than the RAM that can be spared for them. Each chunk
+ * is passed while it is still in the receive ring, so it is never copied. While a
+ * handler is set nothing is queued on the links.
+ *
+ * @param handler Called with every chunk from at_poll(), NULL to buffer datagrams again.
+ * @param context Passed back to the handler.
+ */
+void WiFi_receive_stream(WiFi_chunkType handler, void *context)
+{
+    receiver.handler = handler;
+    receiver.context = context;
+}
+
+
+/**
+ * @function WiFi_power_down
+ *
+ * @brief Puts the WiFi device into light-sleep mode.
+ *
+ * This function sends a command to the WiFi module to enter light-sleep mode, which is a low-power state
+ * designed to reduce power consumption while keeping the device in a ready state.
+ *
+ * @return
+ * - `WIFI_OK` (0) if the device successfully enters light-sleep mode.
+ * - A non-zero error code if there is an issue setting the device to sleep mode or if the command fails.
+ *
+ * @details
+ * - The function constructs and sends the `AT+SLEEP=2` command to the WiFi module to initiate light-sleep mode.
+ * - It waits for the response to confirm that the command was successfully executed.
+ * - An error is logged if the device could not be set to sleep mode.
+ *
+ * @pre Ensure that the WiFi module is properly initialized and ready to accept AT commands.
+ *
+ * @post The function attempts to set the device to light-sleep mode, reducing power consumption.
+ *
+ * @warning The function assumes that the WiFi module correctly responds to the `AT+SLEEP=2` command and handles responses in a timely manner.
+ */
+WiFi_res_t WiFi_power_down()
+{
+    /*Local variable declaration*/
+    WiFi_res_t result_code = -1;
+    char command[50] = {0};
+
+    /*Set the device to light-sleep mode.*/
+    snprintf(command, sizeof(command), "AT+SLEEP=1");
+    result_code = send_command(command, NULL, NULL, "OK", 2000);
+    if (result_code != 0)
+    {
+#ifdef DEBUG_SYSTEM
         LOG_ERR("Could not set the device to sleep mode");
 #endif
         return result_code;
@@ -608,7 +1138,7 @@ WiFi_res_t WiFi_check(void)
     int result_code = -1;
 
     /*Check if the WiFi extender is accessible*/
-    result_code = send_command("AT", "OK", NULL, "OK", 0, 1000);
+    result_code = send_command("AT", NULL, NULL, "OK", 1000);
 
     /*Check the result code*/
     if (result_code != WIFI_OK)
@@ -639,6 +1169,9 @@ WiFi_res_t WiFi_check(void)
  *   and stored in `node.RSSI`.
  * - If the expected response is not received or an error occurs, the function returns `WIFI_FAIL`.
  *
+ * @note The MAC address (`AT+CIPAPMAC?`) is kept in the modem cache after the first query, later calls
+ * return it without touching the UART.
+ *
  * @pre Ensure that the WiFi module is initialized and connected to a network before calling this function.
  *
  * @post The function retrieves the RSSI value and updates the `node.RSSI` field with the current signal strength.
@@ -649,10 +1182,19 @@ WiFi_res_t WiFi_get_IMEI()
 {
     /*Local variables*/
     int result_code = -1;
+    uint8_t mac[6];
 
+    /*The MAC address never changes, ask the module only once*/
+    if (modem_cache_get(FACT_MAC, mac))
+    {
+        snprintf(node.IMEI_num, sizeof(node.IMEI_num), "\"%02x:%02x:%02x:%02x:%02x:%02x\"",
+                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        memcpy(node.mac, mac, sizeof(node.mac));
+        return WIFI_OK;
+    }
 
     /*Take the IMEI number of the WiFi modem*/
-    result_code = send_command("AT+CIPAPMAC?", "+CIPAPMAC:", "%s", "OK", 1, 1000, node.IMEI_num);
+    result_code = send_command("AT+CIPAPMAC?", &mac_schema, &node, "OK", 1000);
 
     /*Check the result code*/
     if (result_code != WIFI_OK)
@@ -660,6 +1202,12 @@ WiFi_res_t WiFi_get_IMEI()
         return WIFI_FAIL;
     }
 
+    if (_parse_bytes(node.IMEI_num, mac, sizeof(mac), ':', 16))
+    {
+        modem_cache_put(FACT_MAC, mac);
+        memcpy(node.mac, mac, sizeof(node.mac));
+    }
+
     return WIFI_OK;
 }
 
@@ -694,11 +1242,10 @@ WiFi_res_t WiFi_get_RSSI()
 {
     /*Local variables*/
     int result_code = -1;
-    char ssid[20]={0}, bssid[20]={0};
-    int pci_n, channel, reconn_interval, listen_interval, scan_mode, pmf;
+    struct ap_info ap = {0};
 
     /*Take the IMEI number of the WiFi modem*/
-    result_code = send_command("AT+CWJAP?", "+CWJAP:", "\"%[^\"]\",\"%[^\"]\",%d,%d,%d,%d,%d,%d,%d", "OK", 9, 4000, ssid, bssid, &channel, &node.RSSI, &pci_n, &reconn_interval, &listen_interval, &scan_mode, &pmf);
+    result_code = send_command("AT+CWJAP?", &ap_info_schema, &ap, "OK", 4000);
 
     /*Check the result code*/
     if (result_code != WIFI_OK)
@@ -706,6 +1253,8 @@ WiFi_res_t WiFi_get_RSSI()
         return WIFI_FAIL;
     }
 
+    node.RSSI = ap.rssi;
+
     return WIFI_OK;
 }
 
@@ -728,6 +1277,9 @@ WiFi_res_t WiFi_get_RSSI()
  *
  * @post The WiFi connection status and SSID are updated in the internal variables.
  *
+ * @note Once a query succeeded, the status is maintained by the `WIFI CONNECTED`, `WIFI GOT IP`,
+ * `WIFI DISCONNECT` and `ready` unsolicited result codes and the function returns without a round trip.
+ *
  * @warning The function assumes that the WiFi module responds correctly to the `AT+CWSTATE?` command within the
  *          specified timeout period. If the response is not in the expected format, a warning is logged.
  */
@@ -735,16 +1287,28 @@ void WiFi_status(void)
 {
     /*Local variables*/
     int result_code = -1;
-    char ssid[10];
+    struct station_state station = { .state = -1 };
+
+    /*The unsolicited result codes already keep the status up to date*/
+    if (node.status_valid)
+    {
+        return;
+    }
 
     /*Take the IMEI number of the WiFi modem*/
-    result_code = send_command("AT+CWSTATE?", "+CWSTATE:", "%d,%s", "OK", 2, 2000, &node.connection_status, ssid);
-    if (result_code != 0)
+    result_code = send_command("AT+CWSTATE?", &station_schema, &station, "OK", 2000);
+    if (result_code != 0 || station.state < 0)
     {
 #ifdef DEBUG_SYSTEM
         LOG_WRN("Something went wrong while quering the WiFi connection status");
 #endif
+        return;
     }
+
+    node.connection_status = station.state;
+
+    /*From now on the unsolicited result codes track every change*/
+    node.status_valid = true;
 }
 
 /**
@@ -764,16 +1328,16 @@ int _get_wifi_state(void)
 {
     /*Local variables*/
     int result_code = -1;
-    int sleep_mode = -1;
+    struct int_reply sleep_mode = { -1 };
 
     /*Check and return the sleep mode*/
-    result_code = send_command("AT+SLEEP?", "+SLEEP:", "%d", "OK", 1, 2000, &sleep_mode);
+    result_code = send_command("AT+SLEEP?", &sleep_schema, &sleep_mode, "OK", 2000);
     if (result_code != 0)
     {
         return result_code;
     }
 
-    return sleep_mode;
+    return sleep_mode.value;
 }
 
 /**
@@ -814,3 +1378,587 @@ static uint32_t _extract_month(char *month)
      return -1;
 }
 
+/**
+ * @function _command_completed
+ *
+ * @brief Completion callback of the commands sent by send_command.
+ *
+ * Parses the response with the caller's schema while it is still available and
+ * reports the outcome back to the waiting send_command.
+ */
+static void _command_completed(at_handleType handle, const at_responseType *response, void *context)
+{
+    /*Local variables*/
+    struct command_wait *wait = (struct command_wait *)context;
+
+    wait->result = response->result;
+
+    /*Parse the response data if needed*/
+    if (response->result.code == WIFI_OK && wait->schema != NULL)
+    {
+        at_parse(wait->schema, &response->view, wait->out);
+    }
+
+    wait->done = true;
+}
+
+/**
+ * @function _urc_wifi_connected
+ *
+ * @brief The station joined the AP, it has no IPv4 address yet.
+ */
+static void _urc_wifi_connected(const char *line, uint32_t length)
+{
+    node.connection_status = CONNECTING;
+    node.status_valid = true;
+}
+
+/**
+ * @function _urc_wifi_got_ip
+ *
+ * @brief The station obtained its IPv4 address.
+ */
+static void _urc_wifi_got_ip(const char *line, uint32_t length)
+{
+    node.connection_status = CONNECTED;
+    node.status_valid = true;
+}
+
+/**
+ * @function _urc_wifi_disconnect
+ *
+ * @brief The station lost the AP, every link is gone with it.
+ */
+static void _urc_wifi_disconnect(const char *line, uint32_t length)
+{
+    node.connection_status = DISCONNECTED;
+    node.status_valid = true;
+    node.board_ip = 0;
+    socket_links_lost();
+    modem_cache_invalidate(EVENT_DISCONNECT);
+}
+
+/**
+ * @function _data_received
+ *
+ * @brief Queues the payload of a datagram on its link as it arrives, or streams it to the handler.
+ */
+static void _data_received(const at_chunkType *chunk, void *context)
+{
+    /*Local variables*/
+    uint32_t offset = chunk->offset;
+
+    if (receiver.handler != NULL)
+    {
+        for (uint32_t i = 0; i < chunk->view.count; i++)
+        {
+            receiver.handler((const uint8_t *)chunk->view.spans[i].data, chunk->view.spans[i].length, offset, chunk->total, receiver.context);
+            offset += chunk->view.spans[i].length;
+        }
+
+        return;
+    }
+
+    /*A passthrough stream has no datagram boundaries to queue*/
+    if (chunk->total == AT_STREAM_TOTAL)
+    {
+        return;
+    }
+
+    socket_data_received(chunk);
+}
+
+/**
+ * @function _idle
+ *
+ * @brief Waits while the engine keeps receiving, the core sleeps between events.
+ * @param duration Time to wait in ms.
+ */
+static void _idle(uint32_t duration)
+{
+    uint32_t start = get_tick();
+
+    while ((get_tick() - start) < duration)
+    {
+        at_poll();
+        __WFI();
+    }
+}
+
+/**
+ * @function _urc_time_updated
+ *
+ * @brief The SNTP client synchronized the module clock.
+ */
+static void _urc_time_updated(const char *line, uint32_t length)
+{
+    node.time_synced = true;
+}
+
+/**
+ * @function _urc_ready
+ *
+ * @brief The module restarted: it is not connected and has no link, MQTT session nor time.
+ */
+static void _urc_ready(const char *line, uint32_t length)
+{
+    node.connection_status = DISCONNECTED;
+    node.status_valid = true;
+    node.board_ip = 0;
+    socket_links_lost();
+    mqtt_session_lost();
+    node.time_synced = false;
+    modem_cache_invalidate(EVENT_RESTART);
+}
+
+/**
+ * @function _skip_when_joined
+ *
+ * @brief The join steps of WiFi_init are not needed if the module was connected.
+ */
+static bool _skip_when_joined(void *context)
+{
+    return ((struct wifi_init_context *)context)->joined;
+}
+
+/**
+ * @function _skip_when_send_mode_known
+ *
+ * @brief AT+GMR is not needed once its version decided the send mode.
+ */
+static bool _skip_when_send_mode_known(void *context)
+{
+    return send_mode_known;
+}
+
+/**
+ * @function _choose_send_mode
+ *
+ * @brief Decides from the AT+GMR version whether AT+CIPSEND gets its payload before the prompt.
+ *
+ * Without a version, because AT+GMR failed or its reply did not parse, the payload
+ * waits for the prompt and the next WiFi_init() asks again.
+ */
+static void _choose_send_mode(void)
+{
+    /*Local variable declaration*/
+    uint32_t version;
+
+    if (send_mode_known || firmware.major <= 0)
+    {
+        return;
+    }
+
+    version = ((uint32_t)firmware.major << 8) | (uint8_t)firmware.minor;
+    send_flags = (version >= WIFI_EARLY_PAYLOAD_VERSION) ? 0 : AT_FLAG_PROMPT;
+    send_mode_known = true;
+
+#ifdef DEBUG_SYSTEM
+    printf("AT version %ld.%ld, payload %s the prompt%c%c", (long)firmware.major, (long)firmware.minor,
+           send_flags ? "after" : "before", RETURN, NEWLINE);
+#endif
+}
+
+/**
+ * @function _resync
+ *
+ * @brief Sends a bare AT until the module answers OK, the answers to the garbage before it are dropped.
+ */
+static void _resync(void)
+{
+    for (uint8_t attempt = 0; attempt < 3; attempt++)
+    {
+        if (send_command("AT", NULL, NULL, "OK", 500) == WIFI_OK)
+        {
+            return;
+        }
+    }
+
+#ifdef DEBUG_SYSTEM
+    LOG_ERR("The module does not answer AT");
+#endif
+}
+
+/**
+ * @function _skip_when_sysstore_cached
+ *
+ * @brief AT+SYSSTORE=0 is not needed if it was sent since the module started.
+ */
+static bool _skip_when_sysstore_cached(void *context)
+{
+    return modem_cache_get(FACT_SYSSTORE, NULL);
+}
+
+/**
+ * @function _connect
+ *
+ * @brief Sets the address of the station as WIFI_ADDRESSING selects and joins the AP.
+ *
+ * A static address, or the last DHCP lease in WIFI_ADDRESS_STICKY mode, is set
+ * with AT+CIPSTA before the join, which turns the DHCP client off: the station
+ * has its address as soon as it is associated. The sticky lease is dropped for
+ * DHCP (AT+CWDHCP=1,1 and a new join) when the join fails or the gateway does
+ * not answer AT+PING, e.g. on another network. A DHCP server that gave the
+ * address to another host in the meantime is not detected, the lease is renewed
+ * whenever the upload fails and the module rejoins.
+ *
+ * @retval The result of the last join.
+ */
+static WiFi_res_t _connect(void)
+{
+    /*Local variables*/
+    struct wifi_lease_record address = { WIFI_LEASE_MAGIC, {0}, WIFI_STATIC_IP, WIFI_STATIC_GATEWAY, WIFI_STATIC_NETMASK };
+    char command[40] = {0};
+    bool configured = false;
+    WiFi_res_t result_code;
+
+    if (WIFI_ADDRESSING == WIFI_ADDRESS_STICKY)
+    {
+        eeprom_read(WIFI_LEASE_EEPROM_OFFSET, &address, sizeof(address));
+    }
+
+    if (WIFI_ADDRESSING != WIFI_ADDRESS_DHCP && address.magic == WIFI_LEASE_MAGIC)
+    {
+        result_code = _set_address(&address);
+        if (result_code != WIFI_OK && WIFI_ADDRESSING == WIFI_ADDRESS_STATIC)
+        {
+            return result_code;
+        }
+
+        configured = (result_code == WIFI_OK);
+    }
+
+    result_code = _join();
+
+    if (configured && WIFI_ADDRESSING == WIFI_ADDRESS_STICKY)
+    {
+        if (result_code == WIFI_OK)
+        {
+            snprintf(command, sizeof(command), "AT+PING=\"%u.%u.%u.%u\"", WIFI_IP_OCTETS(address.gateway));
+            result_code = _send_command(command, NULL, NULL, "OK", 2000, AT_FLAG_TIMEOUT_FLOOR);
+        }
+
+        if (result_code != WIFI_OK)
+        {
+#ifdef DEBUG_SYSTEM
+            LOG_WRN("The last lease does not work here, asking the DHCP server");
+#endif
+            configured = false;
+
+            result_code = send_command("AT+CWDHCP=1,1", NULL, NULL, "OK", 1000);
+            if (result_code == WIFI_OK)
+            {
+                result_code = _join();
+            }
+        }
+    }
+
+    if (result_code != WIFI_OK)
+    {
+        return result_code;
+    }
+
+    if (!configured)
+    {
+        /*The DHCP server may have handed out another address, WiFi_init asks for it*/
+        modem_cache_invalidate(EVENT_DISCONNECT);
+        join_stats.dhcp++;
+        return WIFI_OK;
+    }
+
+    if (WIFI_ADDRESSING == WIFI_ADDRESS_STICKY)
+    {
+        join_stats.sticky++;
+    }
+
+    /*The address is known, AT+CIPSTA? is not needed*/
+    _cache_ip(address.ip);
+
+    return WIFI_OK;
+}
+
+/**
+ * @function _set_address
+ *
+ * @brief Sets a static address with AT+CIPSTA, the DHCP client of the station stops.
+ * @retval The result of the command.
+ */
+static WiFi_res_t _set_address(const struct wifi_lease_record *address)
+{
+    /*Local variables*/
+    char command[80] = {0};
+
+    snprintf(command, sizeof(command), "AT+CIPSTA=\"%u.%u.%u.%u\",\"%u.%u.%u.%u\",\"%u.%u.%u.%u\"",
+             WIFI_IP_OCTETS(address->ip), WIFI_IP_OCTETS(address->gateway), WIFI_IP_OCTETS(address->netmask));
+
+    return send_command(command, NULL, NULL, "OK", 1000);
+}
+
+/**
+ * @function _query_address
+ *
+ * @brief Reads the address, the gateway and the netmask of the station with AT+CIPSTA?.
+ * @retval The result of the command.
+ */
+static WiFi_res_t _query_address(struct station_address *address)
+{
+    /* Variable declaration */
+    struct command_wait wait = { false, NULL, address, { WIFI_FAIL, 0, 0 } };
+
+    /* The reply has a line per field, each with its own schema */
+    while (at_submit("AT+CIPSTA?", "OK", 1000, 0, _address_received, &wait) < 0)
+    {
+        at_poll();
+        __WFI();
+    }
+
+    return _wait_command(&wait);
+}
+
+/**
+ * @function _address_received
+ *
+ * @brief Parses the three lines of the AT+CIPSTA? reply and completes the wait.
+ */
+static void _address_received(at_handleType handle, const at_responseType *response, void *context)
+{
+    /*Local variables*/
+    struct command_wait *wait = (struct command_wait *)context;
+
+    if (response->result.code == WIFI_OK)
+    {
+        at_parse(&station_ip_schema, &response->view, wait->out);
+        at_parse(&station_gw_schema, &response->view, wait->out);
+        at_parse(&station_mask_schema, &response->view, wait->out);
+    }
+
+    _command_completed(handle, response, context);
+}
+
+/**
+ * @function _join
+ *
+ * @brief Connects to the local router, to the AP of the previous join if possible.
+ *
+ * A full scan join goes through every channel before it picks the AP. Once a
+ * join succeeded, the BSSID and the channel of the AP are read back with
+ * AT+CWJAP? and kept in the data EEPROM, and the next join asks for that BSSID
+ * with the fast scan mode and a WIFI_FAST_JOIN_TIMEOUT timeout. AT+CWJAP takes
+ * no channel, the stored one shows where the AP was found. If the AP cannot be
+ * found, the full scan runs and the record is updated from its outcome.
+ *
+ * Both joins share the learned latency of AT+CWJAP=, so their timeouts are
+ * floors: a few fast joins must not cut the full scan short.
+ *
+ * @retval The result of the last AT+CWJAP.
+ */
+static WiFi_res_t _join(void)
+{
+    /*Local variables*/
+    struct wifi_ap_record record;
+    struct ap_info ap = {0};
+    char command[AT_COMMAND_SIZE] = {0};
+    WiFi_res_t result_code;
+
+    eeprom_read(WIFI_AP_EEPROM_OFFSET, &record, sizeof(record));
+
+    if (record.magic == WIFI_AP_MAGIC)
+    {
+        /*<bssid>,<pci_en>,<reconn_interval>,<listen_interval>,<scan_mode>,<jap_timeout>*/
+        snprintf(command, sizeof(command), "AT+CWJAP=\"" SSID "\",\"" PSWD "\",\"%02x:%02x:%02x:%02x:%02x:%02x\",0,1,3,0,%u",
+                 record.bssid[0], record.bssid[1], record.bssid[2], record.bssid[3], record.bssid[4], record.bssid[5],
+                 WIFI_FAST_JOIN_TIMEOUT);
+
+        result_code = _send_command(command, NULL, NULL, "OK", WIFI_FAST_JOIN_TIMEOUT * 1000 + 1000, AT_FLAG_TIMEOUT_FLOOR);
+        if (result_code == WIFI_OK)
+        {
+            join_stats.fast_joins++;
+            join_stats.fast_time += last_result.elapsed;
+
+#ifdef DEBUG_SYSTEM
+            printf("Fast join on channel %u: %lu ms%c%c", record.channel, last_result.elapsed, RETURN, NEWLINE);
+#endif
+            return WIFI_OK;
+        }
+
+#ifdef DEBUG_SYSTEM
+        LOG_WRN("The cached AP was not found, scanning every channel");
+#endif
+        join_stats.fallbacks++;
+    }
+
+    /*Full scan*/
+    result_code = _send_command("AT+CWJAP=\"" SSID "\",\"" PSWD "\"", NULL, NULL, "OK", 5000, AT_FLAG_TIMEOUT_FLOOR);
+    if (result_code != WIFI_OK)
+    {
+        return result_code;
+    }
+
+    join_stats.full_joins++;
+    join_stats.full_time += last_result.elapsed;
+
+#ifdef DEBUG_SYSTEM
+    printf("Full scan join: %lu ms%c%c", last_result.elapsed, RETURN, NEWLINE);
+#endif
+
+    /*Remember the AP for the next join, unchanged words are not written again*/
+    if (send_command("AT+CWJAP?", &ap_info_schema, &ap, "OK", 2000) == WIFI_OK && _parse_bytes(ap.bssid, record.bssid, sizeof(record.bssid), ':', 16))
+    {
+        record.magic    = WIFI_AP_MAGIC;
+        record.channel  = ap.channel;
+        record.reserved = 0;
+        memset(record.padding, 0, sizeof(record.padding));
+
+        eeprom_write(WIFI_AP_EEPROM_OFFSET, &record, sizeof(record));
+    }
+
+    return WIFI_OK;
+}
+
+/**
+ * @function _skip_when_mux_set
+ *
+ * @brief AT+CIPMUX=<WIFI_CIPMUX> is not needed if the module is in that mode already.
+ */
+static bool _skip_when_mux_set(void *context)
+{
+    return mux_mode.value == WIFI_CIPMUX;
+}
+
+/**
+ * @function _skip_when_mux_cached
+ *
+ * @brief AT+CIPMUX? is not needed if the mode is known since the module started.
+ */
+static bool _skip_when_mux_cached(void *context)
+{
+    uint8_t mode;
+
+    if (!modem_cache_get(FACT_MUX, &mode))
+    {
+        return false;
+    }
+
+    mux_mode.value = mode;
+
+    return true;
+}
+
+/**
+ * @function _skip_when_recvtype_cached
+ *
+ * @brief AT+CIPRECVTYPE is not needed if active mode was set since the module started.
+ */
+static bool _skip_when_recvtype_cached(void *context)
+{
+    uint8_t mode;
+
+    return modem_cache_get(FACT_RECVTYPE, &mode) && mode == 0;
+}
+
+/**
+ * @function _restore_ip
+ *
+ * @brief Sets node.board_ip from the modem cache, AT+CIPSTA? is not needed while the lease is known.
+ * @retval true if the cache held the address.
+ */
+static bool _restore_ip(void)
+{
+    uint8_t ip[4];
+
+    if (!modem_cache_get(FACT_IP, ip))
+    {
+        return false;
+    }
+
+    node.board_ip = WIFI_IP(ip[0], ip[1], ip[2], ip[3]);
+
+    return true;
+}
+
+/**
+ * @function _cache_ip
+ *
+ * @brief Sets node.board_ip and keeps it in the modem cache until the station disconnects.
+ */
+static void _cache_ip(uint32_t ip)
+{
+    const uint8_t bytes[4] = { WIFI_IP_OCTETS(ip) };
+
+    node.board_ip = ip;
+    modem_cache_put(FACT_IP, bytes);
+}
+
+/**
+ * @function _parse_ip
+ *
+ * @brief Converts "192.168.1.7", quoted or not, to a packed address.
+ * @retval true if the text holds an IPv4 address.
+ */
+static bool _parse_ip(const char *text, uint32_t *ip)
+{
+    uint8_t bytes[4];
+
+    if (!_parse_bytes(text, bytes, sizeof(bytes), '.', 10))
+    {
+        return false;
+    }
+
+    *ip = WIFI_IP(bytes[0], bytes[1], bytes[2], bytes[3]);
+
+    return true;
+}
+
+/**
+ * @function _parse_bytes
+ *
+ * @brief Converts "aa:bb:cc:dd:ee:ff" or "192.168.1.7", quoted or not, to bytes.
+ * @param text: The text to convert.
+ * @param bytes: Receives the bytes.
+ * @param count: Number of bytes expected.
+ * @param separator: Character between the bytes.
+ * @param base: 16 for a MAC address, 10 for an IPv4 address.
+ * @retval true if exactly count bytes were found.
+ */
+static bool _parse_bytes(const char *text, uint8_t *bytes, uint32_t count, char separator, uint32_t base)
+{
+    /*Local variables*/
+    const char *p = text;
+
+    if (*p == '"')
+    {
+        p++;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t value = 0;
+        uint32_t digits = 0;
+
+        while (isxdigit((unsigned char)*p) && (base == 16 || isdigit((unsigned char)*p)))
+        {
+            value = value * base + (isdigit((unsigned char)*p) ? (uint32_t)(*p - '0') : (uint32_t)((*p | 0x20) - 'a' + 10));
+            digits++;
+            p++;
+        }
+
+        if (digits == 0 || value > 0xFF)
+        {
+            return false;
+        }
+
+        bytes[i] = value;
+
+        if (i + 1 < count)
+        {
+            if (*p != separator)
+            {
+                return false;
+            }
+
+            p++;
+        }
+    }
+
+    return (*p == '"' || *p == '\0');
+}
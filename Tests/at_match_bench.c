@@ -0,0 +1,257 @@
+/*
+ * at_match_bench.c
+ *
+ * Benchmark of the terminator matcher against the strstr loop it replaced.
+ *
+ * Build and run on the host from this directory:
+ *   gcc -O2 -I../Inc at_match_bench.c ../Src/at_match.c -o at_match_bench && ./at_match_bench
+ *
+ * On the STM32L053 build it with STM32L053xx defined in place of Src/main.c, together
+ * with the firmware sources. It runs at the 16 MHz HSI clock of the firmware, counts
+ * core cycles with SysTick and prints on USART2.
+ *
+ * Every recorded response arrives in bursts of BURST bytes, as the DMA delivers them.
+ * The old send_command ran strstr(buffer, exp_end) over the whole buffer after each
+ * burst, and did not look for failures. The matcher is fed each burst once. It is
+ * timed with the terminator alone and with the pattern set the engine tracks for the
+ * command: the terminator, the four ESP-AT failure codes, the command's own failure
+ * result and the ">" prompt when it has them, up to AT_MATCH_MAX_PATTERNS.
+ *
+ * Host numbers say nothing about the target: glibc's strstr is vectorised, newlib's
+ * compares byte by byte. Only the Cortex-M0+ numbers decide which loop is cheaper.
+ */
+
+
+#include <at_match.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef STM32L053xx
+#include <stm32l0xx.h>
+#include <system_init.h>
+#include <uart.h>
+#define EOL             "\r\n"
+#else
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC
+#endif
+#define EOL             "\n"
+#endif
+
+
+/*Bytes per poll, a DMA half transfer or an IDLE burst*/
+#define BURST           8
+#ifdef STM32L053xx
+/*Keeps every timed loop within the 24 bit SysTick counter*/
+#define ITERATIONS      16
+#else
+#define ITERATIONS      200000
+#endif
+
+/*Responses recorded from ESP-AT 3.x with the terminator send_command waited for*/
+static const struct
+{
+    const char *name;
+    const char *exp_end;
+    const char *exp_fail;        // Failure result of the command only, NULL if none
+    int prompt;                  // The payload waits for ">", AT_FLAG_PROMPT
+    const char *text;
+} responses[] =
+{
+    { "AT",           "OK",          NULL, 0, "AT\r\n\r\nOK\r\n" },
+    { "CWJAP?",       "OK",          NULL, 0, "AT+CWJAP?\r\n+CWJAP:\"THEOGREG_8\",\"aa:bb:cc:dd:ee:ff\",6,-60,0,1,3,0,1\r\n\r\nOK\r\n" },
+    { "CIPSNTPTIME?", "OK",          NULL, 0, "AT+CIPSNTPTIME?\r\n+CIPSNTPTIME:Thu Aug  4 14:48:05 2021\r\nOK\r\n" },
+    { "CIPSTA?",      "OK",          NULL, 0, "AT+CIPSTA?\r\n+CIPSTA:ip:\"192.168.1.7\"\r\n+CIPSTA:gateway:\"192.168.1.1\"\r\n"
+                                              "+CIPSTA:netmask:\"255.255.255.0\"\r\n\r\nOK\r\n" },
+    { "CWLAP",        "OK",          NULL, 0, "AT+CWLAP\r\n+CWLAP:(3,\"THEOGREG_8\",-60,\"aa:bb:cc:dd:ee:ff\",6,-1,-1,4,4,7,0)\r\n"
+                                              "+CWLAP:(4,\"Cosmote-2G\",-71,\"10:13:31:aa:bb:01\",1,-1,-1,4,4,7,1)\r\n"
+                                              "+CWLAP:(3,\"Vodafone-AB12\",-78,\"d4:6e:0e:12:34:56\",11,-1,-1,4,4,7,0)\r\n"
+                                              "+CWLAP:(0,\"Guest\",-85,\"d4:6e:0e:12:34:57\",11,-1,-1,0,0,7,0)\r\n"
+                                              "+CWLAP:(4,\"HOME-5521\",-88,\"f0:9f:c2:01:02:03\",6,-1,-1,4,4,7,1)\r\n\r\nOK\r\n" },
+    { "CIPSEND",      "SEND OK",     NULL, 0, "AT+CIPSEND=0,48\r\n\r\nOK\r\n\r\n>\r\nRecv 48 bytes\r\n\r\nSEND OK\r\n" },
+    { "CIPSEND >",    "SEND OK",     NULL, 1, "AT+CIPSEND=0,48\r\n\r\nOK\r\n\r\n>\r\nRecv 48 bytes\r\n\r\nSEND OK\r\n" },
+    { "MQTTPUBRAW",   "+MQTTPUB:OK", "+MQTTPUB:FAIL", 1, "AT+MQTTPUBRAW=0,\"node/1\",48,1,0\r\n\r\nOK\r\n\r\n>\r\n+MQTTPUB:OK\r\n" },
+    { "CWJAP fail",   "OK",          NULL, 0, "AT+CWJAP=\"THEOGREG_8\",\"wrong\"\r\n+CWJAP:1\r\n\r\nERROR\r\n" }
+};
+
+/*Failure codes the engine tracks for every command, see failure_terminators in at_engine.c*/
+static const char *failure_codes[] = { "ERROR", "FAIL", "SEND FAIL", "busy p" };
+
+static volatile uint32_t sink;
+
+
+/**
+ * @function _now
+ *
+ * @brief Reads the SysTick counter on the target, the time stamp counter or the
+ *        monotonic clock in ns on the host.
+ */
+static uint64_t _now(void)
+{
+#if defined(STM32L053xx)
+    return SysTick->VAL;
+#elif defined(HAVE_TSC)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000U + ts.tv_nsec;
+#endif
+}
+
+/**
+ * @function _elapsed
+ *
+ * @brief Time between two readings of _now(), SysTick counts down and wraps at 24 bits.
+ */
+static uint64_t _elapsed(uint64_t start, uint64_t end)
+{
+#ifdef STM32L053xx
+    return (start - end) & SysTick_LOAD_RELOAD_Msk;
+#else
+    return end - start;
+#endif
+}
+
+/**
+ * @function _strstr_loop
+ *
+ * @brief The loop of the old send_command, strstr over the whole buffer after each burst.
+ * @retval true once the terminator was seen.
+ */
+static int _strstr_loop(const char *text, uint32_t length, const char *exp_end)
+{
+    /*Local variables*/
+    char buffer[512] = {0};
+    uint32_t received = 0;
+
+    while (received < length)
+    {
+        uint32_t burst = (length - received < BURST) ? (length - received) : BURST;
+
+        memcpy(&buffer[received], &text[received], burst);
+        received += burst;
+
+        if (strstr(buffer, exp_end))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @function _matcher_loop
+ *
+ * @brief The matcher fed each burst once, it carries on past the prompt as at_poll does.
+ * @retval Index of the pattern that fired, -1 if none did.
+ */
+static int _matcher_loop(at_matcherType *matcher, int prompt, const char *text, uint32_t length)
+{
+    /*Local variables*/
+    uint32_t received = 0, used;
+    int fired = -1;
+
+    at_match_reset(matcher);
+
+    while (received < length && fired < 0)
+    {
+        uint32_t burst = (length - received < BURST) ? (length - received) : BURST;
+
+        fired = at_match_feed(matcher, &text[received], burst, &used);
+        received += used;
+
+        if (fired >= 0 && fired == prompt)
+        {
+            fired = -1;
+        }
+    }
+
+    return fired;
+}
+
+int main(void)
+{
+#if defined(STM32L053xx)
+    const char *unit = "cycles";
+
+    /*The firmware's 16 MHz HSI clock and its debug port*/
+    rccInit();
+    uart2_init();
+
+    /*Free running core clock counter, no interrupt*/
+    SysTick->LOAD = SysTick_LOAD_RELOAD_Msk;
+    SysTick->VAL  = 0;
+    SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_ENABLE_Msk;
+#elif defined(HAVE_TSC)
+    const char *unit = "TSC cycles";
+#else
+    const char *unit = "ns";
+#endif
+
+    printf("%-14s %6s %12s %12s %9s %12s" EOL, "response", "bytes", "strstr loop", "at_match x1", "patterns", "at_match");
+    printf("%-14s %6s %12s %12s %9s %12s" EOL, "", "", unit, unit, "", unit);
+
+    for (uint32_t r = 0; r < sizeof(responses) / sizeof(responses[0]); r++)
+    {
+        at_matcherType single, matcher;
+        uint32_t length = strlen(responses[r].text);
+        uint64_t t0, t1, t2, t3;
+        int prompt = -1;
+
+        at_match_init(&single);
+        at_match_add(&single, responses[r].exp_end, 0);
+
+        /*The pattern set _start_command builds for the command*/
+        at_match_init(&matcher);
+        at_match_add(&matcher, responses[r].exp_end, 0);
+        for (uint32_t i = 0; i < sizeof(failure_codes) / sizeof(failure_codes[0]); i++)
+        {
+            at_match_add(&matcher, failure_codes[i], AT_MATCH_LINE_START);
+        }
+        if (responses[r].exp_fail != NULL)
+        {
+            at_match_add(&matcher, responses[r].exp_fail, AT_MATCH_LINE_START);
+        }
+        if (responses[r].prompt)
+        {
+            prompt = at_match_add(&matcher, ">", AT_MATCH_LINE_START);
+        }
+
+        t0 = _now();
+        for (uint32_t i = 0; i < ITERATIONS; i++)
+        {
+            sink += _strstr_loop(responses[r].text, length, responses[r].exp_end);
+        }
+
+        t1 = _now();
+        for (uint32_t i = 0; i < ITERATIONS; i++)
+        {
+            sink += _matcher_loop(&single, -1, responses[r].text, length);
+        }
+
+        t2 = _now();
+        for (uint32_t i = 0; i < ITERATIONS; i++)
+        {
+            sink += _matcher_loop(&matcher, prompt, responses[r].text, length);
+        }
+
+        t3 = _now();
+
+        printf("%-14s %6lu %12lu %12lu %9lu %12lu" EOL, responses[r].name, (unsigned long)length,
+               (unsigned long)(_elapsed(t0, t1) / ITERATIONS), (unsigned long)(_elapsed(t1, t2) / ITERATIONS),
+               (unsigned long)matcher.count, (unsigned long)(_elapsed(t2, t3) / ITERATIONS));
+    }
+
+#ifdef STM32L053xx
+    while (1)
+    {
+    }
+#endif
+
+    return 0;
+}
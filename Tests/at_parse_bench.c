@@ -0,0 +1,137 @@
+/*
+ * at_parse_bench.c
+ *
+ * Host benchmark of the schema parser against the vsscanf call it replaced.
+ *
+ * Build and run from this directory:
+ *   gcc -O2 -I../Inc at_parse_bench.c ../Src/at_parse.c ../Src/ring.c -o at_parse_bench && ./at_parse_bench
+ *
+ * The AT+CWJAP? reply is parsed ITERATIONS times, once with the strstr and vsscanf
+ * pair of the old send_command and once with at_parse, from a plain buffer and from
+ * a view that wraps around the end of the receive ring. Both results are compared
+ * before anything is timed.
+ */
+
+
+#include <at_parse.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+
+#define ITERATIONS      2000000
+
+/*Reply of AT+CWJAP? in the layout wifi.c parses it*/
+struct ap_info
+{
+    char ssid[33];
+    char bssid[18];
+    int32_t channel;
+    int32_t rssi;
+};
+
+static const at_fieldType ap_info_fields[] = { AT_QUOTED(struct ap_info, ssid, ','), AT_QUOTED(struct ap_info, bssid, ','),
+                                               AT_INT(struct ap_info, channel, ','), AT_INT(struct ap_info, rssi, ',') };
+static const at_schemaType ap_info_schema  = AT_SCHEMA("+CWJAP:", ap_info_fields);
+
+static const char response[] = "AT+CWJAP?\r\n+CWJAP:\"THEOGREG_8\",\"aa:bb:cc:dd:ee:ff\",6,-60,0,1,3,0,1\r\n\r\nOK\r\n";
+
+static volatile int32_t sink;
+
+
+/**
+ * @function _elapsed_ns
+ *
+ * @brief Nanoseconds between two readings of the monotonic clock.
+ */
+static double _elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/**
+ * @function _old_parse
+ *
+ * @brief The parsing of the old send_command, strstr for the prefix and vsscanf for the fields.
+ */
+static int _old_parse(const char *text, const char *prefix, const char *format, ...)
+{
+    /*Local variables*/
+    const char *start = strstr(text, prefix);
+    va_list args;
+    int parsed;
+
+    if (start == NULL)
+    {
+        return -1;
+    }
+
+    va_start(args, format);
+    parsed = vsscanf(start + strlen(prefix), format, args);
+    va_end(args);
+
+    return parsed;
+}
+
+int main(void)
+{
+    /*Local variables*/
+    struct ap_info old = {0}, flat = {0}, wrapped = {0};
+    int32_t extra[5];
+    ring_viewType plain, split;
+    struct timespec t0, t1, t2, t3;
+    uint32_t length = strlen(response);
+
+    ring_view_init(&plain, response, length);
+
+    /*The same reply split in the middle of the SSID, as it lies when the ring wraps*/
+    split.spans[0].data   = response;
+    split.spans[0].length = 20;
+    split.spans[1].data   = response + 20;
+    split.spans[1].length = length - 20;
+    split.count           = 2;
+    split.length          = length;
+
+    _old_parse(response, "+CWJAP:", "\"%32[^\"]\",\"%17[^\"]\",%d,%d,%d,%d,%d,%d,%d", old.ssid, old.bssid,
+               &old.channel, &old.rssi, &extra[0], &extra[1], &extra[2], &extra[3], &extra[4]);
+    at_parse(&ap_info_schema, &plain, &flat);
+    at_parse(&ap_info_schema, &split, &wrapped);
+
+    if (memcmp(&old, &flat, sizeof(old)) != 0 || memcmp(&old, &wrapped, sizeof(old)) != 0)
+    {
+        printf("Results differ: %s %s %d %d\n", flat.ssid, flat.bssid, (int)flat.channel, (int)flat.rssi);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (uint32_t i = 0; i < ITERATIONS; i++)
+    {
+        _old_parse(response, "+CWJAP:", "\"%32[^\"]\",\"%17[^\"]\",%d,%d,%d,%d,%d,%d,%d", old.ssid, old.bssid,
+                   &old.channel, &old.rssi, &extra[0], &extra[1], &extra[2], &extra[3], &extra[4]);
+        sink += old.rssi;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    for (uint32_t i = 0; i < ITERATIONS; i++)
+    {
+        at_parse(&ap_info_schema, &plain, &flat);
+        sink += flat.rssi;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    for (uint32_t i = 0; i < ITERATIONS; i++)
+    {
+        at_parse(&ap_info_schema, &split, &wrapped);
+        sink += wrapped.rssi;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t3);
+
+    printf("AT+CWJAP? reply, %u bytes, %u iterations\n", length, ITERATIONS);
+    printf("  strstr + vsscanf     %6.1f ns/call\n", _elapsed_ns(&t0, &t1) / ITERATIONS);
+    printf("  at_parse             %6.1f ns/call\n", _elapsed_ns(&t1, &t2) / ITERATIONS);
+    printf("  at_parse, wrapped    %6.1f ns/call\n", _elapsed_ns(&t2, &t3) / ITERATIONS);
+
+    return 0;
+}
@@ -0,0 +1,404 @@
+/*
+ * coap_sim.c
+ *
+ * Host simulation of the CoAP client against a minimal server.
+ *
+ * Build and run from this directory:
+ *   gcc -O2 -DSTM32L053xx -DDATE_TIME_SIZE_BUFF=10 -I../Inc -I../CMSIS/Include \
+ *       -I../CMSIS/Device/ST/STM32L0xx/Include \
+ *       coap_sim.c ../Src/coap.c -o coap_sim && ./coap_sim
+ *
+ * The socket layer is replaced by the server below, which answers in simulated time:
+ *   /up    stores a Block1 upload and answers 2.31 Continue until the last block
+ *   /big   serves a 134 byte resource in 32 byte Block2 blocks
+ *   /sep   sends an empty ACK, then the response as a separate CON message
+ *   /obs   registers an observer and sends three notifications, the second one stale
+ *   other  4.04 Not Found
+ * A request can be dropped on its way to the server to exercise the retransmissions.
+ */
+
+
+#include <coap.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+#define QUEUE_SIZE      64
+#define CHECK(condition)  do { if (!(condition)) { printf("FAILED: %s (line %d)\n", #condition, __LINE__); exit(1); } } while (0)
+
+/*Option numbers the server reads*/
+#define OPTION_OBSERVE   6
+#define OPTION_URI_PATH  11
+#define OPTION_BLOCK2    23
+#define OPTION_BLOCK1    27
+
+/*Message on its way to the client*/
+struct packet
+{
+    uint8_t data[200];
+    uint32_t length;
+    uint32_t arrival;
+};
+
+/*Response under construction, options are appended in ascending order*/
+struct message
+{
+    uint8_t data[200];
+    uint32_t length;
+    uint16_t last_option;
+};
+
+nucleoType node;
+
+static struct packet queue[QUEUE_SIZE];
+static uint32_t head, tail;
+static uint32_t now;
+static int drop_requests;                      // Requests the server never sees
+static uint8_t uploaded[1024];
+static uint32_t uploaded_length;
+static const char resource[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                               "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ!!!!!!!!!!";
+static char received[512];
+static uint32_t received_length;
+static int blocks;
+
+
+uint32_t get_tick(void)
+{
+    return now;
+}
+
+/**
+ * @function _push
+ *
+ * @brief Queues a message for the client, it arrives after a delay in ms.
+ */
+static void _push(const uint8_t *data, uint32_t length, uint32_t delay)
+{
+    struct packet *packet = &queue[head++ % QUEUE_SIZE];
+
+    memcpy(packet->data, data, length);
+    packet->length  = length;
+    packet->arrival = now + delay;
+}
+
+/**
+ * @function _add_option
+ *
+ * @brief Appends an unsigned integer option to a response.
+ */
+static void _add_option(struct message *message, uint16_t number, uint32_t value)
+{
+    /*Local variables*/
+    uint8_t bytes[3];
+    uint32_t length = 0;
+    uint32_t delta = number - message->last_option;
+
+    if (value > 0xFFFF)
+    {
+        bytes[length++] = value >> 16;
+    }
+
+    if (value > 0xFF)
+    {
+        bytes[length++] = value >> 8;
+    }
+
+    if (value != 0)
+    {
+        bytes[length++] = value;
+    }
+
+    if (delta >= 13)
+    {
+        message->data[message->length++] = (13 << 4) | length;
+        message->data[message->length++] = delta - 13;
+    }
+    else
+    {
+        message->data[message->length++] = (delta << 4) | length;
+    }
+
+    memcpy(&message->data[message->length], bytes, length);
+    message->length += length;
+    message->last_option = number;
+}
+
+/**
+ * @function _add_payload
+ *
+ * @brief Appends the payload marker and a payload to a response.
+ */
+static void _add_payload(struct message *message, const void *payload, uint32_t length)
+{
+    message->data[message->length++] = 0xFF;
+    memcpy(&message->data[message->length], payload, length);
+    message->length += length;
+}
+
+/**
+ * @function socket_send
+ *
+ * @brief The server: parses a request of the client and queues its answer.
+ */
+WiFi_res_t socket_send(socket_handleType handle, const uint8_t *data, uint32_t length)
+{
+    /*Local variables*/
+    uint8_t token_length = data[0] & 0x0F;
+    uint8_t code = data[1];
+    uint16_t id = (data[2] << 8) | data[3];
+    uint32_t p = 4 + token_length, number = 0;
+    int32_t block1 = -1, block2 = -1;
+    const uint8_t *payload = NULL;
+    uint32_t payload_length = 0;
+    char path[64] = "";
+    struct message response = { {0}, 0, 0 };
+
+    now += 10;
+
+    /*Empty ACK or RST of the client*/
+    if (code == 0)
+    {
+        return WIFI_OK;
+    }
+
+    if (drop_requests > 0)
+    {
+        drop_requests--;
+        return WIFI_OK;
+    }
+
+    /*Options and payload*/
+    while (p < length)
+    {
+        uint32_t delta, option_length, value = 0;
+
+        if (data[p] == 0xFF)
+        {
+            payload        = &data[p + 1];
+            payload_length = length - p - 1;
+            break;
+        }
+
+        delta         = data[p] >> 4;
+        option_length = data[p] & 0x0F;
+        p++;
+
+        if (delta == 13)
+        {
+            delta = 13 + data[p++];
+        }
+
+        if (option_length == 13)
+        {
+            option_length = 13 + data[p++];
+        }
+
+        number += delta;
+
+        for (uint32_t i = 0; i < option_length; i++)
+        {
+            value = (value << 8) | data[p + i];
+        }
+
+        if (number == OPTION_URI_PATH)
+        {
+            strcat(path, "/");
+            strncat(path, (const char *)&data[p], option_length);
+        }
+        else if (number == OPTION_BLOCK1)
+        {
+            block1 = value;
+        }
+        else if (number == OPTION_BLOCK2)
+        {
+            block2 = value;
+        }
+
+        p += option_length;
+    }
+
+    /*Piggybacked ACK with the token of the request*/
+    response.data[0] = 0x60 | token_length;
+    response.data[2] = id >> 8;
+    response.data[3] = id;
+    memcpy(&response.data[4], &data[4], token_length);
+    response.length = 4 + token_length;
+
+    if (strcmp(path, "/up") == 0)
+    {
+        uint32_t block = (block1 >= 0) ? (block1 >> 4) : 0;
+        bool more = (block1 >= 0) && (block1 & 0x08);
+
+        memcpy(&uploaded[block * 64], payload, payload_length);
+        uploaded_length = block * 64 + payload_length;
+
+        response.data[1] = more ? COAP_CODE(2, 31) : COAP_CODE(2, 4);
+
+        if (block1 >= 0)
+        {
+            _add_option(&response, OPTION_BLOCK1, block1);
+        }
+    }
+    else if (strcmp(path, "/big") == 0)
+    {
+        uint32_t block = (block2 >= 0) ? (block2 >> 4) : 0;
+        uint32_t offset = block * 32, size = sizeof(resource) - 1 - offset;
+        bool more = (size > 32);
+
+        if (more)
+        {
+            size = 32;
+        }
+
+        response.data[1] = COAP_CODE(2, 5);
+        _add_option(&response, OPTION_BLOCK2, (block << 4) | (more ? 0x08 : 0) | 1);
+        _add_payload(&response, &resource[offset], size);
+    }
+    else if (strcmp(path, "/sep") == 0)
+    {
+        uint8_t ack[4] = { 0x60, 0, id >> 8, id };
+
+        _push(ack, sizeof(ack), 20);
+
+        /*The response comes later as a CON of its own*/
+        response.data[0] = 0x40 | token_length;
+        response.data[1] = COAP_CODE(2, 5);
+        response.data[2] = 0x77;
+        response.data[3] = 0x01;
+        _add_payload(&response, "late", 4);
+        _push(response.data, response.length, 500);
+
+        return WIFI_OK;
+    }
+    else if (strcmp(path, "/obs") == 0)
+    {
+        static const int32_t sequences[3] = { 6, 3, 8 };
+
+        response.data[1] = COAP_CODE(2, 5);
+        _add_option(&response, OPTION_OBSERVE, 5);
+        _add_payload(&response, "A", 1);
+        _push(response.data, response.length, 30);
+
+        /*Notifications as NON messages, the second one was overtaken*/
+        for (uint32_t k = 0; k < 3; k++)
+        {
+            struct message notification = response;
+
+            notification.data[0] = 0x50 | token_length;
+            notification.data[2] = 0x10;
+            notification.data[3] = k;
+            notification.data[4 + token_length + 1] = sequences[k];
+            notification.data[notification.length - 1] = 'B' + k;
+            _push(notification.data, notification.length, 1000 * (k + 1));
+        }
+
+        return WIFI_OK;
+    }
+    else
+    {
+        response.data[1] = COAP_CODE(4, 4);
+    }
+
+    _push(response.data, response.length, 30);
+
+    return WIFI_OK;
+}
+
+WiFi_res_t socket_receive(socket_handleType handle, uint8_t *buffer, uint32_t size, uint32_t *length, uint32_t timeout)
+{
+    /*Local variables*/
+    uint32_t end = now + timeout;
+
+    while (1)
+    {
+        struct packet *packet = &queue[tail % QUEUE_SIZE];
+
+        if (tail != head && packet->arrival <= now)
+        {
+            memcpy(buffer, packet->data, (packet->length < size) ? packet->length : size);
+            *length = packet->length;
+            tail++;
+
+            return WIFI_OK;
+        }
+
+        if (now >= end)
+        {
+            return WIFI_TIMEOUT;
+        }
+
+        now++;
+    }
+}
+
+/**
+ * @function _collect
+ *
+ * @brief Response handler, reassembles the blocks of a response.
+ */
+static void _collect(const coap_responseType *response, void *context)
+{
+    memcpy(&received[response->offset], response->payload, response->length);
+    received_length = response->offset + response->length;
+    blocks++;
+}
+
+/**
+ * @function _notified
+ *
+ * @brief Notification handler, prints each accepted notification.
+ */
+static void _notified(const coap_responseType *response, void *context)
+{
+    printf("  notification %ld '%.*s'\n", (long)response->observe, (int)response->length, (const char *)response->payload);
+}
+
+int main(void)
+{
+    /*Local variables*/
+    coap_clientType client;
+    uint8_t upload[200];
+    coap_requestType put = { COAP_PUT, "up", true, COAP_FORMAT_CBOR, upload, sizeof(upload) };
+    coap_requestType get = { COAP_GET, "big", true, COAP_FORMAT_NONE, NULL, 0 };
+    uint32_t start;
+
+    coap_init(&client, 0);
+    printf("client RAM %u B\n", (unsigned)sizeof(client));
+
+    for (uint32_t i = 0; i < sizeof(upload); i++)
+    {
+        upload[i] = i;
+    }
+
+    CHECK(coap_request(&client, &put, NULL, NULL) == WIFI_OK);
+    CHECK(uploaded_length == sizeof(upload) && memcmp(uploaded, upload, sizeof(upload)) == 0);
+    printf("Block1 upload of %u bytes\n", (unsigned)sizeof(upload));
+
+    CHECK(coap_request(&client, &get, _collect, NULL) == WIFI_OK);
+    CHECK(received_length == sizeof(resource) - 1 && memcmp(received, resource, received_length) == 0);
+    printf("Block2 download in %d blocks\n", blocks);
+
+    drop_requests = 2;
+    start = now;
+    get.path = "nope";
+    CHECK(coap_request(&client, &get, _collect, NULL) == WIFI_ERROR);
+    printf("4.04 after %lu ms and %lu retransmits\n", (unsigned long)(now - start), (unsigned long)client.stats.retransmits);
+
+    get.path = "sep";
+    CHECK(coap_request(&client, &get, _collect, NULL) == WIFI_OK && memcmp(received, "late", 4) == 0);
+    printf("Separate response\n");
+
+    drop_requests = 100;
+    start = now;
+    CHECK(coap_request(&client, &get, _collect, NULL) == WIFI_TIMEOUT);
+    printf("Gave up after %lu ms, 2 to 3 s times 31 expected\n", (unsigned long)(now - start));
+    drop_requests = 0;
+
+    CHECK(coap_observe(&client, "obs", _notified, NULL) == WIFI_OK);
+    coap_poll(&client, 4000);
+    CHECK(client.stats.notifications == 2);
+    printf("Observe, stale notification dropped\n");
+
+    return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * rudp_sim.c
+ *
+ * Host simulation of two rudp endpoints over a lossy link.
+ *
+ * Build and run from this directory, the argument is the loss rate in percent:
+ *   gcc -O2 -DSTM32L053xx -DDATE_TIME_SIZE_BUFF=10 -I../Inc -I../CMSIS/Include \
+ *       -I../CMSIS/Device/ST/STM32L0xx/Include \
+ *       rudp_sim.c ../Src/rudp.c ../Src/rtt.c -o rudp_sim && ./rudp_sim 30
+ *
+ * Endpoint a sends DATAGRAMS numbered datagrams, endpoint b delivers them. The socket
+ * layer is replaced by two queues with LATENCY ms of one-way delay, each send costs
+ * SEND_COST ms of simulated time. Every datagram has to be delivered exactly once, and
+ * the sender has to agree: a datagram it gave up must not have been delivered, or the
+ * telemetry batch it carried would reach the server twice under a new sequence number.
+ */
+
+
+#include <rudp.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+#define DATAGRAMS       40
+#define LATENCY         30
+#define SEND_COST       20
+#define QUEUE_SIZE      64
+
+/*Datagram on its way to an endpoint*/
+struct packet
+{
+    uint8_t data[64];
+    uint32_t length;
+    uint32_t arrival;
+};
+
+static struct packet queues[2][QUEUE_SIZE];     // Indexed by the receiving socket
+static uint32_t heads[2], tails[2];
+static uint32_t now;
+static int loss_rate;
+
+
+uint32_t get_tick(void)
+{
+    return now;
+}
+
+WiFi_res_t socket_send(socket_handleType handle, const uint8_t *data, uint32_t length)
+{
+    /*Local variables*/
+    struct packet *packet;
+    int peer = !handle;
+
+    now += SEND_COST;
+
+    if (rand() % 100 < loss_rate)
+    {
+        return WIFI_OK;
+    }
+
+    packet = &queues[peer][heads[peer]++ % QUEUE_SIZE];
+    packet->length  = (length < sizeof(packet->data)) ? length : sizeof(packet->data);
+    packet->arrival = now + LATENCY;
+    memcpy(packet->data, data, packet->length);
+
+    return WIFI_OK;
+}
+
+WiFi_res_t socket_receive(socket_handleType handle, uint8_t *buffer, uint32_t size, uint32_t *length, uint32_t timeout)
+{
+    /*Local variables*/
+    uint32_t end = now + timeout;
+
+    while (1)
+    {
+        struct packet *packet = &queues[handle][tails[handle] % QUEUE_SIZE];
+
+        if (tails[handle] != heads[handle] && packet->arrival <= now)
+        {
+            memcpy(buffer, packet->data, (packet->length < size) ? packet->length : size);
+            *length = packet->length;
+            tails[handle]++;
+
+            return WIFI_OK;
+        }
+
+        if (now >= end)
+        {
+            return WIFI_TIMEOUT;
+        }
+
+        now++;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    /*Local variables*/
+    static uint8_t datagrams[DATAGRAMS][RUDP_HEADER_SIZE + 4];
+    uint8_t received[64];
+    uint32_t length, start;
+    int delivered[DATAGRAMS] = {0};
+    int sent = 0, count = 0;
+    rudpType a, b;
+
+    loss_rate = (argc > 1) ? atoi(argv[1]) : 0;
+    srand(7);
+
+    rudp_init(&a);
+    rudp_init(&b);
+    rudp_bind(&a, 0);
+    rudp_bind(&b, 1);
+
+    start = now;
+
+    /*Run until the sender has an outcome for every datagram*/
+    while ((sent < DATAGRAMS || rudp_pending(&a) != 0) && now - start < 600000)
+    {
+        /*Fill the window*/
+        while (sent < DATAGRAMS)
+        {
+            snprintf((char *)&datagrams[sent][RUDP_HEADER_SIZE], 4, "%02d", sent);
+
+            if (rudp_send(&a, datagrams[sent], RUDP_HEADER_SIZE + 3) != WIFI_OK)
+            {
+                break;
+            }
+
+            sent++;
+        }
+
+        if (rudp_poll(&b, received, sizeof(received), &length, 50) == WIFI_OK && length != 0)
+        {
+            int number = atoi((const char *)received);
+
+            if (delivered[number]++)
+            {
+                printf("Datagram %d delivered twice\n", number);
+                return 1;
+            }
+
+            count++;
+        }
+
+        if (rudp_poll(&a, received, sizeof(received), &length, 50) == WIFI_FAIL)
+        {
+            printf("A datagram was given up after %d deliveries\n", count);
+        }
+    }
+
+    printf("loss %d%%: delivered %d/%d in %lu ms, sent %lu, retransmits %lu, lost %lu, duplicates %lu, "
+           "rto %lu ms, mean rtt %lu ms\n", loss_rate, count, DATAGRAMS, (unsigned long)(now - start),
+           (unsigned long)a.stats.sent, (unsigned long)a.stats.retransmits, (unsigned long)a.stats.lost,
+           (unsigned long)b.stats.duplicates, (unsigned long)a.rto, (unsigned long)rtt_mean(&a.rtt));
+
+    if (count + a.stats.lost != DATAGRAMS)
+    {
+        printf("%lu datagrams delivered but given up by the sender\n",
+               (unsigned long)(count + a.stats.lost - DATAGRAMS));
+        return 1;
+    }
+
+    return (count == DATAGRAMS) ? 0 : 1;
+}
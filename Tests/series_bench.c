@@ -0,0 +1,145 @@
+/*
+ * series_bench.c
+ *
+ * Host round trip and compression ratio of the delta-of-delta series codec.
+ *
+ * Build and run from this directory:
+ *   gcc -O2 -I../Inc series_bench.c ../Src/series.c -o series_bench && ./series_bench
+ *
+ * Synthetic temperature series in 1/100 C, one sample per TELEMETRY_SAMPLE_PERIOD
+ * (1800 s), are encoded, decoded and compared sample by sample. The ratio is against
+ * the 8-byte raw samples the batch stored before the codec.
+ *
+ * Every field is a whole varint, so a sample costs at least 2 bytes however regular
+ * the series is: the first cases only show that floor. The larger jitters and steps
+ * push the delta-of-delta and the value delta into 2 and 3 byte varints.
+ */
+
+
+#include <series.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+#define MAX_SAMPLES     100000
+#define SAMPLE_PERIOD   1800
+
+static uint8_t stream[5 * 2 * MAX_SAMPLES];
+static uint32_t times[MAX_SAMPLES];
+static int32_t values[MAX_SAMPLES];
+
+
+/**
+ * @function _run
+ *
+ * @brief Encodes a random walk, decodes it back and prints its size.
+ * @param name: Label of the series.
+ * @param count: Number of samples.
+ * @param jitter: Largest deviation of the sample period in s.
+ * @param step: Largest change of the value between two samples.
+ * @retval 0 if the series round-tripped exactly.
+ */
+static int _run(const char *name, uint32_t count, int32_t jitter, int32_t step)
+{
+    /*Local variables*/
+    series_encoderType encoder;
+    series_decoderType decoder;
+    struct timespec t0, t1;
+    uint32_t time = 800000000, decoded_time, decoded = 0;
+    int32_t value = 2150, decoded_value;
+    int result;
+    double ns;
+
+    srand(1);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        time  += SAMPLE_PERIOD + (jitter ? (rand() % (2 * jitter + 1)) - jitter : 0);
+        value += (rand() % (2 * step + 1)) - step;
+        times[i]  = time;
+        values[i] = value;
+    }
+
+    series_init(&encoder, stream, sizeof(stream), 1);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (series_append(&encoder, times[i], &values[i]) != 0)
+        {
+            printf("%s: buffer full at sample %u\n", name, i);
+            return 1;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    series_decoder_init(&decoder, stream, encoder.length, 1);
+
+    while ((result = series_next(&decoder, &decoded_time, &decoded_value)) == 1)
+    {
+        if (decoded_time != times[decoded] || decoded_value != values[decoded])
+        {
+            printf("%s: sample %u differs\n", name, decoded);
+            return 1;
+        }
+
+        decoded++;
+    }
+
+    if (result != 0 || decoded != count)
+    {
+        printf("%s: stream ended after %u of %u samples (%d)\n", name, decoded, count, result);
+        return 1;
+    }
+
+    ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / count;
+
+    printf("%-32s %6u samples %7u B  %.2f B/sample  %.1fx vs raw  %.1f ns/sample\n", name, count, encoder.length,
+           (double)encoder.length / count, 8.0 * count / encoder.length, ns);
+
+    return 0;
+}
+
+int main(void)
+{
+    /*Local variables*/
+    series_encoderType encoder;
+    series_decoderType decoder;
+    uint8_t small[7], truncated[1] = { 0x80 };
+    uint32_t stored = 0, time;
+    int32_t value = 5;
+    int failed = 0;
+
+    failed |= _run("steady period, +-0.05 C walk", 48, 0, 5);
+    failed |= _run("+-2 s jitter, +-0.05 C walk", 48, 2, 5);
+    failed |= _run("+-2 s jitter, +-0.50 C walk", 48, 2, 50);
+    failed |= _run("+-2 s jitter, +-5.00 C walk", 48, 2, 500);
+    failed |= _run("+-300 s jitter, +-0.05 C walk", 48, 300, 5);
+    failed |= _run("+-300 s jitter, +-5.00 C walk", 48, 300, 500);
+    failed |= _run("+-25 min jitter, +-50.00 C walk", 48, 1500, 5000);
+    failed |= _run("steady period, long", MAX_SAMPLES, 0, 5);
+
+    /*A full buffer refuses the sample and keeps the stream decodable*/
+    series_init(&encoder, small, sizeof(small), 1);
+    for (uint32_t i = 0; i < 10; i++)
+    {
+        if (series_append(&encoder, 1000 + i * SAMPLE_PERIOD, &value) == 0)
+        {
+            stored++;
+        }
+    }
+
+    printf("7 byte buffer holds %u samples in %u bytes\n", stored, encoder.length);
+
+    /*A stream cut inside a varint is reported, not read past*/
+    series_decoder_init(&decoder, truncated, sizeof(truncated), 1);
+    if (series_next(&decoder, &time, &value) != -1)
+    {
+        printf("truncated stream not reported\n");
+        failed = 1;
+    }
+
+    return failed;
+}